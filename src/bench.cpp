@@ -0,0 +1,441 @@
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// my
+#include "constants.hpp"
+#include "flow_kernel.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "water_grid.hpp"
+
+/*
+    ------------ aquablock_bench -------------
+    headless, deterministic benchmark of the simulation. every scenario is
+    built from a fixed seed and run for a fixed number of ticks so two runs
+    of the same build do the same work, and the final state checksum shows
+    when a change to the flow kernel changed the results.
+
+    usage: aquablock_bench [--sizes 256,1024,2048] [--ticks 200] [--warmup 20]
+                           [--scenarios dam_break,flooded,...]
+                           [--threads 0] [--format float32|fixed16]
+                           [--layout row_major|tiled] [--out results.json]
+                           [--trace trace.json] [--profile-csv phases.csv]
+
+    a size is a square grid, or WIDTHxHEIGHT for any other shape.
+    --layout tiled holds the planes a chunk to a tile, see plane_layout.
+    the checksums are the same in either layout, and a grid well past the
+    last level cache, --sizes 8192x4096 or more, shows what each costs.
+
+    --threads 0 runs the serial step(), anything else step(pool).
+    --trace and --profile-csv need a build with AQUABLOCK_PROFILE.
+    the kernel is chosen as usual, so AQUABLOCK_KERNEL=scalar etc. works.
+ */
+
+namespace {
+
+//------------------------------------------------------------
+//                        scenarios                         //
+//------------------------------------------------------------
+
+struct scenario {
+    char const * name;
+
+    // builds the starting state
+    std::function<void(water_grid &, std::mt19937 &)> setup;
+
+    // called before every tick, may be empty
+    std::function<void(water_grid &, std::mt19937 &)> per_tick;
+};
+
+//------------------------------------------------------------
+std::vector<scenario>
+make_scenarios() {
+    std::vector<scenario> scenarios;
+
+    // a wall of water in the left third collapses across the floor
+    scenarios.push_back({"dam_break", [](water_grid & grid, std::mt19937 &) {
+        for (int y = 1; y < grid.height() - 1; y++) {
+            for (int x = 1; x < grid.width() / 3; x++) {
+                grid.set_water(x, y, constants::max_mass);
+            }
+        }
+    }, {}});
+
+    // droplets keep falling along the top row onto an empty grid
+    scenarios.push_back({"constant_rain", [](water_grid &, std::mt19937 &) {}, [](water_grid & grid, std::mt19937 & rng) {
+        auto const drops = std::max(1, grid.width() / 64);
+        for (int i = 0; i < drops; i++) {
+            grid.set_water(1 + static_cast<int>(rng() % static_cast<unsigned>(grid.width() - 2)), 1, constants::max_mass);
+        }
+    }});
+
+    // the bottom half full to the brim, which should sleep almost entirely
+    scenarios.push_back({"settled_basin", [](water_grid & grid, std::mt19937 &) {
+        for (int y = grid.height() / 2; y < grid.height() - 1; y++) {
+            for (int x = 1; x < grid.width() - 1; x++) {
+                grid.set_water(x, y, constants::max_mass);
+            }
+        }
+    }, {}});
+
+    // single droplets scattered over ground ledges, about one per 128x128 area
+    scenarios.push_back({"sparse_droplets", [](water_grid & grid, std::mt19937 & rng) {
+        auto const count = std::max(1, (grid.width() / 128) * (grid.height() / 128));
+        for (int i = 0; i < count; i++) {
+            auto const x = 2 + static_cast<int>(rng() % static_cast<unsigned>(grid.width() - 12));
+            auto const y = 2 + static_cast<int>(rng() % static_cast<unsigned>(grid.height() - 4));
+
+            for (int ledge = 0; ledge < 8; ledge++) {
+                grid.set_ground(x + ledge, y + 1);
+            }
+            grid.set_water(x + 4, y, constants::max_mass);
+        }
+    }, {}});
+
+    // every interior cell holds water at a random mass, so everything moves
+    scenarios.push_back({"flooded", [](water_grid & grid, std::mt19937 & rng) {
+        for (int y = 1; y < grid.height() - 1; y++) {
+            for (int x = 1; x < grid.width() - 1; x++) {
+                auto const mass = constants::min_mass + static_cast<float>(rng() % 1000) * ((constants::max_mass - constants::min_mass) / 1000.0f);
+                grid.set_water(x, y, mass);
+            }
+        }
+    }, {}});
+
+    // bands of sand, water, oil and lava held up off the floor fall and
+    // run into each other, so the material kernels do the work where they
+    // meet
+    scenarios.push_back({"mixed_materials", [](water_grid & grid, std::mt19937 &) {
+        material const bands[] = {material::SAND, material::WATER, material::OIL, material::LAVA};
+        auto const band = std::max(1, grid.width() / 12);
+        for (int i = 0; i < 4; i++) {
+            grid.fill_rect(1 + i * band, 1, (i + 1) * band, grid.height() / 2, bands[i], constants::max_mass);
+        }
+    }, {}});
+
+    return scenarios;
+}
+
+//------------------------------------------------------------
+//                         results                          //
+//------------------------------------------------------------
+
+struct grid_size {
+    int width;
+    int height;
+};
+
+struct result {
+    std::string scenario;
+    grid_size size;
+    int ticks;
+    double seconds;
+    double ticks_per_second;
+    double ns_per_cell;
+    double mean_awake_chunks;
+    std::size_t grid_bytes;
+    double total_mass;
+    std::uint64_t checksum;
+};
+
+//------------------------------------------------------------
+// fnv-1a over every plane, so any change to the results shows up
+std::uint64_t
+checksum(water_grid const & grid, double & total_mass) {
+    std::uint64_t hash = 14695981039346656037ull;
+    total_mass = 0.0;
+
+    auto mix = [&hash](void const * data, std::size_t size) {
+        auto const * bytes = static_cast<unsigned char const *>(data);
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (int y = 0; y < grid.height(); y++) {
+        for (int x = 0; x < grid.width(); x++) {
+            auto const type = static_cast<std::uint8_t>(grid.material_at(x, y));
+            auto const mass = grid.mass_at(x, y);
+            auto const mass_next = grid.mass_next_at(x, y);
+
+            mix(&type, sizeof(type));
+            mix(&mass, sizeof(mass));
+            mix(&mass_next, sizeof(mass_next));
+            total_mass += mass;
+        }
+    }
+
+    return hash;
+}
+
+//------------------------------------------------------------
+result
+run(scenario const & s, grid_size size, int ticks, int warmup, thread_pool * pool, mass_format format, cell_layout layout) {
+    water_grid grid(size.width, size.height, format, layout);
+    std::mt19937 rng(1234);
+
+    s.setup(grid, rng);
+
+    auto tick = [&] {
+        if (s.per_tick) s.per_tick(grid, rng);
+        if (pool) grid.step(*pool); else grid.step();
+    };
+
+    for (int i = 0; i < warmup; i++) {
+        tick();
+    }
+
+    double awake = 0.0;
+
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ticks; i++) {
+        tick();
+        awake += static_cast<double>(grid.awake_chunk_count());
+    }
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result r;
+    r.scenario = s.name;
+    r.size = size;
+    r.ticks = ticks;
+    r.seconds = seconds;
+    r.ticks_per_second = ticks / seconds;
+    r.ns_per_cell = seconds * 1e9 / (static_cast<double>(ticks) * size.width * size.height);
+    r.mean_awake_chunks = awake / ticks;
+    r.grid_bytes = grid.memory_bytes();
+    r.checksum = checksum(grid, r.total_mass);
+    return r;
+}
+
+//------------------------------------------------------------
+// peak resident set size of the whole process in bytes, 0 if unknown
+std::size_t
+peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage {};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    #ifdef __APPLE__
+        return static_cast<std::size_t>(usage.ru_maxrss);
+    #else
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+    #endif
+    }
+#endif
+    return 0;
+}
+
+//------------------------------------------------------------
+void
+write_json(std::ostream & out, std::vector<result> const & results, char const * kernel, std::size_t threads, mass_format format, cell_layout layout) {
+    out.precision(10);
+    out << "{\n";
+    out << "  \"kernel\": \"" << kernel << "\",\n";
+    out << "  \"format\": \"" << (format == mass_format::FIXED16 ? "fixed16" : "float32") << "\",\n";
+    out << "  \"layout\": \"" << (layout == cell_layout::TILED ? "tiled" : "row_major") << "\",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"chunk_size\": " << water_grid::chunk_size << ",\n";
+    out << "  \"peak_rss_bytes\": " << peak_rss_bytes() << ",\n";
+    out << "  \"results\": [\n";
+
+    for (std::size_t i = 0; i < results.size(); i++) {
+        auto const & r = results[i];
+        out << "    {"
+            << "\"scenario\": \"" << r.scenario << "\", "
+            << "\"width\": " << r.size.width << ", "
+            << "\"height\": " << r.size.height << ", "
+            << "\"ticks\": " << r.ticks << ", "
+            << "\"seconds\": " << r.seconds << ", "
+            << "\"ticks_per_second\": " << r.ticks_per_second << ", "
+            << "\"ns_per_cell\": " << r.ns_per_cell << ", "
+            << "\"mean_awake_chunks\": " << r.mean_awake_chunks << ", "
+            << "\"grid_bytes\": " << r.grid_bytes << ", "
+            << "\"total_mass\": " << r.total_mass << ", "
+            << "\"checksum\": \"" << std::hex << r.checksum << std::dec << "\""
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+}
+
+//------------------------------------------------------------
+std::vector<std::string>
+parse_list(std::string const & list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+//------------------------------------------------------------
+std::vector<grid_size>
+parse_sizes(std::string const & list) {
+    std::vector<grid_size> sizes;
+
+    for (auto const & item : parse_list(list)) {
+        auto const split = item.find('x');
+        if (split == std::string::npos) {
+            auto const side = std::stoi(item);
+            sizes.push_back({side, side});
+        } else {
+            sizes.push_back({std::stoi(item.substr(0, split)), std::stoi(item.substr(split + 1))});
+        }
+    }
+    return sizes;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    std::vector<grid_size> sizes {{256, 256}, {1024, 1024}, {2048, 2048}};
+    std::vector<std::string> only;
+    int ticks = 200;
+    int warmup = 20;
+    std::size_t threads = 0;
+    mass_format format = mass_format::FLOAT32;
+    cell_layout layout = cell_layout::ROW_MAJOR;
+    std::string out_path;
+    std::string trace_path;
+    std::string csv_path;
+
+    AQUABLOCK_PROFILE_THREAD("bench");
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--sizes") == 0) {
+                sizes = parse_sizes(value());
+            } else if (std::strcmp(argv[i], "--scenarios") == 0) {
+                only = parse_list(value());
+            } else if (std::strcmp(argv[i], "--ticks") == 0) {
+                ticks = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--warmup") == 0) {
+                warmup = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--threads") == 0) {
+                threads = static_cast<std::size_t>(std::stoul(value()));
+            } else if (std::strcmp(argv[i], "--format") == 0) {
+                auto const name = value();
+                if (name == "float32") {
+                    format = mass_format::FLOAT32;
+                } else if (name == "fixed16") {
+                    format = mass_format::FIXED16;
+                } else {
+                    throw std::invalid_argument("unknown format " + name);
+                }
+            } else if (std::strcmp(argv[i], "--layout") == 0) {
+                auto const name = value();
+                if (name == "row_major") {
+                    layout = cell_layout::ROW_MAJOR;
+                } else if (name == "tiled") {
+                    layout = cell_layout::TILED;
+                } else {
+                    throw std::invalid_argument("unknown layout " + name);
+                }
+            } else if (std::strcmp(argv[i], "--out") == 0) {
+                out_path = value();
+            } else if (std::strcmp(argv[i], "--trace") == 0) {
+                trace_path = value();
+            } else if (std::strcmp(argv[i], "--profile-csv") == 0) {
+                csv_path = value();
+            } else {
+                throw std::invalid_argument(std::string("unknown argument ") + argv[i]);
+            }
+        }
+
+        if (ticks < 1) {
+            throw std::invalid_argument("--ticks must be at least 1");
+        }
+
+#ifndef AQUABLOCK_PROFILE
+        if (!trace_path.empty() || !csv_path.empty()) {
+            throw std::invalid_argument("--trace and --profile-csv need a build with AQUABLOCK_PROFILE");
+        }
+#endif
+
+        std::unique_ptr<thread_pool> pool;
+        if (threads > 0) {
+            pool = std::make_unique<thread_pool>(threads);
+        }
+
+        auto scenarios = make_scenarios();
+        if (!only.empty()) {
+            for (auto const & name : only) {
+                auto const known = std::any_of(scenarios.begin(), scenarios.end(), [&name](scenario const & s) { return name == s.name; });
+                if (!known) throw std::invalid_argument("unknown scenario " + name);
+            }
+
+            scenarios.erase(std::remove_if(scenarios.begin(), scenarios.end(), [&only](scenario const & s) {
+                return std::find(only.begin(), only.end(), s.name) == only.end();
+            }), scenarios.end());
+        }
+
+        std::vector<result> results;
+
+        for (auto const size : sizes) {
+            for (auto const & s : scenarios) {
+                results.push_back(run(s, size, ticks, warmup, pool.get(), format, layout));
+
+                auto const & r = results.back();
+                std::cerr << r.scenario << " " << r.size.width << "x" << r.size.height << ": "
+                          << r.ticks_per_second << " ticks/s, "
+                          << r.ns_per_cell << " ns/cell, "
+                          << r.grid_bytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+            }
+        }
+
+        auto const * kernel = active_flow_kernel().name;
+
+        if (out_path.empty()) {
+            write_json(std::cout, results, kernel, threads, format, layout);
+        } else {
+            std::ofstream file(out_path);
+            if (!file) {
+                throw std::runtime_error("could not open " + out_path);
+            }
+            write_json(file, results, kernel, threads, format, layout);
+        }
+
+#ifdef AQUABLOCK_PROFILE
+        if (!trace_path.empty()) {
+            std::ofstream file(trace_path);
+            profiler::write_chrome_trace(file);
+        }
+
+        if (!csv_path.empty()) {
+            std::ofstream file(csv_path);
+            profiler::write_csv(file);
+        }
+#endif
+
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
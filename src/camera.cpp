@@ -0,0 +1,149 @@
+#include "camera.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+//------------------------------------------------------------
+//                          camera                          //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+camera::camera(int view_width, int view_height, int grid_width, int grid_height) noexcept(false)
+:   m_view_width{view_width}
+,   m_view_height{view_height}
+,   m_grid_width{grid_width}
+,   m_grid_height{grid_height}
+,   m_left{0.0f}
+,   m_top{0.0f}
+,   m_zoom{1.0f} {
+
+    if (view_width < 1 || view_height < 1 || grid_width < 1 || grid_height < 1) {
+        throw std::invalid_argument("camera needs a positive view and grid size");
+    }
+
+    fit();
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+camera::fit() {
+    m_zoom = std::min(fit_zoom(), max_zoom);
+    m_left = (static_cast<float>(m_grid_width) - static_cast<float>(m_view_width) / m_zoom) * 0.5f;
+    m_top = (static_cast<float>(m_grid_height) - static_cast<float>(m_view_height) / m_zoom) * 0.5f;
+}
+
+//------------------------------------------------------------
+void
+camera::pan(float dx, float dy) {
+    m_left += dx / m_zoom;
+    m_top += dy / m_zoom;
+    clamp();
+}
+
+//------------------------------------------------------------
+void
+camera::zoom_at(float screen_x, float screen_y, float factor) {
+    auto const x = cell_x(screen_x);
+    auto const y = cell_y(screen_y);
+
+    // no further out than half the size that fits, past that the grid is
+    // only a speck
+    m_zoom = std::clamp(m_zoom * factor, fit_zoom() * 0.5f, max_zoom);
+    m_left = x - screen_x / m_zoom;
+    m_top = y - screen_y / m_zoom;
+    clamp();
+}
+
+//------------------------------------------------------------
+float
+camera::cell_x(float screen_x) const {
+    return m_left + screen_x / m_zoom;
+}
+
+//------------------------------------------------------------
+float
+camera::cell_y(float screen_y) const {
+    return m_top + screen_y / m_zoom;
+}
+
+//------------------------------------------------------------
+float
+camera::screen_x(float cell_x) const {
+    return (cell_x - m_left) * m_zoom;
+}
+
+//------------------------------------------------------------
+float
+camera::screen_y(float cell_y) const {
+    return (cell_y - m_top) * m_zoom;
+}
+
+//------------------------------------------------------------
+float
+camera::left() const {
+    return m_left;
+}
+
+//------------------------------------------------------------
+float
+camera::top() const {
+    return m_top;
+}
+
+//------------------------------------------------------------
+float
+camera::zoom() const {
+    return m_zoom;
+}
+
+//------------------------------------------------------------
+int
+camera::level() const {
+    if (m_zoom >= 1.0f) return 0;
+
+    // 2^level cells per texel, at least as many as there are per pixel
+    return static_cast<int>(std::ceil(std::log2(1.0f / m_zoom) - 1e-4f));
+}
+
+//------------------------------------------------------------
+int
+camera::view_width() const {
+    return m_view_width;
+}
+
+//------------------------------------------------------------
+int
+camera::view_height() const {
+    return m_view_height;
+}
+
+//------------------------------------------------------------
+float
+camera::fit_zoom() const {
+    return std::min(static_cast<float>(m_view_width) / static_cast<float>(m_grid_width), static_cast<float>(m_view_height) / static_cast<float>(m_grid_height));
+}
+
+//------------------------------------------------------------
+void
+camera::clamp() {
+    // an axis that fits in the view stays centred, one that does not can
+    // be panned until its edge meets the edge of the view
+    auto clamp_axis = [this](float & start, int view, int grid) {
+        auto const visible = static_cast<float>(view) / m_zoom;
+        auto const size = static_cast<float>(grid);
+
+        if (visible >= size) {
+            start = (size - visible) * 0.5f;
+        } else {
+            start = std::clamp(start, 0.0f, size - visible);
+        }
+    };
+
+    clamp_axis(m_left, m_view_width, m_grid_width);
+    clamp_axis(m_top, m_view_height, m_grid_height);
+}
@@ -0,0 +1,66 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+//------------------------------------------------------------
+//                          camera                          //
+//------------------------------------------------------------
+
+// pan and zoom over a grid for a view of a fixed size in screen pixels.
+// the camera is a top left cell position plus a zoom in screen pixels per
+// cell, clamped so the grid never leaves the view entirely.
+//
+// level() says which level of the grid_pixels mip pyramid to draw from.
+// past one pixel per cell it is the first level whose texels are at least
+// a pixel wide, so the texels drawn are never more than the view has
+// pixels, however large the grid is.
+class camera final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    camera(int view_width, int view_height, int grid_width, int grid_height) noexcept(false);
+
+//                       functions                         //
+//------------------------------------------------------------
+    // the whole grid in view, centred
+    void fit();
+
+    // by screen pixels
+    void pan(float dx, float dy);
+
+    // keeping the cell under screen_x, screen_y where it is
+    void zoom_at(float screen_x, float screen_y, float factor);
+
+    // screen pixels to cells and back
+    float cell_x(float screen_x) const;
+    float cell_y(float screen_y) const;
+    float screen_x(float cell_x) const;
+    float screen_y(float cell_y) const;
+
+    float left() const;
+    float top() const;
+    float zoom() const;
+    int level() const;
+
+    int view_width() const;
+    int view_height() const;
+
+    static constexpr float max_zoom = 64.0f;
+
+private:
+    float fit_zoom() const;
+    void clamp();
+
+//                         data                             //
+//------------------------------------------------------------
+    int m_view_width;
+    int m_view_height;
+    int m_grid_width;
+    int m_grid_height;
+
+    float m_left;
+    float m_top;
+    float m_zoom;
+
+}; // camera
+
+#endif // CAMERA_HPP
@@ -0,0 +1,131 @@
+#ifndef CELL_PLANE_HPP
+#define CELL_PLANE_HPP
+
+// std
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+// my
+#include "mapped_file.hpp"
+#include "page_buffer.hpp"
+
+//------------------------------------------------------------
+//                       plane_layout                       //
+//------------------------------------------------------------
+
+// the order the cells of a grid are held in. ROW_MAJOR is one row after
+// the next. TILED holds tile x tile squares one after the next, the tiles
+// in row order and row major inside, so the rows above and below a cell
+// are a few cache lines away however wide the grid is rather than a whole
+// row. each tile has room around it for a copy of the cells next to it
+// that a flow reaches for - three columns either side and a row above and
+// below - so a chunk sweeps in place on its own tile, see water_grid
+enum class cell_layout {
+    ROW_MAJOR,
+    TILED,
+};
+
+struct plane_layout {
+    static constexpr std::size_t tile = 32;
+    static constexpr std::size_t halo_x = 3;
+    static constexpr std::size_t halo_y = 1;
+    static constexpr std::size_t tile_width = tile + 2 * halo_x;
+    static constexpr std::size_t tile_cells = tile_width * (tile + 2 * halo_y);
+
+    cell_layout kind = cell_layout::ROW_MAJOR;
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::size_t tiles_x = 0;
+    std::size_t tiles_y = 0;
+
+    static plane_layout make(cell_layout kind, std::size_t width, std::size_t height) {
+        return {kind, width, height, (width + tile - 1) / tile, (height + tile - 1) / tile};
+    }
+
+    // how many cells each plane holds, the halos and the padding of the
+    // last tiles too
+    std::size_t cell_count() const {
+        return (kind == cell_layout::TILED) ? tiles_x * tiles_y * tile_cells : width * height;
+    }
+
+    // where a tile and its halo start, tile_width cells to a row
+    std::size_t tile_first(std::size_t tile_x, std::size_t tile_y) const {
+        return (tile_x + tile_y * tiles_x) * tile_cells;
+    }
+
+    std::size_t index(std::size_t x, std::size_t y) const {
+        if (kind == cell_layout::ROW_MAJOR) return x + y * width;
+        return tile_first(x / tile, y / tile) + (y % tile + halo_y) * tile_width + x % tile + halo_x;
+    }
+
+    // how many of the count cells of a row from x on follow each other in
+    // the planes, so a row is copied a run at a time whatever the layout
+    std::size_t run(std::size_t x, std::size_t count) const {
+        if (kind == cell_layout::ROW_MAJOR) return count;
+        return std::min(count, tile - x % tile);
+    }
+};
+
+//------------------------------------------------------------
+//                        cell_plane                        //
+//------------------------------------------------------------
+
+// one plane of cells, either in its own pages or straight out of a mapped
+// world file. a mapped plane keeps its file mapped and is written copy on
+// write, so a loaded world is used in place without reading it first.
+//
+// the cells are in whatever plane_layout the owner picks, a mapped one is
+// row major as world files are. planes of 2MB and more get huge pages,
+// see page_buffer.hpp.
+template <typename T>
+class cell_plane final {
+public:
+//                       functions                         //
+//------------------------------------------------------------
+    // page backed, every cell set to value
+    void assign(std::size_t count, T const & value) {
+        static_assert(std::is_trivially_copyable_v<T>, "cell planes hold plain values straight in pages");
+
+        m_pages = std::make_unique<page_buffer>(count * sizeof(T));
+        m_file.reset();
+        m_data = reinterpret_cast<T *>(m_pages->data());
+        m_size = count;
+        std::fill(m_data, m_data + count, value);
+    }
+
+    // count cells at byte offset in file, which must be suitably aligned
+    void map(std::shared_ptr<mapped_file> const & file, std::size_t offset, std::size_t count) {
+        m_pages.reset();
+        m_file = file;
+        m_data = reinterpret_cast<T *>(file->data() + offset);
+        m_size = count;
+    }
+
+    T & operator[](std::size_t i) { return m_data[i]; }
+    T const & operator[](std::size_t i) const { return m_data[i]; }
+
+    T * data() { return m_data; }
+    T const * data() const { return m_data; }
+
+    T * begin() { return m_data; }
+    T * end() { return m_data + m_size; }
+    T const * begin() const { return m_data; }
+    T const * end() const { return m_data + m_size; }
+
+    std::size_t size() const { return m_size; }
+    bool is_mapped() const { return m_file != nullptr; }
+    bool wants_huge_pages() const { return m_pages && m_pages->wants_huge_pages(); }
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::unique_ptr<page_buffer> m_pages;
+    std::shared_ptr<mapped_file> m_file;
+    T * m_data = nullptr;
+    std::size_t m_size = 0;
+
+}; // cell_plane
+
+#endif // CELL_PLANE_HPP
@@ -19,7 +19,7 @@ struct colour {
     int b;
 };
 
-colour lerp_colour(colour const & lhs, colour const & rhs, float amount) {
+inline colour lerp_colour(colour const & lhs, colour const & rhs, float amount) {
     colour colour(0,0,0);
 
     auto lerp = [](auto a, auto b, float t) {
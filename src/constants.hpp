@@ -1,6 +1,9 @@
 #ifndef CONSTANTS_HPP
 #define CONSTANTS_HPP
 
+// my
+#include "colour.hpp"
+
 namespace constants {
     constexpr const float min_mass = 5;
     constexpr const float max_mass = 255;
@@ -9,6 +12,17 @@ namespace constants {
     constexpr const colour max_water_colour(0, 72, 112);
     constexpr const colour selection(255, 0, 0);
     constexpr const colour air(76, 76, 76);
+    constexpr const colour ground(24, 44, 76);
+    constexpr const colour sand(194, 170, 110);
+    constexpr const colour oil(92, 70, 34);
+    constexpr const colour lava(238, 88, 20);
+
+    // mass_format::FIXED16 - unsigned 9.7 fixed point. mass is clamped to
+    // max_mass, and mass_next can reach at most about 1.84 * max_mass (a
+    // cell can only take in down + room / 2 + room / 3), which fits 16 bits
+    constexpr const int fixed_mass_scale = 128;
+    constexpr const int fixed_min_mass = static_cast<int>(min_mass) * fixed_mass_scale;
+    constexpr const int fixed_max_mass = static_cast<int>(max_mass) * fixed_mass_scale;
 }
 
 #endif // CONSTANTS_HPP
@@ -0,0 +1,358 @@
+// std
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// my
+#include "constants.hpp"
+#include "grid_edit.hpp"
+#include "material_registry.hpp"
+#include "socket_transport.hpp"
+#include "subdomain.hpp"
+#include "thread_pool.hpp"
+#include "water_grid.hpp"
+#include "world_file.hpp"
+
+// dependancies
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+    ------------- aquablock_dist --------------
+    one grid split between several processes on this machine, each
+    stepping its own rectangle and swapping halos with its neighbours
+    over unix sockets, see subdomain.hpp. rank 0 is this process. no
+    process ever holds the whole grid, so it can be bigger than one of
+    them could hold.
+
+    usage: aquablock_dist [--ranks 2x2] [--size 1024x512] [--ticks 500]
+                          [--format float32|fixed16] [--threads 0]
+                          [--out gathered.world] [--verify]
+
+    --out has rank 0 gather the owned cells of every rank into a world
+    file at the end, a row at a time straight to disk.
+    --verify runs the same ticks again in one grid and checks the
+    gathered cells against it cell for cell, that grid is whole so keep
+    --size within memory when verifying. without --out rank 0 gathers
+    into a second whole grid for it.
+ */
+
+namespace {
+
+//------------------------------------------------------------
+void
+parse_pair(char const * flag, std::string const & text, int & first, int & second) {
+    auto const split = text.find('x');
+    if (split == std::string::npos) {
+        throw std::invalid_argument(std::string(flag) + " wants AxB, not " + text);
+    }
+
+    first = std::stoi(text.substr(0, split));
+    second = std::stoi(text.substr(split + 1));
+}
+
+//------------------------------------------------------------
+std::vector<grid_edit>
+scenario(int width, int height) {
+    // a dam break over a floor with a wall and a ledge in the way, so water
+    // crosses every rank boundary and piles up against ground near them.
+    // sand, oil and lava fall in after it so the material kernels cross
+    // the boundaries too
+    return {
+        grid_edit::rect(grid_edit::kind::WATER, 1, 1, width / 3, height - 2, constants::max_mass),
+        grid_edit::rect(grid_edit::kind::GROUND, width / 2, height * 2 / 3, width / 2 + width / 40, height - 2),
+        grid_edit::line(grid_edit::kind::GROUND, width * 2 / 3, height / 2, width - 2, height / 2 + height / 8, 1),
+        grid_edit::circle(grid_edit::kind::WATER, width * 3 / 4, height / 4, height / 10, constants::max_mass),
+        grid_edit::circle(grid_edit::kind::SAND, width / 2, height / 6, height / 12, constants::max_mass),
+        grid_edit::circle(grid_edit::kind::OIL, width * 2 / 5, height / 3, height / 12, constants::max_mass),
+        grid_edit::rect(grid_edit::kind::LAVA, width * 5 / 6, 1, width * 5 / 6 + width / 20, height / 5, constants::max_mass),
+    };
+}
+
+//------------------------------------------------------------
+// a world file written a row at a time as rank 0 gathers them, in the
+// layout world_saver writes. the directory and then the header go last,
+// so a run that fails halfway leaves a file that will not open
+class gathered_file {
+public:
+    gathered_file(std::string const & path, int width, int height, mass_format format) noexcept(false)
+    :   m_path{path}
+    ,   m_header{world_file_header::make(width, height, format)}
+    ,   m_directory(m_header.chunk_count(), world_file_chunk{})
+    ,   m_out{path, std::ios::out | std::ios::binary | std::ios::trunc} {
+
+        if (!m_out) {
+            throw std::runtime_error("could not open " + path + " for writing");
+        }
+    }
+
+    // count cells from x, y in the layout of water_grid::read_cells()
+    void write_row(int x, int y, int count, unsigned char const * cells) {
+        auto const n = static_cast<std::size_t>(count);
+        auto const at = static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(m_header.width);
+        auto const mass_bytes = m_header.mass_bytes();
+        auto const * types = reinterpret_cast<material const *>(cells);
+
+        std::uint64_t const planes[3][2] = {
+            {m_header.material_offset, sizeof(material)},
+            {m_header.mass_offset, mass_bytes},
+            {m_header.mass_next_offset, mass_bytes},
+        };
+
+        for (auto const & plane : planes) {
+            m_out.seekp(static_cast<std::streamoff>(plane[0] + at * plane[1]));
+            m_out.write(reinterpret_cast<char const *>(cells), static_cast<std::streamsize>(n * plane[1]));
+            cells += n * plane[1];
+        }
+
+        auto const chunk_y = static_cast<std::size_t>(y) / water_grid::chunk_size;
+
+        for (std::size_t i = 0; i < n; i++) {
+            if (properties_of(types[i]).moves) {
+                auto const chunk_x = (static_cast<std::size_t>(x) + i) / water_grid::chunk_size;
+                m_directory[chunk_x + chunk_y * m_header.chunks_x].water = 1;
+            }
+        }
+    }
+
+    void finish() {
+        m_header.generation = 1;
+        for (auto & entry : m_directory) {
+            entry.generation = m_header.generation;
+        }
+
+        m_out.seekp(static_cast<std::streamoff>(m_header.directory_offset));
+        m_out.write(reinterpret_cast<char const *>(m_directory.data()), static_cast<std::streamsize>(m_directory.size() * sizeof(world_file_chunk)));
+        m_out.seekp(0);
+        m_out.write(reinterpret_cast<char const *>(&m_header), sizeof(m_header));
+        m_out.flush();
+
+        if (!m_out) {
+            throw std::runtime_error("could not write " + m_path);
+        }
+    }
+
+private:
+    std::string m_path;
+    world_file_header m_header;
+    std::vector<world_file_chunk> m_directory;
+    std::ofstream m_out;
+};
+
+//------------------------------------------------------------
+template <typename T>
+std::size_t
+first_difference(T const * a, T const * b, std::size_t count) {
+    for (std::size_t i = 0; i < count; i++) {
+        if (std::memcmp(a + i, b + i, sizeof(T)) != 0) return i;
+    }
+    return count;
+}
+
+//------------------------------------------------------------
+bool
+verify(water_grid const & gathered, int ticks, std::size_t threads) {
+    water_grid whole(gathered.width(), gathered.height(), gathered.format());
+    for (auto const & edit : scenario(whole.width(), whole.height())) {
+        edit.apply(whole);
+    }
+
+    std::unique_ptr<thread_pool> pool;
+    if (threads > 0) pool = std::make_unique<thread_pool>(threads);
+
+    for (int tick = 0; tick < ticks; tick++) {
+        if (pool) whole.step(*pool); else whole.step();
+    }
+
+    auto const cells = static_cast<std::size_t>(whole.width()) * static_cast<std::size_t>(whole.height());
+
+    auto report = [&](char const * plane, std::size_t at) {
+        if (at == cells) return true;
+        std::cout << plane << " differs first at " << at % static_cast<std::size_t>(whole.width()) << ", " << at / static_cast<std::size_t>(whole.width()) << std::endl;
+        return false;
+    };
+
+    auto same = report("material", first_difference(gathered.material_data(), whole.material_data(), cells));
+    if (whole.format() == mass_format::FIXED16) {
+        same = report("mass", first_difference(gathered.fixed_mass_data(), whole.fixed_mass_data(), cells)) && same;
+        same = report("mass_next", first_difference(gathered.fixed_mass_next_data(), whole.fixed_mass_next_data(), cells)) && same;
+    } else {
+        same = report("mass", first_difference(gathered.mass_data(), whole.mass_data(), cells)) && same;
+        same = report("mass_next", first_difference(gathered.mass_next_data(), whole.mass_next_data(), cells)) && same;
+    }
+
+    if (same) std::cout << "identical to one grid" << std::endl;
+    return same;
+}
+
+//------------------------------------------------------------
+// the part every rank runs. rank 0 is handed the gathered rows if there
+// are any, see subdomain::gather()
+double
+run(subdomain & part, int width, int height, int ticks, std::size_t threads, bool gathering, subdomain::row_sink const & row) {
+    for (auto const & edit : scenario(width, height)) {
+        part.apply(edit);
+    }
+
+    std::unique_ptr<thread_pool> pool;
+    if (threads > 0) pool = std::make_unique<thread_pool>(threads);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; tick++) {
+        if (pool) part.step(*pool); else part.step();
+    }
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (gathering) part.gather(row);
+    return seconds;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    int ranks_x = 2;
+    int ranks_y = 2;
+    int width = 1024;
+    int height = 512;
+    int ticks = 500;
+    mass_format format = mass_format::FLOAT32;
+    std::size_t threads = 0;
+    std::string out_path;
+    bool check = false;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--ranks") == 0) {
+                parse_pair("--ranks", value(), ranks_x, ranks_y);
+            } else if (std::strcmp(argv[i], "--size") == 0) {
+                parse_pair("--size", value(), width, height);
+            } else if (std::strcmp(argv[i], "--ticks") == 0) {
+                ticks = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--format") == 0) {
+                auto const name = value();
+                if (name == "float32") {
+                    format = mass_format::FLOAT32;
+                } else if (name == "fixed16") {
+                    format = mass_format::FIXED16;
+                } else {
+                    throw std::invalid_argument("--format wants float32 or fixed16, not " + name);
+                }
+            } else if (std::strcmp(argv[i], "--threads") == 0) {
+                threads = static_cast<std::size_t>(std::stoul(value()));
+            } else if (std::strcmp(argv[i], "--out") == 0) {
+                out_path = value();
+            } else if (std::strcmp(argv[i], "--verify") == 0) {
+                check = true;
+            } else {
+                throw std::invalid_argument(std::string("unknown argument ") + argv[i]);
+            }
+        }
+
+        if (ranks_x < 1 || ranks_y < 1 || ticks < 0) {
+            throw std::invalid_argument("--ranks must be at least 1x1 and --ticks must not be negative");
+        }
+        if (width / ranks_x < subdomain::halo_x || height / ranks_y < subdomain::halo_y) {
+            throw std::invalid_argument("--size is too small to split between that many --ranks");
+        }
+
+        bool const gathering = check || !out_path.empty();
+
+        auto const ranks = ranks_x * ranks_y;
+        auto links = socket_transport::local_links(ranks_x, ranks_y);
+        std::vector<pid_t> children;
+
+        for (int rank = 1; rank < ranks; rank++) {
+            std::cout.flush();
+            auto const child = ::fork();
+            if (child < 0) {
+                throw std::runtime_error(std::string("starting rank ") + std::to_string(rank) + " failed: " + std::strerror(errno));
+            }
+
+            if (child == 0) {
+                // a rank that fails takes its links down with it, which
+                // stops the ones waiting on it too
+                int code = 0;
+                try {
+                    socket_transport::close_links(links, rank);
+                    socket_transport transport(links[static_cast<std::size_t>(rank)]);
+                    subdomain part(width, height, ranks_x, ranks_y, rank, transport, format);
+                    run(part, width, height, ticks, threads, gathering, {});
+                } catch (std::exception const &e) {
+                    std::cerr << "rank " << rank << ": " << e.what() << std::endl;
+                    code = 1;
+                }
+                ::_exit(code);
+            }
+
+            children.push_back(child);
+        }
+
+        socket_transport::close_links(links, 0);
+
+        // rank 0 only ever holds one row of the gathered cells, unless they
+        // go into a whole grid for --verify
+        std::unique_ptr<gathered_file> file;
+        std::unique_ptr<water_grid> whole;
+        subdomain::row_sink row;
+
+        if (!out_path.empty()) {
+            file = std::make_unique<gathered_file>(out_path, width, height, format);
+            row = [&](int x, int y, int count, unsigned char const * cells) { file->write_row(x, y, count, cells); };
+        } else if (check) {
+            whole = std::make_unique<water_grid>(width, height, format);
+            row = [&](int x, int y, int count, unsigned char const * cells) { whole->write_cells(x, y, count, cells); };
+        }
+
+        double seconds = 0.0;
+        {
+            socket_transport transport(links[0]);
+            subdomain part(width, height, ranks_x, ranks_y, 0, transport, format);
+            seconds = run(part, width, height, ticks, threads, gathering, row);
+        }
+
+        if (file) file->finish();
+
+        bool failed = false;
+        for (auto const child : children) {
+            int status = 0;
+            if (::waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                failed = true;
+            }
+        }
+        if (failed) {
+            throw std::runtime_error("a rank failed");
+        }
+
+        std::cout << ranks_x << "x" << ranks_y << " ranks, " << width << "x" << height
+                  << ", " << ticks << " ticks in " << seconds << " s, "
+                  << (seconds > 0.0 ? ticks / seconds : 0.0) << " ticks/s" << std::endl;
+
+        if (check) {
+            if (file) {
+                world_file const gathered(out_path);
+                whole = std::make_unique<water_grid>(gathered);
+            }
+
+            if (!verify(*whole, ticks, threads)) {
+                return 1;
+            }
+        }
+
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+// std
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// my
+#include "constants.hpp"
+#include "frame_recorder.hpp"
+#include "grid_pixels.hpp"
+#include "grid_snapshot.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "water_grid.hpp"
+#include "world_file.hpp"
+
+/*
+    ------------ aquablock_export -------------
+    headless recording of the simulation, for machines with no display.
+    runs a world file (or a dam break on an empty grid) for a number of
+    ticks and writes a frame every few of them, see frame_recorder.hpp
+    for the formats.
+
+    usage: aquablock_export --out video.y4m|frames.ppm|frame_#####.ppm
+                            [--world aquablock.world | --size 512x256]
+                            [--ticks 600] [--every 1] [--fps 30] [--scale 1]
+                            [--buffers 4] [--drop] [--threads 0]
+                            [--settle 0]
+
+    the simulation waits for the writer when it falls behind, so every
+    frame is written and the video keeps the --fps it declares. --drop
+    drops frames instead, for runs where the simulation must not slow
+    down and gaps in the video are fine. --settle N levels
+    closed basins before the first tick and then every N ticks, see
+    water_grid::settle_basins().
+ */
+
+namespace {
+
+//------------------------------------------------------------
+void
+parse_size(std::string const & text, int & width, int & height) {
+    auto const split = text.find('x');
+    if (split == std::string::npos) {
+        throw std::invalid_argument("--size wants WIDTHxHEIGHT, not " + text);
+    }
+
+    width = std::stoi(text.substr(0, split));
+    height = std::stoi(text.substr(split + 1));
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    std::string out_path;
+    std::string world_path;
+    int width = 512;
+    int height = 256;
+    int ticks = 600;
+    int every = 1;
+    int fps = 30;
+    int scale = 1;
+    std::size_t buffers = 4;
+    auto when_full = frame_recorder::overflow::WAIT;
+    std::size_t threads = 0;
+    int settle = 0;
+
+    AQUABLOCK_PROFILE_THREAD("export");
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--out") == 0) {
+                out_path = value();
+            } else if (std::strcmp(argv[i], "--world") == 0) {
+                world_path = value();
+            } else if (std::strcmp(argv[i], "--size") == 0) {
+                parse_size(value(), width, height);
+            } else if (std::strcmp(argv[i], "--ticks") == 0) {
+                ticks = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--every") == 0) {
+                every = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--fps") == 0) {
+                fps = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--scale") == 0) {
+                scale = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--buffers") == 0) {
+                buffers = static_cast<std::size_t>(std::stoul(value()));
+            } else if (std::strcmp(argv[i], "--drop") == 0) {
+                when_full = frame_recorder::overflow::DROP;
+            } else if (std::strcmp(argv[i], "--threads") == 0) {
+                threads = static_cast<std::size_t>(std::stoul(value()));
+            } else if (std::strcmp(argv[i], "--settle") == 0) {
+                settle = std::stoi(value());
+            } else {
+                throw std::invalid_argument(std::string("unknown argument ") + argv[i]);
+            }
+        }
+
+        if (out_path.empty()) {
+            throw std::invalid_argument("--out is needed");
+        }
+        if (ticks < 0 || every < 1 || settle < 0) {
+            throw std::invalid_argument("--ticks and --settle must not be negative and --every must be at least 1");
+        }
+
+        std::unique_ptr<world_file> file;
+        if (!world_path.empty()) {
+            file = std::make_unique<world_file>(world_path);
+        }
+
+        water_grid grid = file ? water_grid(*file) : water_grid(width, height);
+
+        // with no world the left third starts full and breaks across the floor
+        if (!file) {
+            grid.fill_rect(1, 1, grid.width() / 3, grid.height() - 2, material::WATER, constants::max_mass);
+        }
+
+        std::unique_ptr<thread_pool> pool;
+        if (threads > 0) {
+            pool = std::make_unique<thread_pool>(threads);
+        }
+
+        grid_pixels pixels(grid.width(), grid.height());
+        frame_recorder recorder(out_path, grid.width(), grid.height(), fps, scale, buffers, when_full);
+
+        // the same as sim_thread's publish - each frame only copies and
+        // repaints the chunks that changed since the one before
+        grid_snapshot snapshot;
+        std::vector<std::uint64_t> chunk_ticks(grid.chunks_x() * grid.chunks_y(), 0);
+        std::vector<std::size_t> changed;
+
+        auto frame = [&](std::uint64_t tick) {
+            grid.take_changed_chunks(changed);
+            for (auto const chunk : changed) {
+                chunk_ticks[chunk] = tick;
+            }
+
+            snapshot.capture(grid, tick, chunk_ticks);
+            pixels.paint(snapshot);
+            pixels.clear_dirty();
+            recorder.record(pixels);
+        };
+
+        auto const start = std::chrono::steady_clock::now();
+
+        if (settle > 0) grid.settle_basins();
+
+        frame(0);
+        for (int tick = 1; tick <= ticks; tick++) {
+            if (pool) grid.step(*pool); else grid.step();
+
+            if (settle > 0 && tick % settle == 0) {
+                grid.settle_basins();
+            }
+
+            if (tick % every == 0) {
+                frame(static_cast<std::uint64_t>(tick));
+            }
+        }
+
+        recorder.flush();
+        auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cerr << "wrote " << recorder.frames_written() << " frames to " << out_path
+                  << ", dropped " << recorder.frames_dropped()
+                  << ", " << seconds << " s" << std::endl;
+
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include "flow_kernel.hpp"
+
+// std
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// my
+#include "constants.hpp"
+#include "flow_kernel_fixed.hpp"
+
+#if defined(AQUABLOCK_X86_KERNELS)
+#include <cpuid.h>
+
+extern flow_kernel const sse2_flow_kernel;
+extern flow_kernel const avx2_flow_kernel;
+extern flow_kernel const avx512_flow_kernel;
+#endif
+
+namespace {
+
+//------------------------------------------------------------
+//                      scalar kernel                       //
+//------------------------------------------------------------
+
+// the reference rules, one cell at a time. the cells either side of the
+// span are run too, but only their flows into the span are written.
+bool
+scalar_flow_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, std::size_t x_end, flow_writes writes) {
+    auto const width = planes.width;
+    bool const write_row = writes != flow_writes::DOWN;
+    bool const write_down = writes != flow_writes::ROW;
+
+    material const * types = planes.types;
+    float const * mass = planes.mass;
+    float * mass_next = planes.mass_next;
+
+    // the border is ground so it never flows and is never looked at
+    auto const first = (x_begin > 1) ? x_begin - 1 : x_begin;
+    auto const last = (x_end < width - 1) ? x_end + 1 : x_end;
+
+    auto in_span = [&](std::size_t x) { return x >= x_begin && x < x_end; };
+
+    bool moved = false;
+
+    for (auto x = first; x < last; x++) {
+
+        auto const i = x + y * width;
+        bool const own = in_span(x);
+
+        // test the byte plane first so air and ground never touch the floats
+        if (types[i] != material::WATER) continue;
+
+        auto remaining = mass[i];
+
+        if (remaining < constants::min_mass) continue;
+
+
+        // downwards flow
+        auto const down_index = i + width;
+
+        if (types[down_index] != material::GROUND) {
+            auto room = constants::max_mass - mass[down_index];
+            auto flow = std::min(room, remaining);
+
+            // if flow is negative constrain to 0
+            flow = std::max(flow, 0.0f);
+
+            if (flow > std::min(constants::max_mass, mass[i]))
+                flow = std::min(constants::max_mass, mass[i]);
+
+            if (own) {
+                if (write_row) mass_next[i] -= flow;
+                if (write_down) mass_next[down_index] += flow;
+                moved |= flow != 0.0f;
+            }
+            remaining -= flow;
+        }
+
+
+        // if no water left to work with, skip to next loop
+        if (remaining < constants::min_mass) continue;
+
+
+        // left flow
+        auto const left_index = i - 1;
+
+        if (types[left_index] != material::GROUND) {
+            auto room = constants::max_mass - mass[left_index];
+            auto flow = std::min(room, remaining) / 3.0f;
+
+            flow = std::max(flow, 0.0f);
+
+            if (flow > std::min(constants::max_mass, mass[i]))
+                flow = std::min(constants::max_mass, mass[i]);
+
+            if (write_row) {
+                if (own) mass_next[i] -= flow;
+                if (in_span(x - 1)) mass_next[left_index] += flow;
+                moved |= (own || in_span(x - 1)) && flow != 0.0f;
+            }
+            remaining -= flow;
+        }
+
+
+        // if no water left to work with, skip to next loop
+        if (remaining < constants::min_mass) continue;
+
+
+        // right flow
+        auto const right_index = i + 1;
+
+        if (types[right_index] != material::GROUND) {
+            auto room = constants::max_mass - mass[right_index];
+            auto flow = std::min(room, remaining) / 2.0f;
+
+            flow = std::max(flow, 0.0f);
+
+            if (flow > std::min(constants::max_mass, mass[i]))
+                flow = std::min(constants::max_mass, mass[i]);
+
+            if (write_row) {
+                if (own) mass_next[i] -= flow;
+                if (in_span(x + 1)) mass_next[right_index] += flow;
+                moved |= (own || in_span(x + 1)) && flow != 0.0f;
+            }
+            remaining -= flow;
+        }
+    }
+
+    return moved;
+}
+
+//------------------------------------------------------------
+bool
+scalar_commit(grid_planes const & planes, std::size_t begin, std::size_t end) {
+    bool water = false;
+
+    for (auto i = begin; i < end; i++) {
+        if (planes.types[i] == material::GROUND) continue;
+
+        auto const next = planes.mass_next[i];
+
+        if (next < constants::min_mass) {
+            planes.types[i] = material::AIR;
+            planes.mass[i] = 0.0f;
+            planes.mass_next[i] = 0.0f;
+        } else {
+            planes.types[i] = material::WATER;
+
+            // clamp the mass - mass_next keeps any excess
+            planes.mass[i] = std::min(next, constants::max_mass);
+            water = true;
+        }
+    }
+
+    return water;
+}
+
+//------------------------------------------------------------
+// the flows out of cell i, worked out as in scalar_flow_row and 0 where
+// it would skip them
+void
+scalar_cell_flows(grid_planes const & planes, std::size_t i, float & down, float & left, float & right) {
+    auto const width = planes.width;
+    material const * types = planes.types;
+    float const * mass = planes.mass;
+
+    down = 0.0f;
+    left = 0.0f;
+    right = 0.0f;
+
+    if (types[i] != material::WATER) return;
+
+    auto remaining = mass[i];
+    auto const cap = std::min(constants::max_mass, mass[i]);
+
+    if (remaining < constants::min_mass) return;
+
+    if (types[i + width] != material::GROUND) {
+        auto flow = std::max(std::min(constants::max_mass - mass[i + width], remaining), 0.0f);
+        down = (flow > cap) ? cap : flow;
+        remaining -= down;
+    }
+
+    if (remaining < constants::min_mass) return;
+
+    if (types[i - 1] != material::GROUND) {
+        auto flow = std::max(std::min(constants::max_mass - mass[i - 1], remaining) / 3.0f, 0.0f);
+        left = (flow > cap) ? cap : flow;
+        remaining -= left;
+    }
+
+    if (remaining < constants::min_mass) return;
+
+    if (types[i + 1] != material::GROUND) {
+        auto flow = std::max(std::min(constants::max_mass - mass[i + 1], remaining) / 2.0f, 0.0f);
+        right = (flow > cap) ? cap : flow;
+    }
+}
+
+//------------------------------------------------------------
+// each cell adds up its flows in the order scalar_flow_row would have
+// added them to mass_next, then commits as scalar_commit does, into to
+sweep_result
+scalar_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, float * carry, sweep_writes writes) {
+    constexpr std::size_t block_size = 256;
+
+    // slot 0 is the cell before the block, slot count + 1 the one after
+    float down[block_size + 2];
+    float left[block_size + 2];
+    float right[block_size + 2];
+
+    auto const width = from.width;
+    sweep_result result {false, false};
+
+    for (auto begin = x_begin; begin < x_end; begin += block_size) {
+        auto const end = std::min(begin + block_size, x_end);
+        auto const count = end - begin;
+        float * block_carry = carry + (begin - x_begin);
+
+        // the border is ground and flows nothing
+        auto const first = (begin > 1) ? begin - 1 : begin;
+        auto const last = (end < width - 1) ? end + 1 : end;
+
+        std::fill(down, down + count + 2, 0.0f);
+        std::fill(left, left + count + 2, 0.0f);
+        std::fill(right, right + count + 2, 0.0f);
+
+        for (auto x = first; x < last; x++) {
+            auto const slot = x + 1 - begin;
+            scalar_cell_flows(from, x + y * width, down[slot], left[slot], right[slot]);
+        }
+
+        if (writes == sweep_writes::CARRY) {
+            for (std::size_t slot = 1; slot <= count; slot++) {
+                block_carry[slot - 1] = down[slot];
+                result.moved |= down[slot] != 0.0f;
+            }
+            continue;
+        }
+
+        for (auto x = begin; x < end; x++) {
+            auto const i = x + y * width;
+            auto const slot = x + 1 - begin;
+
+            auto const next = (((((from.mass_next[i] + block_carry[slot - 1]) + right[slot - 1]) - down[slot]) - left[slot]) - right[slot]) + left[slot + 1];
+
+            block_carry[slot - 1] = down[slot];
+            result.moved |= right[slot - 1] != 0.0f || down[slot] != 0.0f || left[slot] != 0.0f || right[slot] != 0.0f || left[slot + 1] != 0.0f;
+
+            if (from.types[i] == material::GROUND) {
+                to.types[i] = material::GROUND;
+                to.mass[i] = from.mass[i];
+                to.mass_next[i] = next;
+            } else if (next < constants::min_mass) {
+                to.types[i] = material::AIR;
+                to.mass[i] = 0.0f;
+                to.mass_next[i] = 0.0f;
+            } else {
+                to.types[i] = material::WATER;
+                to.mass[i] = std::min(next, constants::max_mass);
+                to.mass_next[i] = next;
+                result.water = true;
+            }
+        }
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------
+sweep_result
+scalar_chunk_sweep_span(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, float * carry, sweep_writes writes) {
+    return scalar_sweep_row(from, to, y, x_begin, x_begin + flow_chunk_span, carry, writes);
+}
+
+//------------------------------------------------------------
+chunk_sweep_row_fn
+scalar_chunk_sweep_row(std::size_t) {
+    return &scalar_chunk_sweep_span;
+}
+
+//------------------------------------------------------------
+bool
+scalar_chunk_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, flow_writes writes) {
+    return scalar_flow_row(planes, y, x_begin, x_begin + flow_chunk_span, writes);
+}
+
+//------------------------------------------------------------
+// the reference kernel stays the plain per cell loop for every width
+chunk_row_fn
+scalar_chunk_flow_row(std::size_t) {
+    return &scalar_chunk_row;
+}
+
+// the fixed point rules build as plain c++ here, with only the baseline isa
+struct scalar_tag {};
+using scalar_fixed = fixed_flow_kernel<scalar_tag>;
+
+flow_kernel const scalar_flow_kernel {kernel_isa::SCALAR, "scalar", &scalar_flow_row, &scalar_commit, &scalar_fixed::flow_row, &scalar_fixed::commit, &scalar_chunk_flow_row, &pick_chunk_flow_row<scalar_fixed>, &scalar_sweep_row, &scalar_fixed::sweep_row, &scalar_chunk_sweep_row, &pick_chunk_sweep_row<scalar_fixed>};
+
+//------------------------------------------------------------
+//                      cpu detection                       //
+//------------------------------------------------------------
+
+#if defined(AQUABLOCK_X86_KERNELS)
+// which register state the os saves on a context switch
+unsigned long long
+xgetbv() {
+    unsigned int eax = 0;
+    unsigned int edx = 0;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+}
+#endif
+
+//------------------------------------------------------------
+bool
+cpu_supports(kernel_isa isa) {
+#if defined(AQUABLOCK_X86_KERNELS)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return isa == kernel_isa::SCALAR;
+    }
+
+    bool const sse2 = edx & bit_SSE2;
+    bool const osxsave = ecx & bit_OSXSAVE;
+    bool const avx = ecx & bit_AVX;
+
+    // xmm and ymm state for avx2, plus opmask and zmm state for avx-512
+    auto const xcr0 = osxsave ? xgetbv() : 0;
+    bool const ymm_saved = (xcr0 & 0x06) == 0x06;
+    bool const zmm_saved = (xcr0 & 0xe6) == 0xe6;
+
+    unsigned int leaf7_ebx = 0;
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, leaf7_ebx, ecx, edx);
+    }
+
+    switch (isa) {
+        case kernel_isa::SCALAR: return true;
+        case kernel_isa::SSE2:   return sse2;
+        case kernel_isa::AVX2:   return avx && ymm_saved && (leaf7_ebx & bit_AVX2);
+        case kernel_isa::AVX512: return ymm_saved && zmm_saved && (leaf7_ebx & bit_AVX512F);
+    }
+    return false;
+#else
+    return isa == kernel_isa::SCALAR;
+#endif
+}
+
+//------------------------------------------------------------
+flow_kernel const *
+compiled_kernel(kernel_isa isa) {
+    switch (isa) {
+        case kernel_isa::SCALAR: return &scalar_flow_kernel;
+#if defined(AQUABLOCK_X86_KERNELS)
+        case kernel_isa::SSE2:   return &sse2_flow_kernel;
+        case kernel_isa::AVX2:   return &avx2_flow_kernel;
+        case kernel_isa::AVX512: return &avx512_flow_kernel;
+#endif
+        default: return nullptr;
+    }
+}
+
+//------------------------------------------------------------
+flow_kernel const &
+pick_flow_kernel() {
+    // an explicit request wins if this cpu can run it
+    if (auto const * requested = std::getenv("AQUABLOCK_KERNEL")) {
+        for (auto isa : {kernel_isa::SCALAR, kernel_isa::SSE2, kernel_isa::AVX2, kernel_isa::AVX512}) {
+            auto const * kernel = find_flow_kernel(isa);
+
+            if (kernel && std::strcmp(kernel->name, requested) == 0) {
+                return *kernel;
+            }
+        }
+    }
+
+    for (auto isa : {kernel_isa::AVX512, kernel_isa::AVX2, kernel_isa::SSE2}) {
+        if (auto const * kernel = find_flow_kernel(isa)) {
+            return *kernel;
+        }
+    }
+
+    return scalar_flow_kernel;
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                       flow_kernel                        //
+//------------------------------------------------------------
+flow_kernel const &
+active_flow_kernel() {
+    static flow_kernel const & kernel = pick_flow_kernel();
+    return kernel;
+}
+
+//------------------------------------------------------------
+flow_kernel const *
+find_flow_kernel(kernel_isa isa) {
+    auto const * kernel = compiled_kernel(isa);
+    return (kernel && cpu_supports(isa)) ? kernel : nullptr;
+}
@@ -0,0 +1,182 @@
+#ifndef FLOW_KERNEL_HPP
+#define FLOW_KERNEL_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// my
+#include "flow_rules.hpp"
+#include "material.hpp"
+
+//------------------------------------------------------------
+//                       grid_planes                        //
+//------------------------------------------------------------
+
+// raw view over the structure of arrays planes of a grid. the kernels
+// only ever see this so they stay independent of who owns the memory.
+// only one pair of mass planes is in use, see mass_format.
+struct grid_planes {
+    std::size_t width;
+    std::size_t height;
+    material * types;
+    float * mass;
+    float * mass_next;
+    std::uint16_t * mass_fixed;
+    std::uint16_t * mass_next_fixed;
+};
+
+// how a grid stores mass. FLOAT32 is the original representation. FIXED16
+// is 9.7 fixed point (see constants::fixed_mass_scale): half the memory per
+// mass plane and twice the cells per integer vector. the flows are integer,
+// so every unit that leaves one cell arrives in another with no rounding
+// drift (the rules still delete cells that fall below min_mass, as with
+// floats) and a run gives the same result on every compiler and cpu. flows
+// are truncated to 1/128th of a unit, so the results are close to but not
+// the same as FLOAT32.
+enum class mass_format {
+    FLOAT32,
+    FIXED16,
+};
+
+//------------------------------------------------------------
+//                       flow_kernel                        //
+//------------------------------------------------------------
+
+// which cells a flow_row call writes. ROW gives the cells of the span their
+// own outflows and every sideways inflow, including the ones from the cells
+// just outside the span. DOWN gives the cells of the span one row further
+// down the down flows from above. ALL is both.
+//
+// a call only ever writes inside its span, so a band of rows or a chunk
+// owns its cells: the last row of a band uses ROW and the band below pulls
+// those down flows in itself with DOWN.
+enum class flow_writes {
+    ALL,
+    ROW,
+    DOWN,
+};
+
+// flow_row for the span [x_begin, x_begin + flow_chunk_span), which must
+// be clear of the border: x_begin > 1 and x_begin + flow_chunk_span < width - 1
+using chunk_row_fn = bool (*)(grid_planes const & planes, std::size_t y, std::size_t x_begin, flow_writes writes);
+
+// what a sweep_row call saw in its span: a non zero flow into or out of
+// one of its cells, and water left in one of them afterwards
+struct sweep_result {
+    bool moved;
+    bool water;
+};
+
+// ALL sweeps a row into the other buffer and leaves its down flows in the
+// carry. CARRY only works out the down flows, for the row above the first
+// one a caller sweeps - that row belongs to someone else
+enum class sweep_writes {
+    ALL,
+    CARRY,
+};
+
+// a whole tick for the cells [x_begin, x_end) of row y in one pass: every
+// cell gets its flows, including the down flows from the row above that
+// come in through carry (indexed from x_begin), and is committed straight
+// into to. only from is read, so neighbouring spans never see each other's
+// writes and the two buffers just swap afterwards. a caller going down the
+// rows of a rectangle gets the same result as flow_row over them followed
+// by commit, without reading back and writing mass_next a second time.
+//
+// for the rows under the ground border there is nothing to carry in, and
+// the carry should be -0.0f, which adds nothing to any float (0 for the
+// FIXED16 version)
+using sweep_row_fn = sweep_result (*)(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, float * carry, sweep_writes writes);
+using fixed_sweep_row_fn = sweep_result (*)(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, std::int16_t * carry, sweep_writes writes);
+
+// the same for a span flow_chunk_span long, clear of the border as for
+// chunk_row_fn
+using chunk_sweep_row_fn = sweep_result (*)(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, float * carry, sweep_writes writes);
+using fixed_chunk_sweep_row_fn = sweep_result (*)(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::int16_t * carry, sweep_writes writes);
+
+enum class kernel_isa {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512,
+};
+
+// one implementation of the flow rules. every kernel produces results that
+// are bit for bit identical to the scalar kernel (a tolerance of 0 ulp):
+// each lane runs the same IEEE operations in the same order, flows are
+// divided rather than multiplied by a reciprocal, and the accumulation into
+// mass_next happens in the same sequence as the per cell loop.
+struct flow_kernel {
+    kernel_isa isa;
+    char const * name;
+
+    // adds the flows of row y to mass_next for the cells [x_begin, x_end),
+    // see flow_writes. returns true if any flow it wrote was non zero.
+    bool (*flow_row)(grid_planes const & planes, std::size_t y, std::size_t x_begin, std::size_t x_end, flow_writes writes);
+
+    // copies mass_next into mass for the cells [begin, end), clamping and
+    // turning cells into air or water. ground is left untouched. returns
+    // true if any of the cells holds water afterwards.
+    bool (*commit)(grid_planes const & planes, std::size_t begin, std::size_t end);
+
+    // the same two on the mass_format::FIXED16 planes
+    bool (*fixed_flow_row)(grid_planes const & planes, std::size_t y, std::size_t x_begin, std::size_t x_end, flow_writes writes);
+    bool (*fixed_commit)(grid_planes const & planes, std::size_t begin, std::size_t end);
+
+    // flow_row for a whole chunk on a grid of this width, with the span
+    // length a compile time constant so the loops unroll with no tails or
+    // border checks. the widths in flow_tile_widths also get the row stride
+    // as a constant, any other width gets a version that reads it. same
+    // results as flow_row
+    chunk_row_fn (*chunk_flow_row)(std::size_t width);
+    chunk_row_fn (*fixed_chunk_flow_row)(std::size_t width);
+
+    // the fused flow and commit, see sweep_row_fn, and its whole chunk
+    // versions picked by width as for chunk_flow_row
+    sweep_row_fn sweep_row;
+    fixed_sweep_row_fn fixed_sweep_row;
+    chunk_sweep_row_fn (*chunk_sweep_row)(std::size_t width);
+    fixed_chunk_sweep_row_fn (*fixed_chunk_sweep_row)(std::size_t width);
+};
+
+// kernel::chunk_flow_row<width> for the widths in the list, or <0> - the
+// runtime width one - for anything else. used to fill in the tables
+template <typename kernel, std::size_t... widths>
+chunk_row_fn
+pick_chunk_flow_row(std::size_t width, std::index_sequence<widths...>) {
+    chunk_row_fn picked = &kernel::template chunk_flow_row<0>;
+    ((picked = (width == widths) ? &kernel::template chunk_flow_row<widths> : picked), ...);
+    return picked;
+}
+
+template <typename kernel>
+chunk_row_fn
+pick_chunk_flow_row(std::size_t width) {
+    return pick_chunk_flow_row<kernel>(width, flow_tile_widths{});
+}
+
+// the same for kernel::chunk_sweep_row<width>
+template <typename kernel, std::size_t... widths>
+auto
+pick_chunk_sweep_row(std::size_t width, std::index_sequence<widths...>) {
+    auto picked = &kernel::template chunk_sweep_row<0>;
+    ((picked = (width == widths) ? &kernel::template chunk_sweep_row<widths> : picked), ...);
+    return picked;
+}
+
+template <typename kernel>
+auto
+pick_chunk_sweep_row(std::size_t width) {
+    return pick_chunk_sweep_row<kernel>(width, flow_tile_widths{});
+}
+
+// the fastest kernel this cpu supports, picked once from cpuid. setting the
+// AQUABLOCK_KERNEL environment variable to scalar, sse2, avx2 or avx512
+// forces a specific kernel if the cpu supports it.
+flow_kernel const & active_flow_kernel();
+
+// nullptr when the kernel was not compiled in or the cpu lacks the isa
+flow_kernel const * find_flow_kernel(kernel_isa isa);
+
+#endif // FLOW_KERNEL_HPP
@@ -0,0 +1,72 @@
+#include "flow_kernel_simd.hpp"
+#include "flow_kernel_fixed.hpp"
+
+// dependancies
+#include <immintrin.h>
+
+namespace {
+
+struct avx2_ops {
+    using vec = __m256;
+    using mask = __m256;
+
+    static constexpr std::size_t lanes = 8;
+
+    static vec load(float const * p) { return _mm256_loadu_ps(p); }
+    static void store(float * p, vec v) { _mm256_storeu_ps(p, v); }
+    static vec set1(float f) { return _mm256_set1_ps(f); }
+
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm256_div_ps(a, b); }
+
+    // (a < b) ? a : b and (a > b) ? a : b, same as the instructions
+    static vec min(vec a, vec b) { return _mm256_min_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm256_max_ps(a, b); }
+
+    static mask not_less(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static mask and_not(mask a, mask b) { return _mm256_andnot_ps(b, a); }
+    static bool any(mask m) { return _mm256_movemask_ps(m) != 0; }
+    static vec keep(mask m, vec v) { return _mm256_and_ps(m, v); }
+    static vec select(mask m, vec a, vec b) { return _mm256_blendv_ps(b, a, m); }
+
+    static vec bits_or(vec a, vec b) { return _mm256_or_ps(a, b); }
+    static bool any_nonzero(vec v) {
+        auto const bits = _mm256_castps_si256(v);
+        return !_mm256_testz_si256(bits, bits);
+    }
+
+    static __m256i widen_types(material const * types) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(types)));
+    }
+
+    static mask types_equal(material const * types, material value) {
+        auto const v = _mm256_set1_epi32(static_cast<int>(value));
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(widen_types(types), v));
+    }
+
+    static mask types_not_equal(material const * types, material value) {
+        return _mm256_xor_ps(types_equal(types, value), _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+    }
+
+    static void store_types(material * types, mask ground, mask water) {
+        auto const g = _mm256_castps_si256(ground);
+        auto const w = _mm256_castps_si256(water);
+
+        auto const v = _mm256_or_si256(
+            _mm256_and_si256(g, _mm256_set1_epi32(static_cast<int>(material::GROUND))),
+            _mm256_andnot_si256(g, _mm256_and_si256(w, _mm256_set1_epi32(static_cast<int>(material::WATER)))));
+
+        // the 256 bit packs work per 128 bit lane so narrow the halves by hand
+        auto const words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(types), _mm_packus_epi16(words, words));
+    }
+};
+
+using kernel = simd_flow_kernel<avx2_ops>;
+using fixed_kernel = fixed_flow_kernel<avx2_ops>;
+
+} // namespace
+
+extern flow_kernel const avx2_flow_kernel {kernel_isa::AVX2, "avx2", &kernel::flow_row, &kernel::commit, &fixed_kernel::flow_row, &fixed_kernel::commit, &pick_chunk_flow_row<kernel>, &pick_chunk_flow_row<fixed_kernel>, &kernel::sweep_row, &fixed_kernel::sweep_row, &pick_chunk_sweep_row<kernel>, &pick_chunk_sweep_row<fixed_kernel>};
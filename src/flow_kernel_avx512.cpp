@@ -0,0 +1,79 @@
+#include "flow_kernel_simd.hpp"
+#include "flow_kernel_fixed.hpp"
+
+// dependancies
+// gcc 12's avx-512 intrinsics fill their undefined source operand with a
+// self initialised variable, which -Wuninitialized flags once the fixed
+// span kernels are unrolled far enough for it to look
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// avx-512 foundation only, so it runs on every avx-512 cpu
+struct avx512_ops {
+    using vec = __m512;
+    using mask = __mmask16;
+
+    static constexpr std::size_t lanes = 16;
+
+    static vec load(float const * p) { return _mm512_loadu_ps(p); }
+    static void store(float * p, vec v) { _mm512_storeu_ps(p, v); }
+    static vec set1(float f) { return _mm512_set1_ps(f); }
+
+    static vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm512_div_ps(a, b); }
+
+    // (a < b) ? a : b and (a > b) ? a : b, same as the instructions
+    static vec min(vec a, vec b) { return _mm512_min_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm512_max_ps(a, b); }
+
+    static mask not_less(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_NLT_UQ); }
+    static mask both(mask a, mask b) { return _mm512_kand(a, b); }
+    static mask and_not(mask a, mask b) { return _mm512_kandn(b, a); }
+    static bool any(mask m) { return m != 0; }
+    static vec keep(mask m, vec v) { return _mm512_maskz_mov_ps(m, v); }
+    static vec select(mask m, vec a, vec b) { return _mm512_mask_blend_ps(m, b, a); }
+
+    // the float or is avx-512dq, so go through the integer one
+    static vec bits_or(vec a, vec b) {
+        return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+    }
+    static bool any_nonzero(vec v) {
+        auto const bits = _mm512_castps_si512(v);
+        return _mm512_test_epi32_mask(bits, bits) != 0;
+    }
+
+    static __m512i widen_types(material const * types) {
+        return _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(types)));
+    }
+
+    static mask types_equal(material const * types, material value) {
+        return _mm512_cmpeq_epi32_mask(widen_types(types), _mm512_set1_epi32(static_cast<int>(value)));
+    }
+
+    static mask types_not_equal(material const * types, material value) {
+        return _mm512_cmpneq_epi32_mask(widen_types(types), _mm512_set1_epi32(static_cast<int>(value)));
+    }
+
+    static void store_types(material * types, mask ground, mask water) {
+        auto v = _mm512_maskz_mov_epi32(water, _mm512_set1_epi32(static_cast<int>(material::WATER)));
+        v = _mm512_mask_mov_epi32(v, ground, _mm512_set1_epi32(static_cast<int>(material::GROUND)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(types), _mm512_cvtepi32_epi8(v));
+    }
+};
+
+using kernel = simd_flow_kernel<avx512_ops>;
+using fixed_kernel = fixed_flow_kernel<avx512_ops>;
+
+} // namespace
+
+extern flow_kernel const avx512_flow_kernel {kernel_isa::AVX512, "avx512", &kernel::flow_row, &kernel::commit, &fixed_kernel::flow_row, &fixed_kernel::commit, &pick_chunk_flow_row<kernel>, &pick_chunk_flow_row<fixed_kernel>, &kernel::sweep_row, &fixed_kernel::sweep_row, &pick_chunk_sweep_row<kernel>, &pick_chunk_sweep_row<fixed_kernel>};
@@ -0,0 +1,282 @@
+#ifndef FLOW_KERNEL_FIXED_HPP
+#define FLOW_KERNEL_FIXED_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// my
+#include "flow_kernel.hpp"
+#include "flow_rules.hpp"
+
+// flow rules on the mass_format::FIXED16 planes, in integer math. there is
+// no hand written vector code: every loop is branch free over plain arrays
+// so the compiler vectorises it, and each isa translation unit instantiates
+// its own copy (with its own -m flags) through the tag parameter - which is
+// also what keeps the copies apart at link time, as in flow_kernel_simd.hpp.
+//
+// like the float kernels a row is done in blocks: pass 1 computes the down,
+// left and right flows of every cell in the block and the one either side,
+// pass 2 adds them to mass_next. integer addition is exact, so the order
+// does not matter here and no mass is lost or made by rounding.
+//
+// the border cells are ground and flow nothing, so unlike the float kernels
+// the cells either side of a block are always computed.
+//
+// chunk_flow_row is a block of exactly flow_chunk_span cells, with the row
+// stride a constant too for the known tile widths.
+//
+// sweep_row is the same pass 1 with the down flows from the row above
+// coming from the carry, and each sum committed straight into the other
+// buffer.
+
+template <typename tag, typename rules = water_flow_rules>
+struct fixed_flow_kernel {
+    static constexpr std::size_t block_size = 256;
+
+//                       functions                         //
+//------------------------------------------------------------
+    static bool flow_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, std::size_t x_end, flow_writes writes) {
+        bool moved = false;
+
+        for (auto begin = x_begin; begin < x_end; begin += block_size) {
+            auto const end = (x_end - begin > block_size) ? begin + block_size : x_end;
+            moved |= flow_block<0, 0>(planes, y, begin, end, writes);
+        }
+
+        return moved;
+    }
+
+    //------------------------------------------------------------
+    // see flow_kernel::chunk_flow_row, width 0 reads it from planes
+    template <std::size_t width>
+    static bool chunk_flow_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, flow_writes writes) {
+        return flow_block<flow_chunk_span, width>(planes, y, x_begin, x_begin + flow_chunk_span, writes);
+    }
+
+    //------------------------------------------------------------
+    static sweep_result sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, std::int16_t * carry, sweep_writes writes) {
+        sweep_result result {false, false};
+
+        for (auto begin = x_begin; begin < x_end; begin += block_size) {
+            auto const end = (x_end - begin > block_size) ? begin + block_size : x_end;
+            auto const block = sweep_block<0, 0>(from, to, y, begin, end, carry + (begin - x_begin), writes);
+
+            result.moved |= block.moved;
+            result.water |= block.water;
+        }
+
+        return result;
+    }
+
+    //------------------------------------------------------------
+    // see flow_kernel::chunk_sweep_row, width 0 reads it from the planes
+    template <std::size_t width>
+    static sweep_result chunk_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::int16_t * carry, sweep_writes writes) {
+        return sweep_block<flow_chunk_span, width>(from, to, y, x_begin, x_begin + flow_chunk_span, carry, writes);
+    }
+
+    //------------------------------------------------------------
+    static bool commit(grid_planes const & planes, std::size_t begin, std::size_t end) {
+        material * types = planes.types;
+        std::uint16_t * mass = planes.mass_fixed;
+        std::uint16_t * mass_next = planes.mass_next_fixed;
+
+        std::uint16_t water_left = 0;
+
+        for (auto i = begin; i < end; i++) {
+            auto const next = mass_next[i];
+            auto const ground = mask(types[i] == material::GROUND);
+            auto const water = mask(next >= rules::fixed_min_mass);
+            auto const clamped = (next < rules::fixed_max_mass) ? next : static_cast<std::uint16_t>(rules::fixed_max_mass);
+
+            types[i] = ground ? material::GROUND : (water ? material::WATER : material::AIR);
+            mass[i] = static_cast<std::uint16_t>((mass[i] & ground) | (clamped & water & ~ground));
+            mass_next[i] = static_cast<std::uint16_t>(next & (ground | water));
+
+            water_left |= static_cast<std::uint16_t>(water & ~ground);
+        }
+
+        return water_left != 0;
+    }
+
+private:
+    using lane = std::int16_t;
+
+    //------------------------------------------------------------
+    // 0 for fixed_count or fixed_width means it is only known at run time
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static bool flow_block(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, flow_writes writes) {
+        constexpr std::size_t slots = (fixed_count ? fixed_count : block_size) + 2;
+
+        // slot 0 is the cell before the block, slot count + 1 the one after.
+        // down is zeroed only because gcc's vectoriser loses track of pass 1
+        // filling it and warns
+        lane down[slots] = {};
+        lane left[slots];
+        lane right[slots];
+
+        auto const width = fixed_width ? fixed_width : planes.width;
+        auto const row = y * width;
+        auto const count = fixed_count ? fixed_count : end - begin;
+
+        std::uint16_t * next = planes.mass_next_fixed + row + begin;
+        std::uint16_t * next_down = next + width;
+
+        row_flows<fixed_count, fixed_width>(planes, y, begin, count, down, left, right);
+
+        lane moved = 0;
+
+        // pass 2 - own outflows plus the sideways inflows. mass_next can go
+        // past the signed range, but wrapping 16 bit arithmetic still gives
+        // the exact sum as it always ends up in [0, 0xffff]
+        if (writes != flow_writes::DOWN) {
+            for (std::size_t i = 0; i < count; i++) {
+                auto const from_left = right[i];
+                auto const from_right = left[i + 2];
+                auto const out = static_cast<lane>(down[i + 1] + left[i + 1] + right[i + 1]);
+
+                next[i] = static_cast<std::uint16_t>(next[i] + from_left + from_right - out);
+                moved |= from_left | from_right | out;
+            }
+        }
+
+        if (writes != flow_writes::ROW) {
+            for (std::size_t i = 0; i < count; i++) {
+                next_down[i] = static_cast<std::uint16_t>(next_down[i] + down[i + 1]);
+                moved |= down[i + 1];
+            }
+        }
+
+        return moved != 0;
+    }
+
+    //------------------------------------------------------------
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static sweep_result sweep_block(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t begin, std::size_t end, lane * carry, sweep_writes writes) {
+        constexpr std::size_t slots = (fixed_count ? fixed_count : block_size) + 2;
+
+        // zeroed for the same reason as in flow_block
+        lane down[slots] = {};
+        lane left[slots];
+        lane right[slots];
+
+        auto const width = fixed_width ? fixed_width : from.width;
+        auto const count = fixed_count ? fixed_count : end - begin;
+
+        row_flows<fixed_count, fixed_width>(from, y, begin, count, down, left, right);
+
+        lane moved = 0;
+
+        if (writes == sweep_writes::CARRY) {
+            for (std::size_t i = 0; i < count; i++) {
+                carry[i] = down[i + 1];
+                moved |= down[i + 1];
+            }
+
+            return sweep_result {moved != 0, false};
+        }
+
+        auto const row = y * width + begin;
+        material const * types = from.types + row;
+        std::uint16_t const * mass = from.mass_fixed + row;
+        std::uint16_t const * next = from.mass_next_fixed + row;
+        material * types_out = to.types + row;
+        std::uint16_t * mass_out = to.mass_fixed + row;
+        std::uint16_t * next_out = to.mass_next_fixed + row;
+
+        // the sums go through a stack buffer and the commit is its own loop,
+        // one loop over all six planes needs more alias checks than gcc
+        // will emit and is left scalar
+        std::uint16_t sum[slots];
+
+        for (std::size_t i = 0; i < count; i++) {
+            auto const from_left = right[i];
+            auto const from_right = left[i + 2];
+            auto const out = static_cast<lane>(down[i + 1] + left[i + 1] + right[i + 1]);
+
+            sum[i] = static_cast<std::uint16_t>(next[i] + carry[i] + from_left + from_right - out);
+
+            carry[i] = down[i + 1];
+            moved |= from_left | from_right | out;
+        }
+
+        std::uint16_t water_left = 0;
+
+        // and commit, as in commit()
+        for (std::size_t i = 0; i < count; i++) {
+            auto const n = sum[i];
+            auto const ground = mask(types[i] == material::GROUND);
+            auto const water = mask(n >= rules::fixed_min_mass);
+            auto const clamped = (n < rules::fixed_max_mass) ? n : static_cast<std::uint16_t>(rules::fixed_max_mass);
+
+            types_out[i] = ground ? material::GROUND : (water ? material::WATER : material::AIR);
+            mass_out[i] = static_cast<std::uint16_t>((mass[i] & ground) | (clamped & water & ~ground));
+            next_out[i] = static_cast<std::uint16_t>(n & (ground | water));
+
+            water_left |= static_cast<std::uint16_t>(water & ~ground);
+        }
+
+        return sweep_result {moved != 0, water_left != 0};
+    }
+
+    //------------------------------------------------------------
+    // pass 1 - flows out of every cell of row y in the block and the one
+    // either side, slot 0 being the cell before the block. mass is never
+    // above fixed_max_mass, so every value here fits a signed 16 bit lane.
+    // the conditions are and-ed in as bit masks rather than branched on, so
+    // the loop vectorises. remaining only goes down, so remaining >=
+    // min_mass covers the earlier checks too
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static void row_flows(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t count, lane * down, lane * left, lane * right) {
+        auto const width = fixed_width ? fixed_width : planes.width;
+        auto const row = y * width;
+
+        // begin is at least 1 and the block ends at most at width - 1, so
+        // the cells either side and the row below are always inside the grid
+        material const * types = planes.types + row + begin - 1;
+        std::uint16_t const * mass = planes.mass_fixed + row + begin - 1;
+
+        for (std::size_t i = 0; i < count + 2; i++) {
+            auto const m = static_cast<lane>(mass[i]);
+            auto const water = mask(types[i] == material::WATER);
+
+            auto remaining = m;
+
+            auto flow = limit(room(mass[i + width]), remaining, m, 1);
+            down[i] = flow & water & mask(types[i + width] != material::GROUND) & mask(remaining >= rules::fixed_min_mass);
+            remaining = static_cast<lane>(remaining - down[i]);
+
+            flow = limit(room(mass[i - 1]), remaining, m, rules::fixed_left_divisor);
+            left[i] = flow & water & mask(types[i - 1] != material::GROUND) & mask(remaining >= rules::fixed_min_mass);
+            remaining = static_cast<lane>(remaining - left[i]);
+
+            flow = limit(room(mass[i + 1]), remaining, m, rules::fixed_right_divisor);
+            right[i] = flow & water & mask(types[i + 1] != material::GROUND) & mask(remaining >= rules::fixed_min_mass);
+        }
+    }
+
+    //------------------------------------------------------------
+    // all ones if the condition holds, zero otherwise
+    static lane mask(bool condition) {
+        return static_cast<lane>(-static_cast<lane>(condition));
+    }
+
+    //------------------------------------------------------------
+    static lane room(std::uint16_t mass) {
+        return static_cast<lane>(rules::fixed_max_mass - mass);
+    }
+
+    //------------------------------------------------------------
+    // min(room, remaining), no lower than 0, divided, no more than mass
+    // (which is already at most max_mass, so that is the float rule's cap)
+    static lane limit(lane room, lane remaining, lane cap, lane divisor) {
+        lane flow = (remaining < room) ? remaining : room;
+        flow = (flow > 0) ? flow : 0;
+        flow = static_cast<lane>(flow / divisor);
+        return (flow < cap) ? flow : cap;
+    }
+
+}; // fixed_flow_kernel
+
+#endif // FLOW_KERNEL_FIXED_HPP
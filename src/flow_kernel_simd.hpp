@@ -0,0 +1,468 @@
+#ifndef FLOW_KERNEL_SIMD_HPP
+#define FLOW_KERNEL_SIMD_HPP
+
+// std
+#include <cstddef>
+
+// my
+#include "flow_kernel.hpp"
+#include "flow_rules.hpp"
+
+// shared body of the vectorised kernels. each isa translation unit supplies
+// an ops struct of intrinsics and instantiates simd_flow_kernel<ops>.
+//
+// everything in here is a template on ops on purpose: the isa units are
+// compiled with different -m flags, so a plain inline helper (or a call to
+// std::min) could be emitted once with avx-512 instructions and then picked
+// by the linker for the sse2 path.
+//
+// a row is handled in blocks. the first pass computes the masked down, left
+// and right flows of every cell in the block, plus the right flow of the
+// cell before it and the left flow of the cell after it, into small stack
+// buffers. the second pass adds them to mass_next in exactly the order the
+// per cell loop does, which is what keeps the result identical to the
+// scalar kernel:
+//
+//   next[x] = ((((next[x] + right[x - 1]) - down[x]) - left[x]) - right[x]) + left[x + 1]
+//
+// chunk_flow_row runs the same block code with the span length, and for
+// the known tile widths the row stride, as constants.
+//
+// sweep_row runs the same pass 1 and, instead of adding to mass_next in
+// place, adds the same flows in the same order to the old mass_next and
+// commits the sum straight into the other buffer. the down flows from the
+// row above come from the carry, and this row's are left there.
+
+template <typename ops, typename rules = water_flow_rules>
+struct simd_flow_kernel {
+    using vec = typename ops::vec;
+    using mask = typename ops::mask;
+
+    static constexpr std::size_t lanes = ops::lanes;
+    static constexpr std::size_t block_size = 256;
+
+//                       functions                         //
+//------------------------------------------------------------
+    static bool flow_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, std::size_t x_end, flow_writes writes) {
+        // one spare slot either side for right[-1] and left[n]
+        alignas(64) float down[block_size];
+        alignas(64) float left[block_size + 1];
+        alignas(64) float right[block_size + 1];
+
+        bool moved = false;
+
+        for (auto begin = x_begin; begin < x_end; begin += block_size) {
+            auto const end = (x_end - begin > block_size) ? begin + block_size : x_end;
+            moved |= flow_block<0, 0>(planes, y, begin, end, writes, down, left, right + 1);
+        }
+
+        return moved;
+    }
+
+    //------------------------------------------------------------
+    // see flow_kernel::chunk_flow_row, width 0 reads it from planes
+    template <std::size_t width>
+    static bool chunk_flow_row(grid_planes const & planes, std::size_t y, std::size_t x_begin, flow_writes writes) {
+        alignas(64) float down[flow_chunk_span];
+        alignas(64) float left[flow_chunk_span + 1];
+        alignas(64) float right[flow_chunk_span + 1];
+
+        return flow_block<flow_chunk_span, width>(planes, y, x_begin, x_begin + flow_chunk_span, writes, down, left, right + 1);
+    }
+
+    //------------------------------------------------------------
+    static sweep_result sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, float * carry, sweep_writes writes) {
+        alignas(64) float down[block_size];
+        alignas(64) float left[block_size + 1];
+        alignas(64) float right[block_size + 1];
+
+        sweep_result result {false, false};
+
+        for (auto begin = x_begin; begin < x_end; begin += block_size) {
+            auto const end = (x_end - begin > block_size) ? begin + block_size : x_end;
+            auto const block = sweep_block<0, 0>(from, to, y, begin, end, carry + (begin - x_begin), writes, down, left, right + 1);
+
+            result.moved |= block.moved;
+            result.water |= block.water;
+        }
+
+        return result;
+    }
+
+    //------------------------------------------------------------
+    // see flow_kernel::chunk_sweep_row, width 0 reads it from the planes
+    template <std::size_t width>
+    static sweep_result chunk_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, float * carry, sweep_writes writes) {
+        alignas(64) float down[flow_chunk_span];
+        alignas(64) float left[flow_chunk_span + 1];
+        alignas(64) float right[flow_chunk_span + 1];
+
+        return sweep_block<flow_chunk_span, width>(from, to, y, x_begin, x_begin + flow_chunk_span, carry, writes, down, left, right + 1);
+    }
+
+    //------------------------------------------------------------
+    static bool commit(grid_planes const & planes, std::size_t begin, std::size_t end) {
+        auto const min_mass = ops::set1(rules::min_mass);
+        auto const max_mass = ops::set1(rules::max_mass);
+
+        bool water_left = false;
+
+        auto i = begin;
+        for (; i + lanes <= end; i += lanes) {
+            auto const ground = ops::types_equal(planes.types + i, material::GROUND);
+            auto const next = ops::load(planes.mass_next + i);
+            auto const water = ops::not_less(next, min_mass);
+
+            // std::min(next, max_mass) is (max_mass < next) ? max_mass : next
+            auto const mass = ops::keep(water, ops::min(max_mass, next));
+            auto const mass_next = ops::keep(water, next);
+
+            ops::store(planes.mass + i, ops::select(ground, ops::load(planes.mass + i), mass));
+            ops::store(planes.mass_next + i, ops::select(ground, next, mass_next));
+            ops::store_types(planes.types + i, ground, water);
+
+            water_left |= ops::any(ops::and_not(water, ground));
+        }
+
+        for (; i < end; i++) {
+            water_left |= commit_cell(planes, i);
+        }
+
+        return water_left;
+    }
+
+private:
+    //------------------------------------------------------------
+    // a fixed_count block is a whole chunk clear of the border, so the cells
+    // either side of it are always computed. 0 for either means runtime
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static bool flow_block(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, flow_writes writes, float * down, float * left, float * right) {
+        auto const width = fixed_width ? fixed_width : planes.width;
+        auto const row = y * width;
+        auto const count = fixed_count ? fixed_count : end - begin;
+
+        constexpr bool tails = has_tails(fixed_count);
+
+        float * next = planes.mass_next + row + begin;
+        float * next_down = next + width;
+
+        row_flows<fixed_count, fixed_width>(planes, y, begin, end, down, left, right);
+
+        auto moved = ops::set1(0.0f);
+
+        // pass 2 - accumulate in per cell loop order
+        if (writes != flow_writes::DOWN) {
+            std::size_t i = 0;
+            for (; i + lanes <= count; i += lanes) {
+                auto const from_left = ops::load(right + i - 1);
+                auto const d = ops::load(down + i);
+                auto const l = ops::load(left + i);
+                auto const r = ops::load(right + i);
+                auto const from_right = ops::load(left + i + 1);
+
+                auto n = ops::load(next + i);
+                n = ops::add(n, from_left);
+                n = ops::sub(n, d);
+                n = ops::sub(n, l);
+                n = ops::sub(n, r);
+                n = ops::add(n, from_right);
+                ops::store(next + i, n);
+
+                moved = ops::bits_or(moved, ops::bits_or(ops::bits_or(from_left, d), ops::bits_or(ops::bits_or(l, r), from_right)));
+            }
+
+            if constexpr (tails) {
+                for (; i < count; i++) {
+                    next[i] = ((((next[i] + right[i - 1]) - down[i]) - left[i]) - right[i]) + left[i + 1];
+
+                    if (right[i - 1] != 0.0f || down[i] != 0.0f || left[i] != 0.0f || right[i] != 0.0f || left[i + 1] != 0.0f) {
+                        moved = ops::set1(1.0f);
+                    }
+                }
+            }
+        }
+
+        if (writes != flow_writes::ROW) {
+            std::size_t i = 0;
+            for (; i + lanes <= count; i += lanes) {
+                auto const d = ops::load(down + i);
+                ops::store(next_down + i, ops::add(ops::load(next_down + i), d));
+                moved = ops::bits_or(moved, d);
+            }
+
+            if constexpr (tails) {
+                for (; i < count; i++) {
+                    next_down[i] = next_down[i] + down[i];
+
+                    if (down[i] != 0.0f) {
+                        moved = ops::set1(1.0f);
+                    }
+                }
+            }
+        }
+
+        return ops::any_nonzero(moved);
+    }
+
+    //------------------------------------------------------------
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static sweep_result sweep_block(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t begin, std::size_t end, float * carry, sweep_writes writes, float * down, float * left, float * right) {
+        auto const width = fixed_width ? fixed_width : from.width;
+        auto const count = fixed_count ? fixed_count : end - begin;
+
+        constexpr bool tails = has_tails(fixed_count);
+
+        row_flows<fixed_count, fixed_width>(from, y, begin, end, down, left, right);
+
+        auto moved = ops::set1(0.0f);
+
+        if (writes == sweep_writes::CARRY) {
+            std::size_t i = 0;
+            for (; i + lanes <= count; i += lanes) {
+                auto const d = ops::load(down + i);
+                ops::store(carry + i, d);
+                moved = ops::bits_or(moved, d);
+            }
+
+            if constexpr (tails) {
+                for (; i < count; i++) {
+                    carry[i] = down[i];
+                    moved = (down[i] != 0.0f) ? ops::set1(1.0f) : moved;
+                }
+            }
+
+            return sweep_result {ops::any_nonzero(moved), false};
+        }
+
+        auto const min_mass = ops::set1(rules::min_mass);
+        auto const max_mass = ops::set1(rules::max_mass);
+
+        auto const row = y * width + begin;
+        material const * types = from.types + row;
+        float const * mass = from.mass + row;
+        float const * next = from.mass_next + row;
+        material * types_out = to.types + row;
+        float * mass_out = to.mass + row;
+        float * next_out = to.mass_next + row;
+
+        bool water_left = false;
+
+        std::size_t i = 0;
+        for (; i + lanes <= count; i += lanes) {
+            auto const from_left = ops::load(right + i - 1);
+            auto const d = ops::load(down + i);
+            auto const l = ops::load(left + i);
+            auto const r = ops::load(right + i);
+            auto const from_right = ops::load(left + i + 1);
+
+            // the down flows from above went into mass_next first
+            auto n = ops::add(ops::load(next + i), ops::load(carry + i));
+            n = ops::add(n, from_left);
+            n = ops::sub(n, d);
+            n = ops::sub(n, l);
+            n = ops::sub(n, r);
+            n = ops::add(n, from_right);
+
+            ops::store(carry + i, d);
+            moved = ops::bits_or(moved, ops::bits_or(ops::bits_or(from_left, d), ops::bits_or(ops::bits_or(l, r), from_right)));
+
+            // and commit, as in commit()
+            auto const ground = ops::types_equal(types + i, material::GROUND);
+            auto const water = ops::not_less(n, min_mass);
+
+            ops::store(mass_out + i, ops::select(ground, ops::load(mass + i), ops::keep(water, ops::min(max_mass, n))));
+            ops::store(next_out + i, ops::select(ground, n, ops::keep(water, n)));
+            ops::store_types(types_out + i, ground, water);
+
+            water_left |= ops::any(ops::and_not(water, ground));
+        }
+
+        if constexpr (tails) {
+            for (; i < count; i++) {
+                auto const n = (((((next[i] + carry[i]) + right[i - 1]) - down[i]) - left[i]) - right[i]) + left[i + 1];
+
+                carry[i] = down[i];
+                if (right[i - 1] != 0.0f || down[i] != 0.0f || left[i] != 0.0f || right[i] != 0.0f || left[i + 1] != 0.0f) {
+                    moved = ops::set1(1.0f);
+                }
+
+                water_left |= commit_value(types[i], mass[i], n, types_out + i, mass_out + i, next_out + i);
+            }
+        }
+
+        return sweep_result {ops::any_nonzero(moved), water_left};
+    }
+
+    //------------------------------------------------------------
+    // pass 1 - masked flows out of every cell of row y in the block, plus
+    // the right flow of the cell before it into right[-1] and the left flow
+    // of the one after it into left[count]
+    template <std::size_t fixed_count, std::size_t fixed_width>
+    static void row_flows(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, float * down, float * left, float * right) {
+        auto const width = fixed_width ? fixed_width : planes.width;
+        auto const row = y * width;
+        auto const count = fixed_count ? fixed_count : end - begin;
+
+        constexpr bool tails = has_tails(fixed_count);
+
+        material const * types = planes.types + row + begin;
+        float const * mass = planes.mass + row + begin;
+
+        std::size_t i = 0;
+        for (; i + lanes <= count; i += lanes) {
+            cell_flows(types + i, mass + i, width, down + i, left + i, right + i);
+        }
+
+        if constexpr (tails) {
+            for (; i < count; i++) {
+                cell_flows_scalar(types + i, mass + i, width, down + i, left + i, right + i);
+            }
+        }
+
+        // the cells just outside the block, unless they are the ground border
+        float unused_down = 0.0f;
+        float unused_side = 0.0f;
+
+        right[-1] = 0.0f;
+        if (fixed_count || begin > 1) {
+            cell_flows_scalar(types - 1, mass - 1, width, &unused_down, &unused_side, right - 1);
+        }
+
+        left[count] = 0.0f;
+        if (fixed_count || end < width - 1) {
+            cell_flows_scalar(types + count, mass + count, width, &unused_down, left + count, &unused_side);
+        }
+    }
+
+    //------------------------------------------------------------
+    // a fixed span that is a whole number of vectors has no tail loops
+    static constexpr bool has_tails(std::size_t fixed_count) {
+        return fixed_count == 0 || fixed_count % lanes != 0;
+    }
+
+    //------------------------------------------------------------
+    static void cell_flows(material const * types, float const * mass, std::size_t width, float * down, float * left, float * right) {
+        auto const zero = ops::set1(0.0f);
+        auto const min_mass = ops::set1(rules::min_mass);
+        auto const max_mass = ops::set1(rules::max_mass);
+        auto const left_divisor = ops::set1(rules::left_divisor);
+        auto const right_divisor = ops::set1(rules::right_divisor);
+
+        auto const m = ops::load(mass);
+
+        // std::min(max_mass, mass) is (mass < max_mass) ? mass : max_mass
+        auto const cap = ops::min(m, max_mass);
+
+        auto remaining = m;
+        auto active = ops::both(ops::types_equal(types, material::WATER), ops::not_less(remaining, min_mass));
+
+        // downwards flow
+        {
+            auto flow = ops::min(remaining, ops::sub(max_mass, ops::load(mass + width)));
+            flow = ops::max(zero, flow);
+            flow = ops::min(cap, flow);
+            flow = ops::keep(ops::both(active, ops::types_not_equal(types + width, material::GROUND)), flow);
+
+            ops::store(down, flow);
+            remaining = ops::sub(remaining, flow);
+            active = ops::both(active, ops::not_less(remaining, min_mass));
+        }
+
+        // left flow
+        {
+            auto flow = ops::div(ops::min(remaining, ops::sub(max_mass, ops::load(mass - 1))), left_divisor);
+            flow = ops::max(zero, flow);
+            flow = ops::min(cap, flow);
+            flow = ops::keep(ops::both(active, ops::types_not_equal(types - 1, material::GROUND)), flow);
+
+            ops::store(left, flow);
+            remaining = ops::sub(remaining, flow);
+            active = ops::both(active, ops::not_less(remaining, min_mass));
+        }
+
+        // right flow
+        {
+            auto flow = ops::div(ops::min(remaining, ops::sub(max_mass, ops::load(mass + 1))), right_divisor);
+            flow = ops::max(zero, flow);
+            flow = ops::min(cap, flow);
+            flow = ops::keep(ops::both(active, ops::types_not_equal(types + 1, material::GROUND)), flow);
+
+            ops::store(right, flow);
+        }
+    }
+
+    //------------------------------------------------------------
+    // the same rules one lane at a time, for the end of a block
+    static void cell_flows_scalar(material const * types, float const * mass, std::size_t width, float * down, float * left, float * right) {
+        auto const m = mass[0];
+        auto const cap = (m < rules::max_mass) ? m : rules::max_mass;
+
+        auto remaining = m;
+        bool active = types[0] == material::WATER && !(remaining < rules::min_mass);
+
+        auto limit = [cap](float flow) {
+            flow = (0.0f > flow) ? 0.0f : flow;
+            return (cap < flow) ? cap : flow;
+        };
+
+        auto const room_down = rules::max_mass - mass[width];
+        auto flow = limit((remaining < room_down) ? remaining : room_down);
+        down[0] = (active && types[width] != material::GROUND) ? flow : 0.0f;
+        remaining -= down[0];
+        active = active && !(remaining < rules::min_mass);
+
+        auto const room_left = rules::max_mass - mass[-1];
+        flow = limit(((remaining < room_left) ? remaining : room_left) / rules::left_divisor);
+        left[0] = (active && types[-1] != material::GROUND) ? flow : 0.0f;
+        remaining -= left[0];
+        active = active && !(remaining < rules::min_mass);
+
+        auto const room_right = rules::max_mass - mass[1];
+        flow = limit(((remaining < room_right) ? remaining : room_right) / rules::right_divisor);
+        right[0] = (active && types[1] != material::GROUND) ? flow : 0.0f;
+    }
+
+    //------------------------------------------------------------
+    // commit_cell for a sweep, from a cell of the old buffer into the new
+    static bool commit_value(material type, float mass, float next, material * type_out, float * mass_out, float * next_out) {
+        if (type == material::GROUND) {
+            *type_out = material::GROUND;
+            *mass_out = mass;
+            *next_out = next;
+            return false;
+        }
+
+        if (next < rules::min_mass) {
+            *type_out = material::AIR;
+            *mass_out = 0.0f;
+            *next_out = 0.0f;
+            return false;
+        }
+
+        *type_out = material::WATER;
+        *mass_out = (rules::max_mass < next) ? rules::max_mass : next;
+        *next_out = next;
+        return true;
+    }
+
+    //------------------------------------------------------------
+    static bool commit_cell(grid_planes const & planes, std::size_t i) {
+        if (planes.types[i] == material::GROUND) return false;
+
+        auto const next = planes.mass_next[i];
+
+        if (next < rules::min_mass) {
+            planes.types[i] = material::AIR;
+            planes.mass[i] = 0.0f;
+            planes.mass_next[i] = 0.0f;
+            return false;
+        }
+
+        planes.types[i] = material::WATER;
+        planes.mass[i] = (rules::max_mass < next) ? rules::max_mass : next;
+        return true;
+    }
+
+}; // simd_flow_kernel
+
+#endif // FLOW_KERNEL_SIMD_HPP
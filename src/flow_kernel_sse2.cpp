@@ -0,0 +1,83 @@
+#include "flow_kernel_simd.hpp"
+#include "flow_kernel_fixed.hpp"
+
+// std
+#include <cstdint>
+#include <cstring>
+
+// dependancies
+#include <emmintrin.h>
+
+namespace {
+
+struct sse2_ops {
+    using vec = __m128;
+    using mask = __m128;
+
+    static constexpr std::size_t lanes = 4;
+
+    static vec load(float const * p) { return _mm_loadu_ps(p); }
+    static void store(float * p, vec v) { _mm_storeu_ps(p, v); }
+    static vec set1(float f) { return _mm_set1_ps(f); }
+
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static vec div(vec a, vec b) { return _mm_div_ps(a, b); }
+
+    // (a < b) ? a : b and (a > b) ? a : b, same as the instructions
+    static vec min(vec a, vec b) { return _mm_min_ps(a, b); }
+    static vec max(vec a, vec b) { return _mm_max_ps(a, b); }
+
+    static mask not_less(vec a, vec b) { return _mm_cmpnlt_ps(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+    static mask and_not(mask a, mask b) { return _mm_andnot_ps(b, a); }
+    static bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+    static vec keep(mask m, vec v) { return _mm_and_ps(m, v); }
+    static vec select(mask m, vec a, vec b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+    static vec bits_or(vec a, vec b) { return _mm_or_ps(a, b); }
+    static bool any_nonzero(vec v) {
+        auto const zero = _mm_cmpeq_epi32(_mm_castps_si128(v), _mm_setzero_si128());
+        return _mm_movemask_epi8(zero) != 0xffff;
+    }
+
+    static __m128i widen_types(material const * types) {
+        std::int32_t bytes;
+        std::memcpy(&bytes, types, sizeof(bytes));
+
+        auto const zero = _mm_setzero_si128();
+        auto const v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return _mm_unpacklo_epi16(v, zero);
+    }
+
+    static mask types_equal(material const * types, material value) {
+        auto const v = _mm_set1_epi32(static_cast<int>(value));
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(widen_types(types), v));
+    }
+
+    static mask types_not_equal(material const * types, material value) {
+        return _mm_andnot_ps(types_equal(types, value), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+    }
+
+    static void store_types(material * types, mask ground, mask water) {
+        auto const g = _mm_castps_si128(ground);
+        auto const w = _mm_castps_si128(water);
+
+        auto v = _mm_or_si128(
+            _mm_and_si128(g, _mm_set1_epi32(static_cast<int>(material::GROUND))),
+            _mm_andnot_si128(g, _mm_and_si128(w, _mm_set1_epi32(static_cast<int>(material::WATER)))));
+
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+
+        auto const bytes = _mm_cvtsi128_si32(v);
+        std::memcpy(types, &bytes, sizeof(bytes));
+    }
+};
+
+using kernel = simd_flow_kernel<sse2_ops>;
+using fixed_kernel = fixed_flow_kernel<sse2_ops>;
+
+} // namespace
+
+extern flow_kernel const sse2_flow_kernel {kernel_isa::SSE2, "sse2", &kernel::flow_row, &kernel::commit, &fixed_kernel::flow_row, &fixed_kernel::commit, &pick_chunk_flow_row<kernel>, &pick_chunk_flow_row<fixed_kernel>, &kernel::sweep_row, &fixed_kernel::sweep_row, &pick_chunk_sweep_row<kernel>, &pick_chunk_sweep_row<fixed_kernel>};
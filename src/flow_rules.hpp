@@ -0,0 +1,64 @@
+#ifndef FLOW_RULES_HPP
+#define FLOW_RULES_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// my
+#include "constants.hpp"
+
+// the numbers the flow rules are built from, as compile time constants so
+// every kernel is instantiated with them folded in. a kernel takes the
+// rules as a template parameter, so another liquid is another policy.
+struct water_flow_rules {
+    static constexpr float min_mass = constants::min_mass;
+    static constexpr float max_mass = constants::max_mass;
+
+    // a cell gives a third of what fits to the left, then half to the right
+    static constexpr float left_divisor = 3.0f;
+    static constexpr float right_divisor = 2.0f;
+
+    static constexpr int fixed_min_mass = constants::fixed_min_mass;
+    static constexpr int fixed_max_mass = constants::fixed_max_mass;
+    static constexpr std::int16_t fixed_left_divisor = 3;
+    static constexpr std::int16_t fixed_right_divisor = 2;
+
+    // false for something that only ever falls
+    static constexpr bool spreads = true;
+};
+
+// sand falls like water but never runs sideways, so it piles up where it
+// lands
+struct sand_flow_rules : water_flow_rules {
+    static constexpr bool spreads = false;
+};
+
+// lava gives a fifth of what fits to the left, then a quarter of the rest
+// to the right. that is a fifth of the first amount each way, as water
+// gives a third each way - while neither side is short of room, a cell
+// sends its neighbours equal amounts as long as the right divisor is one
+// less than the left. lava sends less, so it creeps where water runs.
+// mass_next stays inside FIXED16 as long as 1/left + 1/right is no more
+// than water's, see constants::fixed_mass_scale
+struct lava_flow_rules : water_flow_rules {
+    static constexpr float left_divisor = 5.0f;
+    static constexpr float right_divisor = 4.0f;
+    static constexpr std::int16_t fixed_left_divisor = 5;
+    static constexpr std::int16_t fixed_right_divisor = 4;
+};
+
+static_assert(lava_flow_rules::right_divisor == lava_flow_rules::left_divisor - 1.0f, "lava would flow more one way than the other");
+static_assert(1.0f / lava_flow_rules::left_divisor + 1.0f / lava_flow_rules::right_divisor <= 1.0f / water_flow_rules::left_divisor + 1.0f / water_flow_rules::right_divisor, "lava could overflow FIXED16");
+
+// the width of the span a flow_kernel::chunk_flow_row call works on, the
+// chunk size of water_grid and sparse_chunk
+constexpr std::size_t flow_chunk_span = 32;
+
+// grid widths with their own chunk_flow_row, the row stride baked in.
+// 36 is a padded sparse_chunk and 38 a tile of a tiled water_grid with
+// its halo, the rest are the tile sizes we run
+using flow_tile_widths = std::index_sequence<36, 38, 256, 512, 1024, 2048, 4096>;
+
+#endif // FLOW_RULES_HPP
@@ -0,0 +1,353 @@
+#include "frame_recorder.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+// my
+#include "grid_pixels.hpp"
+#include "profiler.hpp"
+
+namespace {
+
+int
+red(std::uint32_t pixel) {
+    return static_cast<int>((pixel >> 16) & 0xffu);
+}
+
+int
+green(std::uint32_t pixel) {
+    return static_cast<int>((pixel >> 8) & 0xffu);
+}
+
+int
+blue(std::uint32_t pixel) {
+    return static_cast<int>(pixel & 0xffu);
+}
+
+// full range bt.601 in 16.16 fixed point, what C420jpeg means
+unsigned char
+luma(int r, int g, int b) {
+    return static_cast<unsigned char>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+}
+
+unsigned char
+chroma_blue(int r, int g, int b) {
+    return static_cast<unsigned char>(std::clamp((-11059 * r - 21709 * g + 32768 * b + 32768) / 65536 + 128, 0, 255));
+}
+
+unsigned char
+chroma_red(int r, int g, int b) {
+    return static_cast<unsigned char>(std::clamp((32768 * r - 27439 * g - 5329 * b + 32768) / 65536 + 128, 0, 255));
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                      frame_recorder                      //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+frame_recorder::frame_recorder(std::string path, int width, int height, int fps, int scale, std::size_t buffers, overflow when_full) noexcept(false)
+:   m_path{std::move(path)}
+,   m_format{format_of(m_path)}
+,   m_when_full{when_full}
+,   m_width{width}
+,   m_height{height}
+,   m_fps{fps}
+,   m_scale{scale}
+,   m_writing{false}
+,   m_stopping{false}
+,   m_written{0}
+,   m_dropped{0}
+,   m_failed{false} {
+
+    if (width < 1 || height < 1 || fps < 1 || scale < 1 || buffers < 1) {
+        throw std::invalid_argument("frame_recorder needs a positive size, frame rate, scale and buffer count");
+    }
+
+    if (m_format != format::PPM_FILES) {
+        m_file.open(m_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_file) {
+            throw std::runtime_error("could not open " + m_path + " for writing");
+        }
+    }
+
+    // every buffer is allocated up front and reused, so recording never
+    // allocates once it has started
+    auto const cells = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    m_buffers.assign(buffers, std::vector<std::uint32_t>(cells));
+
+    for (std::size_t i = 0; i < buffers; i++) {
+        m_free.push_back(i);
+    }
+
+    m_thread = std::thread([this] { loop(); });
+}
+
+//------------------------------------------------------------
+frame_recorder::~frame_recorder() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+bool
+frame_recorder::record(grid_pixels const & pixels) {
+    AQUABLOCK_PROFILE_SCOPE("recorder.record");
+    check();
+
+    if (pixels.width() != m_width || pixels.height() != m_height) {
+        throw std::invalid_argument("frame_recorder for " + m_path + " was given a different size of frame");
+    }
+
+    std::size_t buffer;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_free.empty()) {
+            if (m_when_full == overflow::DROP) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            // the writer hands every buffer back, even after a failed write
+            m_freed.wait(lock, [this] { return !m_free.empty(); });
+        }
+
+        buffer = m_free.back();
+        m_free.pop_back();
+    }
+
+    // the copy is the only work done on the calling thread
+    std::copy_n(pixels.data(), m_buffers[buffer].size(), m_buffers[buffer].data());
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(buffer);
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::flush() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_freed.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+    }
+    check();
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::check() {
+    if (m_failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+//------------------------------------------------------------
+std::uint64_t
+frame_recorder::frames_written() const {
+    return m_written.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+std::uint64_t
+frame_recorder::frames_dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+frame_recorder::format
+frame_recorder::format_of(std::string const & path) {
+    if (path.find('#') != std::string::npos) {
+        return format::PPM_FILES;
+    }
+
+    auto const y4m = std::string(".y4m");
+    if (path.size() >= y4m.size() && path.compare(path.size() - y4m.size(), y4m.size(), y4m) == 0) {
+        return format::Y4M;
+    }
+    return format::PPM_STREAM;
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::loop() {
+    AQUABLOCK_PROFILE_THREAD("recorder");
+
+    for (std::uint64_t number = 0;; number++) {
+        std::size_t buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+            // only stops once everything queued is written
+            if (m_queue.empty()) return;
+
+            buffer = m_queue.front();
+            m_queue.pop_front();
+            m_writing = true;
+        }
+
+        // after a failed write the output is in an unknown state, so later
+        // frames are dropped rather than written after it
+        if (!m_failed.load(std::memory_order_relaxed)) {
+            try {
+                write(m_buffers[buffer], number);
+                m_written.fetch_add(1, std::memory_order_relaxed);
+            } catch (...) {
+                m_error = std::current_exception();
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(buffer);
+            m_writing = false;
+        }
+        m_freed.notify_all();
+    }
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::write(std::vector<std::uint32_t> const & pixels, std::uint64_t number) {
+    AQUABLOCK_PROFILE_SCOPE("recorder.write");
+
+    std::ofstream numbered;
+    auto * out = &m_file;
+
+    if (m_format == format::PPM_FILES) {
+        auto const path = numbered_path(number);
+        numbered.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!numbered) {
+            throw std::runtime_error("could not open " + path + " for writing");
+        }
+        out = &numbered;
+    }
+
+    if (m_format == format::Y4M) {
+        // the stream header goes in front of the first frame
+        if (number == 0) {
+            *out << "YUV4MPEG2 W" << m_width * m_scale << " H" << m_height * m_scale << " F" << m_fps << ":1 Ip A1:1 C420jpeg\n";
+        }
+        *out << "FRAME\n";
+        encode_y4m(pixels);
+    } else {
+        *out << "P6\n" << m_width * m_scale << " " << m_height * m_scale << "\n255\n";
+        encode_ppm(pixels);
+    }
+
+    out->write(reinterpret_cast<char const *>(m_encoded.data()), static_cast<std::streamsize>(m_encoded.size()));
+    out->flush();
+
+    if (!*out) {
+        throw std::runtime_error("could not write frame " + std::to_string(number) + " to " + (out == &m_file ? m_path : numbered_path(number)));
+    }
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::encode_ppm(std::vector<std::uint32_t> const & pixels) {
+    auto const out_width = static_cast<std::size_t>(m_width) * static_cast<std::size_t>(m_scale);
+    auto const row_bytes = out_width * 3;
+    m_encoded.resize(row_bytes * static_cast<std::size_t>(m_height) * static_cast<std::size_t>(m_scale));
+
+    auto * out = m_encoded.data();
+
+    for (int y = 0; y < m_height; y++) {
+        auto const * row = pixels.data() + static_cast<std::size_t>(y) * static_cast<std::size_t>(m_width);
+        auto * first = out;
+
+        for (int x = 0; x < m_width; x++) {
+            for (int repeat = 0; repeat < m_scale; repeat++) {
+                *out++ = static_cast<unsigned char>(red(row[x]));
+                *out++ = static_cast<unsigned char>(green(row[x]));
+                *out++ = static_cast<unsigned char>(blue(row[x]));
+            }
+        }
+
+        // the other scale - 1 rows are the same
+        for (int repeat = 1; repeat < m_scale; repeat++) {
+            out = std::copy_n(first, row_bytes, out);
+        }
+    }
+}
+
+//------------------------------------------------------------
+void
+frame_recorder::encode_y4m(std::vector<std::uint32_t> const & pixels) {
+    auto const out_width = m_width * m_scale;
+    auto const out_height = m_height * m_scale;
+    auto const chroma_width = (out_width + 1) / 2;
+    auto const chroma_height = (out_height + 1) / 2;
+
+    auto const luma_size = static_cast<std::size_t>(out_width) * static_cast<std::size_t>(out_height);
+    auto const chroma_size = static_cast<std::size_t>(chroma_width) * static_cast<std::size_t>(chroma_height);
+    m_encoded.resize(luma_size + 2 * chroma_size);
+
+    auto * y_plane = m_encoded.data();
+    auto * u_plane = y_plane + luma_size;
+    auto * v_plane = u_plane + chroma_size;
+
+    // the cell under an output pixel, clamped for the odd edge of chroma
+    auto cell = [&](int x, int y) {
+        x = std::min(x, out_width - 1) / m_scale;
+        y = std::min(y, out_height - 1) / m_scale;
+        return pixels[static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(m_width)];
+    };
+
+    for (int y = 0; y < out_height; y++) {
+        for (int x = 0; x < out_width; x++) {
+            auto const p = cell(x, y);
+            *y_plane++ = luma(red(p), green(p), blue(p));
+        }
+    }
+
+    // chroma is the mean over each 2x2 block
+    for (int y = 0; y < chroma_height; y++) {
+        for (int x = 0; x < chroma_width; x++) {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    auto const p = cell(2 * x + dx, 2 * y + dy);
+                    r += red(p);
+                    g += green(p);
+                    b += blue(p);
+                }
+            }
+
+            *u_plane++ = chroma_blue(r / 4, g / 4, b / 4);
+            *v_plane++ = chroma_red(r / 4, g / 4, b / 4);
+        }
+    }
+}
+
+//------------------------------------------------------------
+std::string
+frame_recorder::numbered_path(std::uint64_t number) const {
+    auto const first = m_path.find('#');
+    auto const last = m_path.find_first_not_of('#', first);
+    auto const digits = ((last == std::string::npos) ? m_path.size() : last) - first;
+
+    auto text = std::to_string(number);
+    if (text.size() < digits) {
+        text.insert(0, digits - text.size(), '0');
+    }
+
+    return m_path.substr(0, first) + text + ((last == std::string::npos) ? std::string() : m_path.substr(last));
+}
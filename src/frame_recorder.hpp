@@ -0,0 +1,121 @@
+#ifndef FRAME_RECORDER_HPP
+#define FRAME_RECORDER_HPP
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class grid_pixels;
+
+//------------------------------------------------------------
+//                      frame_recorder                      //
+//------------------------------------------------------------
+
+// writes grid_pixels frames out as video on its own thread, for runs with
+// no display. the path picks the format:
+//
+//   - *.y4m            one yuv4mpeg2 stream, 4:2:0, which ffmpeg and most
+//                      players read as is
+//   - a path with #s   one binary ppm per frame, the run of #s replaced by
+//                      the zero padded frame number, frame_#####.ppm
+//   - anything else    binary ppm frames back to back in one file, which
+//                      ffmpeg reads with -f image2pipe
+//
+// record() only copies the pixels into one of a fixed pool of frame
+// buffers and queues it - the colour conversion, scaling and writing all
+// happen on the writer thread. when every buffer is still queued the
+// writer has fallen behind, and the frame is dropped or, with
+// overflow::WAIT, record() waits for a buffer to come free.
+class frame_recorder final {
+public:
+    enum class format {
+        Y4M,
+        PPM_STREAM,
+        PPM_FILES,
+    };
+
+    enum class overflow {
+        DROP,
+        WAIT,
+    };
+
+//                         RAII                             //
+//------------------------------------------------------------
+    // width and height in cells, each written as scale x scale pixels
+    frame_recorder(std::string path, int width, int height, int fps = 30, int scale = 1, std::size_t buffers = 4, overflow when_full = overflow::DROP) noexcept(false);
+
+    // finishes every queued frame
+    ~frame_recorder();
+
+    frame_recorder(frame_recorder const &) = delete;
+    frame_recorder & operator=(frame_recorder const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // false if the frame was dropped
+    bool record(grid_pixels const & pixels);
+
+    // blocks until every queued frame is written
+    void flush();
+
+    // rethrows on the calling thread if a write failed
+    void check();
+
+    std::uint64_t frames_written() const;
+    std::uint64_t frames_dropped() const;
+
+    static format format_of(std::string const & path);
+
+private:
+    void loop();
+    void write(std::vector<std::uint32_t> const & pixels, std::uint64_t number);
+    void encode_ppm(std::vector<std::uint32_t> const & pixels);
+    void encode_y4m(std::vector<std::uint32_t> const & pixels);
+    std::string numbered_path(std::uint64_t number) const;
+
+//                         data                             //
+//------------------------------------------------------------
+    std::string m_path;
+    format m_format;
+    overflow m_when_full;
+    int m_width;
+    int m_height;
+    int m_fps;
+    int m_scale;
+
+    // only touched by the writer thread
+    std::ofstream m_file;
+    std::vector<unsigned char> m_encoded;
+
+    // buffers are handed between the threads by index, the pixels in them
+    // belong to whichever side holds the index
+    std::vector<std::vector<std::uint32_t>> m_buffers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_freed;
+    std::vector<std::size_t> m_free;
+    std::deque<std::size_t> m_queue;
+    bool m_writing;
+    bool m_stopping;
+
+    std::atomic<std::uint64_t> m_written;
+    std::atomic<std::uint64_t> m_dropped;
+
+    std::atomic<bool> m_failed;
+    std::exception_ptr m_error;
+
+    std::thread m_thread;
+
+}; // frame_recorder
+
+#endif // FRAME_RECORDER_HPP
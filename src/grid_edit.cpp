@@ -0,0 +1,141 @@
+#include "grid_edit.hpp"
+
+// my
+#include "profiler.hpp"
+#include "water_grid.hpp"
+
+namespace {
+
+material
+material_of(grid_edit::kind type) {
+    switch (type) {
+        case grid_edit::kind::GROUND: return material::GROUND;
+        case grid_edit::kind::WATER:  return material::WATER;
+        case grid_edit::kind::SAND:   return material::SAND;
+        case grid_edit::kind::OIL:    return material::OIL;
+        case grid_edit::kind::LAVA:   return material::LAVA;
+        default:                      return material::AIR;
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                        grid_edit                         //
+//------------------------------------------------------------
+
+
+//                       functions                         //
+//------------------------------------------------------------
+grid_edit
+grid_edit::rect(kind type, int x0, int y0, int x1, int y1, float mass) {
+    grid_edit edit {type, x0, y0, mass, shape::RECT};
+    edit.x2 = x1;
+    edit.y2 = y1;
+    return edit;
+}
+
+//------------------------------------------------------------
+grid_edit
+grid_edit::circle(kind type, int x, int y, int radius, float mass) {
+    grid_edit edit {type, x, y, mass, shape::CIRCLE};
+    edit.radius = radius;
+    return edit;
+}
+
+//------------------------------------------------------------
+grid_edit
+grid_edit::line(kind type, int x0, int y0, int x1, int y1, int radius, float mass) {
+    grid_edit edit {type, x0, y0, mass, shape::LINE};
+    edit.x2 = x1;
+    edit.y2 = y1;
+    edit.radius = radius;
+    return edit;
+}
+
+//------------------------------------------------------------
+grid_edit
+grid_edit::flood(kind type, int x, int y, float mass) {
+    return grid_edit {type, x, y, mass, shape::FLOOD};
+}
+
+//------------------------------------------------------------
+grid_edit
+grid_edit::clear_material(material target) {
+    grid_edit edit {kind::CLEAR_MATERIAL};
+    edit.target = target;
+    return edit;
+}
+
+//------------------------------------------------------------
+void
+grid_edit::apply(water_grid & grid) const {
+    switch (type) {
+        case kind::CLEAR:          grid.clear();                  return;
+        case kind::CLEAR_WATER:    grid.clear_water();            return;
+        case kind::CLEAR_MATERIAL: grid.clear_material(target);   return;
+        case kind::SETTLE:         grid.settle_basins();          return;
+        default:                                                  break;
+    }
+
+    auto const fill = material_of(type);
+
+    switch (area) {
+        case shape::CELL:
+            switch (type) {
+                case kind::GROUND: grid.set_ground(x, y);      break;
+                case kind::WATER:  grid.set_water(x, y, mass); break;
+                case kind::AIR:    grid.set_air(x, y);         break;
+
+                // the other materials have no cell setter of their own
+                default:           grid.fill_rect(x, y, x, y, fill, mass); break;
+            }
+            break;
+
+        case shape::RECT:   grid.fill_rect(x, y, x2, y2, fill, mass);           break;
+        case shape::CIRCLE: grid.fill_circle(x, y, radius, fill, mass);         break;
+        case shape::LINE:   grid.fill_line(x, y, x2, y2, radius, fill, mass);   break;
+        case shape::FLOOD:  grid.flood_fill(x, y, fill, mass);                  break;
+    }
+}
+
+//------------------------------------------------------------
+//                     grid_edit_buffer                     //
+//------------------------------------------------------------
+
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+grid_edit_buffer::push(grid_edit const & edit) {
+    m_edits.push_back(edit);
+}
+
+//------------------------------------------------------------
+void
+grid_edit_buffer::apply(water_grid & grid) {
+    AQUABLOCK_PROFILE_SCOPE("grid.edits");
+
+    for (auto const & edit : m_edits) {
+        edit.apply(grid);
+    }
+    m_edits.clear();
+}
+
+//------------------------------------------------------------
+void
+grid_edit_buffer::clear() {
+    m_edits.clear();
+}
+
+//------------------------------------------------------------
+std::size_t
+grid_edit_buffer::size() const {
+    return m_edits.size();
+}
+
+//------------------------------------------------------------
+bool
+grid_edit_buffer::empty() const {
+    return m_edits.empty();
+}
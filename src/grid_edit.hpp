@@ -0,0 +1,104 @@
+#ifndef GRID_EDIT_HPP
+#define GRID_EDIT_HPP
+
+// std
+#include <cstddef>
+#include <vector>
+
+// my
+#include "material.hpp"
+
+class water_grid;
+
+//------------------------------------------------------------
+//                        grid_edit                         //
+//------------------------------------------------------------
+
+// one user edit, small and trivially copyable so it can cross threads
+// through a spsc_queue and be applied by whoever owns the grid.
+//
+// GROUND, WATER, AIR, SAND, OIL and LAVA write their material over a
+// shape - one cell, a rectangle between two corners, a circle, a line with
+// a radius or the flood filled region under x, y. everything but a single
+// cell goes through the bulk edits on water_grid, so one edit can place
+// millions of cells a row span at a time. SETTLE runs
+// water_grid::settle_basins().
+struct grid_edit {
+    enum class kind {
+        GROUND,
+        WATER,
+        AIR,
+        SAND,
+        OIL,
+        LAVA,
+        CLEAR,
+        CLEAR_WATER,
+        CLEAR_MATERIAL,
+        SETTLE,
+    };
+
+    enum class shape {
+        CELL,
+        RECT,
+        CIRCLE,
+        LINE,
+        FLOOD,
+    };
+
+//                       functions                         //
+//------------------------------------------------------------
+    static grid_edit rect(kind type, int x0, int y0, int x1, int y1, float mass = 0.0f);
+    static grid_edit circle(kind type, int x, int y, int radius, float mass = 0.0f);
+    static grid_edit line(kind type, int x0, int y0, int x1, int y1, int radius, float mass = 0.0f);
+    static grid_edit flood(kind type, int x, int y, float mass = 0.0f);
+    static grid_edit clear_material(material target);
+
+    void apply(water_grid & grid) const;
+
+//                         data                             //
+//------------------------------------------------------------
+    kind type = kind::AIR;
+    int x = 0;
+    int y = 0;
+    float mass = 0.0f;
+
+    shape area = shape::CELL;
+
+    // the other corner of a RECT or end of a LINE
+    int x2 = 0;
+    int y2 = 0;
+    int radius = 0;
+
+    // the material CLEAR_MATERIAL turns into air
+    material target = material::WATER;
+
+}; // grid_edit
+
+//------------------------------------------------------------
+//                     grid_edit_buffer                     //
+//------------------------------------------------------------
+
+// edits recorded up front and applied together between ticks, for tools
+// that build whole levels. unlike the queue in sim_thread it grows as
+// needed, so it is for whoever owns the grid, not for crossing threads.
+class grid_edit_buffer final {
+public:
+//                       functions                         //
+//------------------------------------------------------------
+    void push(grid_edit const & edit);
+
+    // in the order they were pushed, then the buffer is empty again
+    void apply(water_grid & grid);
+
+    void clear();
+    std::size_t size() const;
+    bool empty() const;
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::vector<grid_edit> m_edits;
+
+}; // grid_edit_buffer
+
+#endif // GRID_EDIT_HPP
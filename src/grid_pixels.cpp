@@ -0,0 +1,375 @@
+#include "grid_pixels.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+// my
+#include "constants.hpp"
+#include "grid_snapshot.hpp"
+#include "material_registry.hpp"
+#include "water_grid.hpp"
+
+namespace {
+
+float
+mass_value(float mass) {
+    return mass;
+}
+
+float
+mass_value(std::uint16_t mass) {
+    return static_cast<float>(mass) / constants::fixed_mass_scale;
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                       grid_pixels                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+grid_pixels::grid_pixels(int width, int height)
+:   m_width{width}
+,   m_height{height}
+,   m_painted_tick{0}
+,   m_painted{false} {
+
+    if (width < 1 || height < 1) {
+        throw std::invalid_argument("grid_pixels needs a positive size");
+    }
+
+    m_pixels.assign(static_cast<std::size_t>(width) * static_cast<std::size_t>(height), pack(constants::air));
+
+    for (std::size_t i = 0; i < lut_size; i++) {
+        auto const amount = static_cast<float>(i) / static_cast<float>(lut_size - 1);
+        auto const water = lerp_colour(constants::min_mass_colour, constants::max_mass_colour, amount);
+
+        m_water_lut[i] = pack(water);
+        m_falling_lut[i] = pack(lerp_colour(constants::air, water, amount));
+    }
+
+    for (std::size_t type = 0; type < m_flat.size(); type++) {
+        m_flat[type] = pack(properties_of(static_cast<material>(type)).shade);
+    }
+
+    for (auto w = width, h = height; w > 1 || h > 1;) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+
+        auto const count = static_cast<std::size_t>(w) * static_cast<std::size_t>(h);
+        m_mips.push_back({w, h, std::vector<float>(count), std::vector<std::uint32_t>(count), std::vector<std::uint32_t>(count), std::vector<std::uint32_t>(count)});
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+grid_pixels::paint(water_grid const & grid) {
+    // the painter walks row major planes, a tiled grid goes by a snapshot
+    if (grid.layout().kind != cell_layout::ROW_MAJOR) {
+        grid_snapshot snapshot;
+        snapshot.capture(grid, 0);
+        paint(snapshot.width, snapshot.height, snapshot.types.data(), snapshot.mass.data());
+        return;
+    }
+
+    if (grid.format() == mass_format::FIXED16) {
+        paint(grid.width(), grid.height(), grid.material_data(), grid.fixed_mass_data());
+    } else {
+        paint(grid.width(), grid.height(), grid.material_data(), grid.mass_data());
+    }
+}
+
+//------------------------------------------------------------
+void
+grid_pixels::paint(grid_snapshot const & snapshot) {
+    if (!m_painted || snapshot.chunk_ticks.empty()) {
+        paint(snapshot.width, snapshot.height, snapshot.types.data(), snapshot.mass.data());
+        m_painted_tick = snapshot.tick;
+        m_painted = true;
+        return;
+    }
+
+    if (snapshot.width != m_width || snapshot.height != m_height) {
+        throw std::invalid_argument("grid_pixels size does not match the grid");
+    }
+
+    auto const size = static_cast<int>(snapshot.chunk_size);
+    auto const row = static_cast<std::size_t>(m_width);
+
+    for (std::size_t chunk_y = 0; chunk_y < snapshot.chunks_y; chunk_y++) {
+        auto const * ticks = snapshot.chunk_ticks.data() + chunk_y * snapshot.chunks_x;
+
+        // runs of changed chunks along the row become one rect each
+        for (std::size_t first = 0; first < snapshot.chunks_x;) {
+            if (ticks[first] <= m_painted_tick) {
+                first++;
+                continue;
+            }
+
+            auto last = first + 1;
+            while (last < snapshot.chunks_x && ticks[last] > m_painted_tick) last++;
+
+            auto const x_begin = static_cast<int>(first) * size;
+            auto const x_end = std::min(static_cast<int>(last) * size, m_width);
+            auto const y_begin = static_cast<int>(chunk_y) * size;
+            auto const y_end = std::min(y_begin + size + 1, m_height);
+
+            for (auto y = y_begin; y < y_end; y++) {
+                auto const begin = static_cast<std::size_t>(x_begin) + static_cast<std::size_t>(y) * row;
+                paint_span(snapshot.types.data(), snapshot.mass.data(), begin, static_cast<std::size_t>(x_end - x_begin));
+            }
+
+            m_dirty.push_back({x_begin, y_begin, x_end - x_begin, y_end - y_begin});
+            update_mips(snapshot.types.data(), snapshot.mass.data(), m_dirty.back());
+            first = last;
+        }
+    }
+
+    m_painted_tick = snapshot.tick;
+}
+
+//------------------------------------------------------------
+template <typename mass_type>
+void
+grid_pixels::paint(int width, int height, material const * types, mass_type const * mass) {
+    if (width != m_width || height != m_height) {
+        throw std::invalid_argument("grid_pixels size does not match the grid");
+    }
+
+    paint_span(types, mass, 0, static_cast<std::size_t>(m_width) * static_cast<std::size_t>(m_height));
+
+    m_dirty.clear();
+    m_dirty.push_back({0, 0, m_width, m_height});
+    update_mips(types, mass, m_dirty.back());
+}
+
+//------------------------------------------------------------
+template <typename mass_type>
+void
+grid_pixels::paint_span(material const * types, mass_type const * mass, std::size_t begin, std::size_t count) {
+    auto * pixels = m_pixels.data();
+
+    auto const row = static_cast<std::size_t>(m_width);
+
+    // only water is shaded by its mass, everything else is one colour
+    for (auto i = begin; i < begin + count; i++) {
+        if (types[i] == material::WATER) {
+            // the top row is always ground so i - row is in range
+            bool const falling = mass[i - row] == 0;
+            pixels[i] = (falling ? m_falling_lut : m_water_lut)[lut_index(mass[i])];
+        } else {
+            pixels[i] = m_flat[static_cast<std::size_t>(types[i])];
+        }
+    }
+}
+
+//------------------------------------------------------------
+template <typename mass_type>
+void
+grid_pixels::update_mips(material const * types, mass_type const * mass, pixel_rect const & rect) {
+    // the rect in the level below, as [begin, end) on each axis
+    auto x_begin = rect.x;
+    auto y_begin = rect.y;
+    auto x_end = rect.x + rect.w;
+    auto y_end = rect.y + rect.h;
+    auto below_width = m_width;
+    auto below_height = m_height;
+
+    for (std::size_t level = 0; level < m_mips.size(); level++) {
+        auto & mip = m_mips[level];
+
+        x_begin /= 2;
+        y_begin /= 2;
+        x_end = (x_end + 1) / 2;
+        y_end = (y_end + 1) / 2;
+
+        for (auto y = y_begin; y < y_end; y++) {
+            for (auto x = x_begin; x < x_end; x++) {
+                float mass_total = 0.0f;
+                std::uint32_t water = 0;
+                std::uint32_t other = 0;
+                std::uint64_t other_sum[3] = {0, 0, 0};
+
+                auto add_other = [&](std::uint32_t cells, std::uint32_t colour) {
+                    other += cells;
+                    for (int channel = 0; channel < 3; channel++) {
+                        other_sum[channel] += static_cast<std::uint64_t>(cells) * ((colour >> (8 * channel)) & 0xffu);
+                    }
+                };
+
+                for (auto cy = 2 * y; cy < std::min(2 * y + 2, below_height); cy++) {
+                    for (auto cx = 2 * x; cx < std::min(2 * x + 2, below_width); cx++) {
+                        auto const child = static_cast<std::size_t>(cx) + static_cast<std::size_t>(cy) * static_cast<std::size_t>(below_width);
+
+                        if (level == 0) {
+                            if (types[child] == material::WATER) {
+                                mass_total += mass_value(mass[child]);
+                                water++;
+                            } else if (types[child] != material::AIR) {
+                                add_other(1, m_flat[static_cast<std::size_t>(types[child])]);
+                            }
+                        } else {
+                            auto const & below = m_mips[level - 1];
+                            mass_total += below.mass[child];
+                            water += below.water[child];
+                            add_other(below.other[child], below.other_colour[child]);
+                        }
+                    }
+                }
+
+                auto const i = static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(mip.width);
+                mip.mass[i] = mass_total;
+                mip.water[i] = water;
+                mip.other[i] = other;
+
+                std::uint32_t other_colour = 0;
+                for (int channel = 0; other > 0 && channel < 3; channel++) {
+                    other_colour |= static_cast<std::uint32_t>(other_sum[channel] / other) << (8 * channel);
+                }
+                mip.other_colour[i] = other_colour;
+            }
+        }
+
+        below_width = mip.width;
+        below_height = mip.height;
+    }
+}
+
+//------------------------------------------------------------
+void
+grid_pixels::paint_view(int level, int x, int y, int w, int h, std::uint32_t * out, std::size_t out_pitch) const {
+    if (level == 0) {
+        for (int row = 0; row < h; row++) {
+            auto const * first = m_pixels.data() + static_cast<std::size_t>(x) + static_cast<std::size_t>(y + row) * static_cast<std::size_t>(m_width);
+            std::copy_n(first, w, out + static_cast<std::size_t>(row) * out_pitch);
+        }
+        return;
+    }
+
+    for (int row = 0; row < h; row++) {
+        auto * line = out + static_cast<std::size_t>(row) * out_pitch;
+
+        for (int column = 0; column < w; column++) {
+            line[column] = mip_colour(level, x + column, y + row);
+        }
+    }
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::levels() const {
+    return static_cast<int>(m_mips.size()) + 1;
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::level_width(int level) const {
+    return (level == 0) ? m_width : m_mips[static_cast<std::size_t>(level - 1)].width;
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::level_height(int level) const {
+    return (level == 0) ? m_height : m_mips[static_cast<std::size_t>(level - 1)].height;
+}
+
+//------------------------------------------------------------
+std::uint32_t
+grid_pixels::mip_colour(int level, int x, int y) const {
+    auto const & mip = m_mips[static_cast<std::size_t>(level - 1)];
+    auto const i = static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(mip.width);
+
+    // texels on the right and bottom edges can cover less than a full block
+    auto const size = 1 << level;
+    auto const covered_x = std::min(size, m_width - x * size);
+    auto const covered_y = std::min(size, m_height - y * size);
+    auto const cells = static_cast<std::uint64_t>(covered_x) * static_cast<std::uint64_t>(covered_y);
+
+    auto const water = static_cast<std::uint64_t>(mip.water[i]);
+    auto const other = static_cast<std::uint64_t>(mip.other[i]);
+    auto const air = cells - water - other;
+
+    auto const water_colour = (water > 0) ? m_water_lut[lut_index(mip.mass[i] / static_cast<float>(water))] : 0u;
+    auto const other_colour = mip.other_colour[i];
+    auto const air_colour = pack(constants::air);
+
+    // each channel is the mean of the cells under the texel
+    std::uint32_t result = 0xff000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+        auto const channel = [shift](std::uint32_t c) { return static_cast<std::uint64_t>((c >> shift) & 0xffu); };
+        auto const sum = water * channel(water_colour) + other * channel(other_colour) + air * channel(air_colour);
+
+        result |= static_cast<std::uint32_t>(sum / cells) << shift;
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------
+std::vector<grid_pixels::pixel_rect> const &
+grid_pixels::dirty() const {
+    return m_dirty;
+}
+
+//------------------------------------------------------------
+void
+grid_pixels::clear_dirty() {
+    m_dirty.clear();
+}
+
+//------------------------------------------------------------
+std::uint32_t const *
+grid_pixels::data() const {
+    return m_pixels.data();
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::width() const {
+    return m_width;
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::height() const {
+    return m_height;
+}
+
+//------------------------------------------------------------
+int
+grid_pixels::pitch() const {
+    return m_width * static_cast<int>(sizeof(std::uint32_t));
+}
+
+//------------------------------------------------------------
+std::uint32_t
+grid_pixels::pack(colour const & c) {
+    return 0xff000000u
+         | (static_cast<std::uint32_t>(c.r) << 16)
+         | (static_cast<std::uint32_t>(c.g) << 8)
+         |  static_cast<std::uint32_t>(c.b);
+}
+
+//------------------------------------------------------------
+std::size_t
+grid_pixels::lut_index(float mass) const {
+    auto const scaled = mass * (static_cast<float>(lut_size - 1) / constants::max_mass);
+
+    if (!(scaled > 0.0f)) return 0;
+    if (scaled >= static_cast<float>(lut_size - 1)) return lut_size - 1;
+    return static_cast<std::size_t>(scaled);
+}
+
+//------------------------------------------------------------
+std::size_t
+grid_pixels::lut_index(std::uint16_t mass) const {
+    // lut_size - 1 == max_mass, so the index is the whole part of the mass
+    static_assert(lut_size - 1 == static_cast<std::size_t>(constants::max_mass), "fixed point lut index assumes one entry per unit of mass");
+
+    auto const index = static_cast<std::size_t>(mass / constants::fixed_mass_scale);
+    return (index < lut_size) ? index : lut_size - 1;
+}
@@ -0,0 +1,128 @@
+#ifndef GRID_PIXELS_HPP
+#define GRID_PIXELS_HPP
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// my
+#include "colour.hpp"
+#include "material.hpp"
+
+class water_grid;
+struct grid_snapshot;
+
+//------------------------------------------------------------
+//                       grid_pixels                        //
+//------------------------------------------------------------
+
+// one 0xAARRGGBB pixel per cell, filled in a single pass over the grid.
+// water colours come from lookup tables indexed by the mass quantised to
+// lut_size steps, built once from constants::min_mass_colour and
+// max_mass_colour, so painting a cell is a table load and no float lerp.
+//
+// falling water (nothing above it) used to be drawn as a partly filled
+// cell. with one pixel per cell it is blended towards the air colour by
+// how full it is instead, which reads the same once scaled up.
+//
+// painting a snapshot after the first only repaints the chunks that
+// changed since the last one painted, plus the row under each as falling
+// water looks at the cell above. the regions repainted are kept as
+// dirty() rects until clear_dirty(), so only they need uploading.
+//
+// for drawing zoomed out there is a mip pyramid above the pixels. each
+// level has a texel per 2x2 of the level below and keeps the totals under
+// it - water mass, how many cells are water, and how many are anything but
+// water or air along with their mean colour - so a texel is coloured by
+// what it covers instead of by whichever cell a sample hits.
+// it is kept up to date from the same repainted regions, a texel per
+// level for every four below, so it costs a third of the repaint again.
+class grid_pixels final {
+public:
+    struct pixel_rect {
+        int x;
+        int y;
+        int w;
+        int h;
+    };
+
+//                         RAII                             //
+//------------------------------------------------------------
+    grid_pixels(int width, int height);
+
+//                       functions                         //
+//------------------------------------------------------------
+    void paint(water_grid const & grid);
+    void paint(grid_snapshot const & snapshot);
+
+    std::vector<pixel_rect> const & dirty() const;
+    void clear_dirty();
+
+    // texels [x, x + w) x [y, y + h) of a level into out, a row every
+    // out_pitch pixels. level 0 is the pixels themselves
+    void paint_view(int level, int x, int y, int w, int h, std::uint32_t * out, std::size_t out_pitch) const;
+
+    int levels() const;
+    int level_width(int level) const;
+    int level_height(int level) const;
+
+    std::uint32_t const * data() const;
+    int width() const;
+    int height() const;
+    int pitch() const;
+
+    static constexpr std::size_t lut_size = 256;
+
+    static std::uint32_t pack(colour const & c);
+
+private:
+    // float or FIXED16 mass planes
+    template <typename mass_type>
+    void paint(int width, int height, material const * types, mass_type const * mass);
+
+    template <typename mass_type>
+    void paint_span(material const * types, mass_type const * mass, std::size_t begin, std::size_t count);
+
+    // totals of every texel of every level above level 0 that is over rect
+    template <typename mass_type>
+    void update_mips(material const * types, mass_type const * mass, pixel_rect const & rect);
+
+    std::uint32_t mip_colour(int level, int x, int y) const;
+
+    std::size_t lut_index(float mass) const;
+    std::size_t lut_index(std::uint16_t mass) const;
+
+    struct mip_level {
+        int width;
+        int height;
+        std::vector<float> mass;
+        std::vector<std::uint32_t> water;
+        std::vector<std::uint32_t> other;
+        std::vector<std::uint32_t> other_colour;
+    };
+
+//                         data                             //
+//------------------------------------------------------------
+    int m_width;
+    int m_height;
+    std::vector<std::uint32_t> m_pixels;
+    std::vector<pixel_rect> m_dirty;
+
+    // the tick of the last snapshot painted, if there was one
+    std::uint64_t m_painted_tick;
+    bool m_painted;
+    std::array<std::uint32_t, lut_size> m_water_lut;
+    std::array<std::uint32_t, lut_size> m_falling_lut;
+
+    // the one colour of every material but water, from material_registry.hpp,
+    // for every byte a cell can hold so an unknown one reads as ground
+    std::array<std::uint32_t, 256> m_flat;
+
+    // level 1 up, until a single texel covers the whole grid
+    std::vector<mip_level> m_mips;
+
+}; // grid_pixels
+
+#endif // GRID_PIXELS_HPP
@@ -0,0 +1,127 @@
+#include "grid_renderer.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// my
+#include "camera.hpp"
+#include "grid_pixels.hpp"
+#include "sdl_module.hpp"
+
+//------------------------------------------------------------
+//                      grid_renderer                       //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+grid_renderer::grid_renderer(SDL_Renderer * renderer, int view_width, int view_height) noexcept(false)
+:   m_renderer{renderer}
+,   m_texture{nullptr}
+,   m_texture_width{view_width + 2}
+,   m_texture_height{view_height + 2}
+,   m_level{-1}
+,   m_region{0, 0, 0, 0}
+,   m_target{0, 0, 0, 0} {
+
+    // nearest neighbour so every cell stays a hard edged block when scaled
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+
+    // a view that starts part way into a texel sees at most one more on
+    // each axis than it has pixels
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, m_texture_width, m_texture_height);
+
+    if (m_texture == nullptr) {
+        throw sdl_module_exception(SDL_GetError());
+    }
+
+    m_staging.resize(static_cast<std::size_t>(m_texture_width) * static_cast<std::size_t>(m_texture_height));
+}
+
+//------------------------------------------------------------
+grid_renderer::~grid_renderer() {
+    SDL_DestroyTexture(m_texture);
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+bool
+grid_renderer::update(grid_pixels & pixels, camera const & view) {
+    auto const level = std::min(view.level(), pixels.levels() - 1);
+    auto const size = static_cast<float>(1 << level);
+    auto const level_width = pixels.level_width(level);
+    auto const level_height = pixels.level_height(level);
+
+    // the texels the view covers, clipped to the level
+    auto const x_begin = std::max(static_cast<int>(std::floor(view.left() / size)), 0);
+    auto const y_begin = std::max(static_cast<int>(std::floor(view.top() / size)), 0);
+    auto const x_end = std::min(static_cast<int>(std::ceil(view.cell_x(static_cast<float>(view.view_width())) / size)), level_width);
+    auto const y_end = std::min(static_cast<int>(std::ceil(view.cell_y(static_cast<float>(view.view_height())) / size)), level_height);
+
+    SDL_Rect const region {x_begin, y_begin, std::clamp(x_end - x_begin, 0, m_texture_width), std::clamp(y_end - y_begin, 0, m_texture_height)};
+
+    auto const left = static_cast<int>(std::lround(view.screen_x(static_cast<float>(region.x) * size)));
+    auto const top = static_cast<int>(std::lround(view.screen_y(static_cast<float>(region.y) * size)));
+    auto const right = static_cast<int>(std::lround(view.screen_x(static_cast<float>(region.x + region.w) * size)));
+    auto const bottom = static_cast<int>(std::lround(view.screen_y(static_cast<float>(region.y + region.h) * size)));
+    SDL_Rect const target {left, top, right - left, bottom - top};
+
+    bool changed = false;
+
+    if (level != m_level || region.x != m_region.x || region.y != m_region.y || region.w != m_region.w || region.h != m_region.h) {
+        // a different set of texels, all of them are needed
+        m_level = level;
+        m_region = region;
+        upload(pixels, 0, 0, region.w, region.h);
+        changed = true;
+    } else {
+        // the same texels, only the dirty ones in view are out of date
+        for (auto const & rect : pixels.dirty()) {
+            auto const dirty_x_begin = std::max((rect.x >> level) - region.x, 0);
+            auto const dirty_y_begin = std::max((rect.y >> level) - region.y, 0);
+            auto const dirty_x_end = std::min(((rect.x + rect.w - 1) >> level) + 1 - region.x, region.w);
+            auto const dirty_y_end = std::min(((rect.y + rect.h - 1) >> level) + 1 - region.y, region.h);
+
+            if (dirty_x_begin < dirty_x_end && dirty_y_begin < dirty_y_end) {
+                upload(pixels, dirty_x_begin, dirty_y_begin, dirty_x_end - dirty_x_begin, dirty_y_end - dirty_y_begin);
+                changed = true;
+            }
+        }
+    }
+
+    pixels.clear_dirty();
+
+    if (target.x != m_target.x || target.y != m_target.y || target.w != m_target.w || target.h != m_target.h) {
+        m_target = target;
+        changed = true;
+    }
+
+    return changed;
+}
+
+//------------------------------------------------------------
+void
+grid_renderer::draw() {
+    if (m_region.w < 1 || m_region.h < 1) return;
+
+    SDL_Rect const source {0, 0, m_region.w, m_region.h};
+    SDL_RenderCopy(m_renderer, m_texture, &source, &m_target);
+}
+
+//------------------------------------------------------------
+void
+grid_renderer::upload(grid_pixels const & pixels, int x, int y, int w, int h) {
+    if (w < 1 || h < 1) return;
+
+    auto const pitch = static_cast<std::size_t>(m_texture_width);
+    auto * first = m_staging.data() + static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * pitch;
+
+    pixels.paint_view(m_level, m_region.x + x, m_region.y + y, w, h, first, pitch);
+
+    SDL_Rect const area {x, y, w, h};
+    if (SDL_UpdateTexture(m_texture, &area, first, m_texture_width * static_cast<int>(sizeof(std::uint32_t))) != 0) {
+        throw sdl_module_exception(SDL_GetError());
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef GRID_RENDERER_HPP
+#define GRID_RENDERER_HPP
+
+// std
+#include <cstdint>
+#include <vector>
+
+// dependancies
+#include "SDL2/SDL.h"
+
+class camera;
+class grid_pixels;
+
+//------------------------------------------------------------
+//                      grid_renderer                       //
+//------------------------------------------------------------
+
+// draws what a camera sees of a grid_pixels buffer through a streaming
+// texture the size of the view, with a texel per cell (or per mip texel
+// when zoomed out) that the renderer scales up to the window. replaces a
+// fill rect per cell, which made the draw call count the limit on large
+// grids.
+//
+// only texels in view are ever painted or uploaded, and the camera picks a
+// mip level with no more texels than the view has pixels, so the cost is
+// bound by the window and not by the size of the grid. while the camera
+// stays put update() only repaints the dirty rects that are in view, and a
+// frame where nothing in view changed uploads nothing at all.
+class grid_renderer final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    grid_renderer(SDL_Renderer * renderer, int view_width, int view_height) noexcept(false);
+    ~grid_renderer();
+
+    grid_renderer(grid_renderer const &) = delete;
+    grid_renderer & operator=(grid_renderer const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // uploads what changed in view and then clears pixels.dirty(). true if
+    // the picture is different and needs drawing again
+    bool update(grid_pixels & pixels, camera const & view);
+
+    // the view as of the last update
+    void draw();
+
+private:
+    // texels of the current level and region, relative to its corner
+    void upload(grid_pixels const & pixels, int x, int y, int w, int h);
+
+//                         data                             //
+//------------------------------------------------------------
+    SDL_Renderer * m_renderer;
+    SDL_Texture * m_texture;
+    int m_texture_width;
+    int m_texture_height;
+    std::vector<std::uint32_t> m_staging;
+
+    // the texels in the texture and where they go on screen
+    int m_level;
+    SDL_Rect m_region;
+    SDL_Rect m_target;
+
+}; // grid_renderer
+
+#endif // GRID_RENDERER_HPP
@@ -0,0 +1,130 @@
+#include "grid_snapshot.hpp"
+
+// std
+#include <algorithm>
+
+// my
+#include "constants.hpp"
+#include "water_grid.hpp"
+
+namespace {
+
+// cells [x_begin, x_end) of row y of the grid's front planes into the
+// snapshot, a run of the grid's layout at a time
+void
+copy_span(grid_snapshot & snapshot, water_grid const & grid, std::size_t y, std::size_t x_begin, std::size_t x_end) {
+    auto const & layout = grid.layout();
+
+    for (auto x = x_begin; x < x_end;) {
+        auto const from = layout.index(x, y);
+        auto const begin = x + y * static_cast<std::size_t>(snapshot.width);
+        auto const count = layout.run(x, x_end - x);
+
+        std::copy_n(grid.material_data() + from, count, snapshot.types.data() + begin);
+
+        if (grid.format() == mass_format::FIXED16) {
+            auto const * fixed = grid.fixed_mass_data() + from;
+            auto const * fixed_next = grid.fixed_mass_next_data() + from;
+
+            for (std::size_t i = 0; i < count; i++) {
+                snapshot.mass[begin + i] = static_cast<float>(fixed[i]) / constants::fixed_mass_scale;
+                snapshot.mass_next[begin + i] = static_cast<float>(fixed_next[i]) / constants::fixed_mass_scale;
+            }
+        } else {
+            std::copy_n(grid.mass_data() + from, count, snapshot.mass.data() + begin);
+            std::copy_n(grid.mass_next_data() + from, count, snapshot.mass_next.data() + begin);
+        }
+
+        x += count;
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                      grid_snapshot                       //
+//------------------------------------------------------------
+
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+grid_snapshot::capture(water_grid const & grid, std::uint64_t tick_number) {
+    width = grid.width();
+    height = grid.height();
+    tick = tick_number;
+
+    auto const count = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    types.resize(count);
+    mass.resize(count);
+    mass_next.resize(count);
+    for (std::size_t y = 0; y < static_cast<std::size_t>(height); y++) {
+        copy_span(*this, grid, y, 0, static_cast<std::size_t>(width));
+    }
+
+    chunk_size = water_grid::chunk_size;
+    chunks_x = grid.chunks_x();
+    chunks_y = grid.chunks_y();
+    chunk_ticks.assign(chunks_x * chunks_y, tick_number);
+}
+
+//------------------------------------------------------------
+void
+grid_snapshot::capture(water_grid const & grid, std::uint64_t tick_number, std::vector<std::uint64_t> const & changed_ticks) {
+    // a new or resized snapshot has nothing to keep
+    if (width != grid.width() || height != grid.height() || chunk_ticks.size() != changed_ticks.size()) {
+        capture(grid, tick_number);
+        chunk_ticks = changed_ticks;
+        return;
+    }
+
+    auto const row = static_cast<std::size_t>(width);
+    auto const rows = static_cast<std::size_t>(height);
+
+    // row by row through each row of chunks, a run of changed chunks at a
+    // time, so the copies stay long and in order
+    for (std::size_t chunk_y = 0; chunk_y < chunks_y; chunk_y++) {
+        auto const y_begin = chunk_y * chunk_size;
+        auto const y_end = std::min(y_begin + chunk_size, rows);
+        auto const * ticks = changed_ticks.data() + chunk_y * chunks_x;
+
+        for (std::size_t first = 0; first < chunks_x;) {
+            if (ticks[first] <= tick) {
+                first++;
+                continue;
+            }
+
+            auto last = first + 1;
+            while (last < chunks_x && ticks[last] > tick) last++;
+
+            auto const x_begin = first * chunk_size;
+            auto const x_end = std::min(last * chunk_size, row);
+
+            for (auto y = y_begin; y < y_end; y++) {
+                copy_span(*this, grid, y, x_begin, x_end);
+            }
+            first = last;
+        }
+    }
+
+    tick = tick_number;
+    chunk_ticks = changed_ticks;
+}
+
+//------------------------------------------------------------
+material
+grid_snapshot::material_at(int x, int y) const {
+    return types[static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(width)];
+}
+
+//------------------------------------------------------------
+float
+grid_snapshot::mass_at(int x, int y) const {
+    return mass[static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(width)];
+}
+
+//------------------------------------------------------------
+float
+grid_snapshot::mass_next_at(int x, int y) const {
+    return mass_next[static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * static_cast<std::size_t>(width)];
+}
@@ -0,0 +1,56 @@
+#ifndef GRID_SNAPSHOT_HPP
+#define GRID_SNAPSHOT_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// my
+#include "material.hpp"
+
+class water_grid;
+
+//------------------------------------------------------------
+//                      grid_snapshot                       //
+//------------------------------------------------------------
+
+// copy of the cell planes of a water_grid after a tick, so another thread
+// can draw or inspect it while the simulation carries on. capture() reuses
+// the vectors, so once they have grown a snapshot costs three copies.
+// mass is always float here, FIXED16 grids are converted on capture.
+//
+// chunk_ticks holds the tick each chunk last changed on. given those, a
+// capture over an older snapshot of the same grid only copies the chunks
+// that changed since it was taken, and whoever draws it only has to redo
+// the chunks newer than the last tick it drew.
+struct grid_snapshot {
+//                       functions                         //
+//------------------------------------------------------------
+    // the whole grid, every chunk counts as changed on tick_number
+    void capture(water_grid const & grid, std::uint64_t tick_number);
+
+    // only the chunks that changed after this snapshot's own tick
+    void capture(water_grid const & grid, std::uint64_t tick_number, std::vector<std::uint64_t> const & changed_ticks);
+
+    material material_at(int x, int y) const;
+    float mass_at(int x, int y) const;
+    float mass_next_at(int x, int y) const;
+
+//                         data                             //
+//------------------------------------------------------------
+    int width = 0;
+    int height = 0;
+    std::uint64_t tick = 0;
+    std::vector<material> types;
+    std::vector<float> mass;
+    std::vector<float> mass_next;
+
+    std::size_t chunk_size = 0;
+    std::size_t chunks_x = 0;
+    std::size_t chunks_y = 0;
+    std::vector<std::uint64_t> chunk_ticks;
+
+}; // grid_snapshot
+
+#endif // GRID_SNAPSHOT_HPP
@@ -0,0 +1,36 @@
+#ifndef HALO_TRANSPORT_HPP
+#define HALO_TRANSPORT_HPP
+
+// std
+#include <cstddef>
+
+//------------------------------------------------------------
+//                      halo_transport                      //
+//------------------------------------------------------------
+
+// how the ranks of a distributed run talk to each other, see subdomain.hpp.
+// ranks are numbered from 0 and every call blocks until its bytes are all
+// through. a transport only has to reach the ranks a subdomain talks to -
+// its four neighbours and rank 0.
+//
+// socket_transport is the one for a single machine. anything that can move
+// bytes between two ranks in order, tcp or an mpi library, fits behind the
+// same three calls.
+class halo_transport {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    virtual ~halo_transport() = default;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // sends out to peer while receiving the same number of bytes from it,
+    // so two ranks exchanging with each other never both wait on the send
+    virtual void exchange(int peer, void const * out, void * in, std::size_t bytes) = 0;
+
+    virtual void send(int peer, void const * data, std::size_t bytes) = 0;
+    virtual void receive(int peer, void * data, std::size_t bytes) = 0;
+
+}; // halo_transport
+
+#endif // HALO_TRANSPORT_HPP
@@ -1,35 +1,63 @@
 // std
 #include <iostream>
 #include <cstdint>
-#include <array>
 #include <algorithm>                
 #include <cmath>
 #include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
 
 // my
 #include "sdl_module.hpp"
+#include "camera.hpp"
 #include "colour.hpp"
-#include "block.hpp"
+#include "water_grid.hpp"
+#include "grid_pixels.hpp"
+#include "grid_renderer.hpp"
+#include "sim_thread.hpp"
+#include "profiler.hpp"
+#include "world_file.hpp"
+#include "world_saver.hpp"
 #include "material.hpp"
+#include "material_registry.hpp"
 #include "constants.hpp"
 
 /*
     ------------controls -------------
     - left click  = place ground block
-    - right click = place water block
+    - right click = pour water, or whatever 2 to 5 picked
     - space       = clear 
     - 0           = clear water only
+    - b           = settle closed basins straight away
     - 1           = print block info to console of red box selected block
+    - 2, 3, 4, 5  = right click pours water, sand, oil or lava
+    - s           = save the world to the world file
+    - mouse wheel = zoom in and out around the mouse
+    - middle drag = pan, as do the arrow keys
+    - home        = fit the whole world in the window
+
+    usage: AquaBlock [world file]
+    the world file defaults to aquablock.world and is loaded if it exists
  */
 
 
-int main() {
-    constexpr int num_cols  = 50;   
-    constexpr int num_rows  = 30;   
+int main(int argc, char ** argv) {
+    constexpr int default_cols = 50;
+    constexpr int default_rows = 30;
     constexpr int cell_size = 20;
-    constexpr int grid_size = num_cols * num_rows;
-    constexpr int window_width = num_cols * cell_size;
-    constexpr int window_height = num_rows * cell_size;
+    constexpr int max_window_width = 1280;
+    constexpr int max_window_height = 800;
+    constexpr double ticks_per_second = 60.0;
+
+    // how long a frame with nothing to draw waits for input instead of
+    // presenting, about what the vsync'd present would have blocked for.
+    // once the simulation is idle nothing changes without input, so it
+    // waits far longer - only the fps line and error checks need a turn
+    constexpr int unchanged_frame_ms = 16;
+    constexpr int idle_frame_ms = 500;
+
+    std::string const world_path = (argc > 1) ? argv[1] : "aquablock.world";
 
     auto clamp = [](auto const & val, auto const & min, auto const & max) {
         if (val > max) {
@@ -40,137 +68,222 @@ int main() {
         return val;
     }; 
     
+    AQUABLOCK_PROFILE_THREAD("ui");
+
     try {
+        // carry on from the world file if there is one. it is mapped, not
+        // read, and saves only write back what changed
+        std::unique_ptr<world_file> file;
+        if (std::ifstream(world_path)) {
+            file = std::make_unique<world_file>(world_path);
+            std::cout << "loaded " << world_path << std::endl;
+        }
+
+        water_grid grid = file ? water_grid(*file) : water_grid(default_cols, default_rows);
+        world_saver saver = file ? world_saver(*file) : world_saver(world_path);
+
+        int const num_cols = grid.width();
+        int const num_rows = grid.height();
+
+        // small worlds get cell_size pixels per cell, large ones start zoomed
+        // out to fit and are panned and zoomed with the camera
+        int const window_width = std::min(num_cols * cell_size, max_window_width);
+        int const window_height = std::min(num_rows * cell_size, max_window_height);
+
         sdl_module sdl("AquaBlock", window_width, window_height);
+        camera view(window_width, window_height, num_cols, num_rows);
         
-        std::array<block, grid_size> blocks{};
-        std::array<std::uint32_t, grid_size> pixels;
+        grid_pixels pixels(num_cols, num_rows);
+        grid_renderer renderer(sdl.m_renderer, window_width, window_height);
+
+        // from here on the grid belongs to the sim thread - the ui only
+        // sends it edits and draws the snapshots it publishes
+        sim_thread sim(grid, ticks_per_second, nullptr, &saver);
+        std::uint64_t painted_tick = ~std::uint64_t{0};
 
         int mouse_x = 0;
         int mouse_y = 0; 
         int mouse_grid_x = 1;
         int mouse_grid_y = 1;
+
+        // where the brush was last frame, so a fast drag paints a line
+        // instead of a trail of separate cells
+        int brush_x = 1;
+        int brush_y = 1;
+        bool brush_down = false;
+
+        // what right click pours
+        grid_edit::kind pour = grid_edit::kind::WATER;
         
         bool left_down = false;
         bool right_down = false; 
+        bool middle_down = false;
         bool running = true; 
-        
-        // set top row to ground blocks
-        for (auto x = 0; x < num_cols; x++) {
-            blocks[x].setGround();
-        }
 
-        // set bottom row to ground blocks 
-        for (auto x = grid_size - num_cols; x < grid_size; x++) {
-            blocks[x].setGround();
-        }
-        
-        // set the left column to ground blocks
-        for (int y = 0; y < num_rows; y++) {
-            blocks[y * num_cols].setGround();
-        }
-        
-        // set the right column to ground blocks 
-        for (int y = 0; y < num_rows; y++) {
-            blocks[(num_cols - 1) + y * num_cols].setGround();
-        }
+        // the cell under the mouse. the ground boarder around the window
+        // should not be selectable so clamp it
+        auto pick = [&] {
+            auto const last_grid_x = mouse_grid_x;
+            auto const last_grid_y = mouse_grid_y;
+
+            mouse_grid_x = clamp(static_cast<int>(std::floor(view.cell_x(static_cast<float>(mouse_x)))), 1, num_cols - 2);
+            mouse_grid_y = clamp(static_cast<int>(std::floor(view.cell_y(static_cast<float>(mouse_y)))), 1, num_rows - 2);
 
+            return mouse_grid_x != last_grid_x || mouse_grid_y != last_grid_y;
+        };
+
+        // the window only needs drawing again when the picture changed
+        bool redraw = true;
+        
         // fps counter display timer 
         using namespace std::chrono_literals;
         auto frames = 0;
         auto start = std::chrono::system_clock::now();
+        auto start_ticks = sim.tick_count();
+        auto reported_behind = std::chrono::milliseconds::zero();
 
         while(running) {
+            AQUABLOCK_PROFILE_SCOPE("frame");
+
             auto now = std::chrono::system_clock::now();
             auto passed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
             
             // code inside if statement is ran every 1 second        
             if (passed > 1s) {
-                std::cout << "FPS: " << frames << std::endl;
+                std::cout << "FPS: " << frames << "  TPS: " << sim.tick_count() - start_ticks
+                          << "  tick: " << std::chrono::duration_cast<std::chrono::microseconds>(sim.tick_cost()).count() << " us";
+
+                // the simulation could not keep up with the clock
+                auto const behind = std::chrono::duration_cast<std::chrono::milliseconds>(sim.behind());
+                if (behind > reported_behind) {
+                    std::cout << "  behind: " << behind.count() << " ms";
+                    reported_behind = behind;
+                }
+                std::cout << std::endl;
+
                 start = std::chrono::system_clock::now();
+                start_ticks = sim.tick_count();
                 frames = 0;
             }    
-            frames++;
+
+            sim.check();
+            saver.check();
+            auto const & snapshot = sim.latest();
             
-            // poll input      
-            while (SDL_PollEvent(&sdl.m_event)) {
-                switch (sdl.m_event.type) {
-                    
-                    case SDL_QUIT:
-                        running = false; 
-                        break;
+            // poll input
+            {
+                AQUABLOCK_PROFILE_SCOPE("frame.events");
+
+                while (SDL_PollEvent(&sdl.m_event)) {
+                    switch (sdl.m_event.type) {
                     
-                    case SDL_MOUSEMOTION:
-                    {
-                        // get the real mouse position and the mouse position within the grid
-                        mouse_x = sdl.m_event.motion.x;
-                        mouse_y = sdl.m_event.motion.y;
-                        mouse_grid_x = mouse_x / cell_size;
-                        mouse_grid_y = mouse_y / cell_size;
-                        
-                        // the ground boarder around the window should not be selectable so clamp it 
-                        mouse_grid_x = clamp(mouse_grid_x, 1, num_cols - 2);
-                        mouse_grid_y = clamp(mouse_grid_y, 1, num_rows - 2);
-                        break;
-                    }
+                        case SDL_QUIT:
+                            running = false; 
+                            break;
+
+                        case SDL_WINDOWEVENT:
+                            // shown, exposed or resized - what was presented may be gone
+                            redraw = true;
+                            break;
                     
-                    case SDL_MOUSEBUTTONDOWN:
-                        switch (sdl.m_event.button.button) {
-                            case SDL_BUTTON_LEFT: 
-                                left_down = true; 
-                                break;
-                            case SDL_BUTTON_RIGHT:
-                                right_down = true;
-                                break;
-                        }
-                        break;
-
-                    case SDL_MOUSEBUTTONUP:
-                        switch (sdl.m_event.button.button) {
-                            case SDL_BUTTON_LEFT:
-                                left_down = false;
-                                break;
-                            case SDL_BUTTON_RIGHT:
-                                right_down = false;
-                                break;
+                        case SDL_MOUSEMOTION:
+                        {
+                            // get the real mouse position and the mouse position within the grid
+                            mouse_x = sdl.m_event.motion.x;
+                            mouse_y = sdl.m_event.motion.y;
+
+                            if (middle_down) {
+                                view.pan(static_cast<float>(-sdl.m_event.motion.xrel), static_cast<float>(-sdl.m_event.motion.yrel));
+                            }
+
+                            // the selection box moved
+                            redraw |= pick();
+                            break;
                         }
-                        break;
 
-                    case SDL_KEYDOWN:
-                        switch(sdl.m_event.key.keysym.sym) {
+                        case SDL_MOUSEWHEEL:
+                            view.zoom_at(static_cast<float>(mouse_x), static_cast<float>(mouse_y), std::pow(1.25f, static_cast<float>(sdl.m_event.wheel.y)));
+                            pick();
+                            break;
+                    
+                        case SDL_MOUSEBUTTONDOWN:
+                            switch (sdl.m_event.button.button) {
+                                case SDL_BUTTON_LEFT: 
+                                    left_down = true; 
+                                    break;
+                                case SDL_BUTTON_RIGHT:
+                                    right_down = true;
+                                    break;
+                                case SDL_BUTTON_MIDDLE:
+                                    middle_down = true;
+                                    break;
+                            }
+                            break;
+
+                        case SDL_MOUSEBUTTONUP:
+                            switch (sdl.m_event.button.button) {
+                                case SDL_BUTTON_LEFT:
+                                    left_down = false;
+                                    break;
+                                case SDL_BUTTON_RIGHT:
+                                    right_down = false;
+                                    break;
+                                case SDL_BUTTON_MIDDLE:
+                                    middle_down = false;
+                                    break;
+                            }
+                            break;
+
+                        case SDL_KEYDOWN:
+                            switch(sdl.m_event.key.keysym.sym) {
                             
-                            case SDLK_SPACE:
-                                // set all blocks to air - ignore the ground block border
-                                for (auto x = 1; x < num_cols - 1; x++) {
-                                    for (auto y = 1; y < num_rows - 1; y++) {
-                                        blocks[x + y * num_cols].setAir();
-                                    }
-                                }
-                                break;
-
-                            case SDLK_0:
-                                // set all active water blocks to air
-                                for (auto x = 1; x < num_cols - 1; x++) {
-                                    for (auto y = 1; y < num_rows - 1; y++) {
-                                        auto& block = blocks[x + y * num_cols];
-
-                                        if (block.type == material::WATER) {
-                                            block.setAir();
-                                        }
-                                    }
-                                }
-                                break; 
-
-                            case SDLK_1:
-                            {
-                                // print out the data stored in the selected block
-                                auto const & block = blocks[mouse_grid_x + mouse_grid_y * num_cols];
-                                std::cout << "\n---------\n";
-                                std::cout << "material: " << (unsigned)block.type << "\nmass: " << +block.mass << "\nmass_next: " << +block.mass_next << "\n";
-                                break;
-                            } 
-                        }
-                        break; // SDL_KEYDOWN
+                                case SDLK_SPACE:
+                                    // set all blocks to air - ignore the ground block border
+                                    sim.push_edit({grid_edit::kind::CLEAR});
+                                    break;
+
+                                case SDLK_0:
+                                    // set all active water blocks to air
+                                    sim.push_edit({grid_edit::kind::CLEAR_WATER});
+                                    break; 
+
+                                case SDLK_b:
+                                    // level the water in closed basins instead of waiting
+                                    sim.push_edit({grid_edit::kind::SETTLE});
+                                    break;
+
+                                case SDLK_1:
+                                {
+                                    // print out the data stored in the selected block
+                                    std::cout << "\n---------\n";
+                                    std::cout << "material: " << properties_of(snapshot.material_at(mouse_grid_x, mouse_grid_y)).name << "\nmass: " << +snapshot.mass_at(mouse_grid_x, mouse_grid_y) << "\nmass_next: " << +snapshot.mass_next_at(mouse_grid_x, mouse_grid_y) << "\n";
+                                    break;
+                                } 
+
+                                case SDLK_2: pour = grid_edit::kind::WATER; std::cout << "pouring water" << std::endl; break;
+                                case SDLK_3: pour = grid_edit::kind::SAND;  std::cout << "pouring sand" << std::endl;  break;
+                                case SDLK_4: pour = grid_edit::kind::OIL;   std::cout << "pouring oil" << std::endl;   break;
+                                case SDLK_5: pour = grid_edit::kind::LAVA;  std::cout << "pouring lava" << std::endl;  break;
+
+                                case SDLK_s:
+                                    // written on the saver thread, the sim carries on
+                                    sim.request_save();
+                                    std::cout << "saving to " << saver.path() << std::endl;
+                                    break;
+
+                                // pan a tenth of the window at a time
+                                case SDLK_LEFT:  view.pan(-0.1f * window_width, 0.0f);  pick(); break;
+                                case SDLK_RIGHT: view.pan(0.1f * window_width, 0.0f);   pick(); break;
+                                case SDLK_UP:    view.pan(0.0f, -0.1f * window_height); pick(); break;
+                                case SDLK_DOWN:  view.pan(0.0f, 0.1f * window_height);  pick(); break;
+
+                                case SDLK_HOME:
+                                    view.fit();
+                                    pick();
+                                    break;
+                            }
+                            break; // SDL_KEYDOWN
+                    }
                 }
             }
            
@@ -178,181 +291,82 @@ int main() {
             // we cannot do this in the event poll loop as we want a continuos 
             // flow of water or ground blocks 
             {            
-                auto& current_block {blocks[mouse_grid_x + mouse_grid_y * num_cols]};
+                if (!brush_down) {
+                    brush_x = mouse_grid_x;
+                    brush_y = mouse_grid_y;
+                }
 
                 if (left_down) {
-                    switch (current_block.type) {
-                        case material::WATER: 
-                            [[fallthrough]]; 
-                        case material::AIR: 
-                            current_block.setGround();
-                            break;
-                    }
+                    sim.push_edit(grid_edit::line(grid_edit::kind::GROUND, brush_x, brush_y, mouse_grid_x, mouse_grid_y, 0));
                 } 
 
                 if (right_down) {
-                    current_block.type = material::WATER;
-                    current_block.mass = constants::max_mass; 
-                    current_block.mass_next = constants::max_mass;
+                    sim.push_edit(grid_edit::line(pour, brush_x, brush_y, mouse_grid_x, mouse_grid_y, 0, constants::max_mass));
                 }
+
+                brush_x = mouse_grid_x;
+                brush_y = mouse_grid_y;
+                brush_down = left_down || right_down;
             }
             
-            // update
+            // render - the sim thread does the updates. only the chunks that
+            // changed are repainted, only what is in view is uploaded, and
+            // nothing is drawn at all while the picture stays the same
             {
-               
-                for (int y = 0; y < num_rows; y++) {
-                   for (int x = 0; x < num_cols; x++) {
-                       
-                        auto& current_block = blocks[x + y * num_cols];
-
-                        auto remaining = current_block.mass;
-
-                        if (remaining < constants::min_mass) continue;
-                        if (current_block.type != material::WATER) continue;         
-                        
-                        
-                        // downwards flow
-                        auto& down_block = blocks[x + (y + 1) * num_cols];
-                        
-                        if (down_block.type != material::GROUND) {
-                            auto room = constants::max_mass - down_block.mass;
-                            auto flow = std::min(room, remaining);
-                            
-                            // if flow is negative constrain to 0
-                            flow = std::max(flow, 0.0f);
-
-                            if (flow > std::min(constants::max_mass, current_block.mass))
-        						flow = std::min(constants::max_mass, current_block.mass);
-
-                            current_block.mass_next -= flow;
-                            down_block.mass_next += flow ;
-                            remaining -= flow;
-                        }   
-
-
-                        // if no water left to work with, skip to next loop
-                        if (remaining < constants::min_mass) continue; 
-                        
-
-                        // left flow
-                        auto left_index = (x - 1) + y * num_cols;
-                        
-                        if (blocks[left_index].type != material::GROUND) {
-                            
-                            auto room = constants::max_mass - blocks[left_index].mass;
-                            auto flow = std::min(room, remaining) / 3.0f;
-                            
-                            flow = std::max(flow, 0.0f);
-
-                            if (flow > std::min(constants::max_mass, current_block.mass))
-        						flow = std::min(constants::max_mass, current_block.mass);
-
-                            current_block.mass_next -= flow;
-                            blocks[left_index].mass_next += flow;
-                            remaining -= flow;
-                        }
-                        
-                        
-                        // if no water left to work with, skip to next loop
-                        if (remaining < constants::min_mass) continue; 
-
-                        
-                        // right flow
-                        auto right_index = (x + 1) + y * num_cols;
-                      
-                        if (blocks[right_index].type != material::GROUND) {
-                            auto room = constants::max_mass - blocks[right_index].mass;
-                            auto flow = std::min(room, remaining) / 2.0f;
-                            
-                            flow = std::max(flow, 0.0f);
-
-                            if (flow > std::min(constants::max_mass, current_block.mass))
-        						flow = std::min(constants::max_mass, current_block.mass);
-
-
-                            current_block.mass_next -= flow;
-                            blocks[right_index].mass_next += flow;
-                            remaining -= flow;
-                        }
-                   }
+                if (snapshot.tick != painted_tick) {
+                    AQUABLOCK_PROFILE_SCOPE("frame.paint");
+                    pixels.paint(snapshot);
+                    painted_tick = snapshot.tick;
                 }
 
-                for (block & b : blocks) {
-                    if (b.type == material::GROUND) continue;
-                    b.mass = b.mass_next;
-
-                    if (b.mass < constants::min_mass) {
-                        b.setAir();
-                    } else {
-                        b.type = material::WATER;
-                        
-                        // clamp the mass 
-                        if (b.mass > constants::max_mass) {
-                            b.mass = constants::max_mass;
-                        }
-                    }
+                redraw |= renderer.update(pixels, view);
+
+                // input ends the wait straight away and is left queued
+                // for the poll at the top of the loop. a held brush keeps
+                // painting, so it never waits long
+                if (!redraw) {
+                    auto const idle = sim.is_idle() && !brush_down;
+                    SDL_WaitEventTimeout(nullptr, idle ? idle_frame_ms : unchanged_frame_ms);
+                    continue;
                 }
-            }
 
-            // render 
-            {
-                SDL_SetRenderDrawColor(sdl.m_renderer,constants::air.r, constants::air.g, constants::air.b, 255); 
+                AQUABLOCK_PROFILE_SCOPE("frame.draw");
                 sdl.clear_back_buffer();
+                renderer.draw();
 
-                for (auto y = 0; y < num_rows; y++) {
-                    for (auto x = 0; x < num_cols; x++) {
-                        
-                        auto const & block_to_render {blocks[x + y * num_cols]};
-                        
-                        SDL_Rect r;
-                        r.x =   x * cell_size;
-                        r.y =  (y * cell_size) + cell_size; 
-                        r.w =  cell_size;
-                        r.h = -cell_size;
-
-                       
-                        switch (block_to_render.type) {
-
-                            case material::AIR:
-                                break;
-
-                            case material::GROUND:
-                                SDL_SetRenderDrawColor(sdl.m_renderer, 24, 44, 76,255);
-                                SDL_RenderFillRect(sdl.m_renderer, &r); 
-                                break;
-
-                            case material::WATER:
-                            {
-                                auto above_mass {blocks[x + (y - 1) * num_cols].mass};
-
-                                colour mass_colour(lerp_colour(constants::min_mass_colour, constants::max_mass_colour, block_to_render.mass / constants::max_mass));
-
-                                if (!(above_mass != 0 && block_to_render.mass != 0)) { // if the block is falling
-                                    r.h = -cell_size * (block_to_render.mass / constants::max_mass); // scale the box depending on the amount of water in the cell
-                                }
-                                
-                                SDL_SetRenderDrawColor(sdl.m_renderer, mass_colour.r, mass_colour.g, mass_colour.b, 255);
-                                SDL_RenderFillRect(sdl.m_renderer, &r); 
-                                break;
-                            }
-                        } 
-                    }
-                }   
+                // draw mouse position, at least a pixel even when zoomed out
+                auto const box_x = static_cast<int>(std::lround(view.screen_x(static_cast<float>(mouse_grid_x))));
+                auto const box_y = static_cast<int>(std::lround(view.screen_y(static_cast<float>(mouse_grid_y))));
 
-                // draw mouse position 
                 SDL_Rect mouse_position;
-                mouse_position.x = mouse_grid_x * cell_size;
-                mouse_position.y = mouse_grid_y * cell_size;
-                mouse_position.w = cell_size;
-                mouse_position.h = cell_size;
+                mouse_position.x = box_x;
+                mouse_position.y = box_y;
+                mouse_position.w = std::max(static_cast<int>(std::lround(view.screen_x(static_cast<float>(mouse_grid_x + 1)))) - box_x, 1);
+                mouse_position.h = std::max(static_cast<int>(std::lround(view.screen_y(static_cast<float>(mouse_grid_y + 1)))) - box_y, 1);
 
                 SDL_SetRenderDrawColor(sdl.m_renderer, constants::selection.r, constants::selection.g, constants::selection.b, 255);
                 SDL_RenderDrawRect(sdl.m_renderer, &mouse_position);
 
+                AQUABLOCK_PROFILE_SCOPE("frame.present");
                 sdl.back_to_front();
+
+                redraw = false;
+                frames++;
             }
 
         } 
+
+#ifdef AQUABLOCK_PROFILE
+        // stop the other threads first so their last events are in
+        sim.stop();
+        saver.flush();
+
+        std::ofstream trace("aquablock_trace.json");
+        profiler::write_chrome_trace(trace);
+        std::ofstream csv("aquablock_profile.csv");
+        profiler::write_csv(csv);
+        std::cout << "wrote aquablock_trace.json and aquablock_profile.csv" << std::endl;
+#endif
     } catch (sdl_module_exception const &e) {
         std::cerr << e.what() << std::endl;
 
@@ -0,0 +1,132 @@
+#include "mapped_file.hpp"
+
+// std
+#include <stdexcept>
+
+// dependancies
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//------------------------------------------------------------
+//                       mapped_file                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+#ifdef _WIN32
+
+mapped_file::mapped_file(std::string const & path) noexcept(false)
+:   m_path{path}
+,   m_data{nullptr}
+,   m_size{0}
+,   m_file{INVALID_HANDLE_VALUE}
+,   m_mapping{nullptr} {
+
+    // others may keep writing the file - a world_saver does exactly that
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("could not open " + path);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        CloseHandle(m_file);
+        throw std::runtime_error("could not map empty or unreadable file " + path);
+    }
+    m_size = static_cast<std::size_t>(size.QuadPart);
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (m_mapping == nullptr) {
+        CloseHandle(m_file);
+        throw std::runtime_error("could not map " + path);
+    }
+
+    m_data = static_cast<unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (m_data == nullptr) {
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw std::runtime_error("could not map " + path);
+    }
+}
+
+//------------------------------------------------------------
+mapped_file::~mapped_file() {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+}
+
+#else
+
+mapped_file::mapped_file(std::string const & path) noexcept(false)
+:   m_path{path}
+,   m_data{nullptr}
+,   m_size{0}
+,   m_file{-1} {
+
+    m_file = ::open(path.c_str(), O_RDONLY);
+    if (m_file < 0) {
+        throw std::runtime_error("could not open " + path);
+    }
+
+    struct stat info;
+    if (::fstat(m_file, &info) != 0 || info.st_size == 0) {
+        ::close(m_file);
+        throw std::runtime_error("could not map empty or unreadable file " + path);
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+
+    // private and writable on a read only descriptor - writes stay in memory
+    auto * data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED) {
+        ::close(m_file);
+        throw std::runtime_error("could not map " + path);
+    }
+    m_data = static_cast<unsigned char *>(data);
+}
+
+//------------------------------------------------------------
+mapped_file::~mapped_file() {
+    ::munmap(m_data, m_size);
+    ::close(m_file);
+}
+
+#endif
+
+//                       functions                         //
+//------------------------------------------------------------
+unsigned char *
+mapped_file::data() {
+    return m_data;
+}
+
+//------------------------------------------------------------
+unsigned char const *
+mapped_file::data() const {
+    return m_data;
+}
+
+//------------------------------------------------------------
+std::size_t
+mapped_file::size() const {
+    return m_size;
+}
+
+//------------------------------------------------------------
+std::string const &
+mapped_file::path() const {
+    return m_path;
+}
@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+// std
+#include <cstddef>
+#include <string>
+
+//------------------------------------------------------------
+//                       mapped_file                        //
+//------------------------------------------------------------
+
+// a whole file mapped copy on write. pages are only read from disk when
+// they are first touched and writes go to private copies of them, so the
+// file itself never changes through the mapping and mapping even a huge
+// file is instant.
+class mapped_file final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    explicit mapped_file(std::string const & path) noexcept(false);
+    ~mapped_file();
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator=(mapped_file const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    unsigned char * data();
+    unsigned char const * data() const;
+    std::size_t size() const;
+
+    std::string const & path() const;
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::string m_path;
+    unsigned char * m_data;
+    std::size_t m_size;
+
+#ifdef _WIN32
+    void * m_file;
+    void * m_mapping;
+#else
+    int m_file;
+#endif
+
+}; // mapped_file
+
+#endif // MAPPED_FILE_HPP
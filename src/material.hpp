@@ -1,10 +1,21 @@
 #ifndef MATERIAL_HPP
 #define MATERIAL_HPP
 
+// std
+#include <cstddef>
+#include <cstdint>
+
+// what a cell is made of. everything else known about a material lives in
+// material_registry.hpp, one specialisation per value here
 enum class material : std::uint8_t {
    AIR    = 0,
    GROUND = 1,
-   WATER  = 2, 
+   WATER  = 2,
+   SAND   = 3,
+   OIL    = 4,
+   LAVA   = 5,
 };
 
+constexpr std::size_t material_count = 6;
+
 #endif // MATERIAL_HPP
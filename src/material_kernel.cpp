@@ -0,0 +1,360 @@
+#include "material_kernel.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <utility>
+
+// my
+#include "constants.hpp"
+#include "material_registry.hpp"
+
+namespace {
+
+constexpr std::size_t block_size = 256;
+
+using lane = std::int16_t;
+
+// the flows out of a run of cells of one material, written from slot 0 of
+// down, left and right on. slots a run does not flow from stay 0
+using float_flows_fn = void (*)(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, float * down, float * left, float * right);
+using fixed_flows_fn = void (*)(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, lane * down, lane * left, lane * right);
+
+//------------------------------------------------------------
+// whether type can flow from source into target. air is only open if no
+// other kind that could flow into it this tick is at least as dense. the
+// one above can always fall into it, one beside it only if it runs
+// sideways and has the mass to. min_mass is water's, every liquid's rules
+// keep it
+template <material type, typename value>
+bool
+accepts(material const * types, value const * mass, value min_mass, std::size_t source, std::size_t target, std::size_t width) {
+    auto const there = types[target];
+    if (there == type) return true;
+    if (there != material::AIR) return false;
+
+    auto const rival = [&](std::size_t other, bool beside) {
+        auto const kind = types[other];
+        if (other == source || kind == type) return false;
+
+        auto const & properties = properties_of(kind);
+        if (properties.density < material_traits<type>::density) return false;
+        return !beside || (properties.spreads && mass[other] >= min_mass);
+    };
+
+    return !rival(target - width, false) && !rival(target - 1, true) && !rival(target + 1, true);
+}
+
+//------------------------------------------------------------
+// who an empty cell that ends up with mass got it from - with the rivals
+// held back there is only one kind it can be
+material
+arrival(material const * types, std::size_t i, std::size_t width, bool from_above, bool from_left, bool from_right) {
+    if (from_above) return types[i - width];
+    if (from_left) return types[i - 1];
+    if (from_right) return types[i + 1];
+
+    // air never holds mass of its own, and the flow kernels make it water
+    return material::WATER;
+}
+
+//------------------------------------------------------------
+// min(room, remaining), no lower than 0, divided, no more than mass, as
+// fixed_flow_kernel::limit
+lane
+limit(lane room, lane remaining, lane cap, lane divisor) {
+    lane flow = (remaining < room) ? remaining : room;
+    flow = (flow > 0) ? flow : 0;
+    flow = static_cast<lane>(flow / divisor);
+    return (flow < cap) ? flow : cap;
+}
+
+//------------------------------------------------------------
+// the flows of one material with its rules folded in, the same operations
+// in the same order as scalar_cell_flows and fixed_flow_kernel::row_flows
+template <material type>
+struct material_flows {
+    using rules = typename material_traits<type>::rules;
+
+    static void floats(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, float * down, float * left, float * right) {
+        auto const width = planes.width;
+        material const * types = planes.types;
+        float const * mass = planes.mass;
+        constexpr float spread_min = water_flow_rules::min_mass;
+
+        for (auto x = begin; x < end; x++) {
+            auto const i = x + y * width;
+            auto const slot = x - begin;
+
+            auto remaining = mass[i];
+            auto const cap = std::min(rules::max_mass, mass[i]);
+
+            if (remaining < rules::min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i + width, width)) {
+                auto flow = std::max(std::min(rules::max_mass - mass[i + width], remaining), 0.0f);
+                down[slot] = (flow > cap) ? cap : flow;
+                remaining -= down[slot];
+            }
+
+            if (!rules::spreads || remaining < rules::min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i - 1, width)) {
+                auto flow = std::max(std::min(rules::max_mass - mass[i - 1], remaining) / rules::left_divisor, 0.0f);
+                left[slot] = (flow > cap) ? cap : flow;
+                remaining -= left[slot];
+            }
+
+            if (remaining < rules::min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i + 1, width)) {
+                auto flow = std::max(std::min(rules::max_mass - mass[i + 1], remaining) / rules::right_divisor, 0.0f);
+                right[slot] = (flow > cap) ? cap : flow;
+            }
+        }
+    }
+
+    static void fixed(grid_planes const & planes, std::size_t y, std::size_t begin, std::size_t end, lane * down, lane * left, lane * right) {
+        auto const width = planes.width;
+        material const * types = planes.types;
+        std::uint16_t const * mass = planes.mass_fixed;
+        constexpr auto spread_min = static_cast<std::uint16_t>(water_flow_rules::fixed_min_mass);
+
+        auto room = [](std::uint16_t m) { return static_cast<lane>(rules::fixed_max_mass - m); };
+
+        for (auto x = begin; x < end; x++) {
+            auto const i = x + y * width;
+            auto const slot = x - begin;
+
+            auto const m = static_cast<lane>(mass[i]);
+            auto remaining = m;
+
+            if (remaining < rules::fixed_min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i + width, width)) {
+                down[slot] = limit(room(mass[i + width]), remaining, m, 1);
+                remaining = static_cast<lane>(remaining - down[slot]);
+            }
+
+            if (!rules::spreads || remaining < rules::fixed_min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i - 1, width)) {
+                left[slot] = limit(room(mass[i - 1]), remaining, m, rules::fixed_left_divisor);
+                remaining = static_cast<lane>(remaining - left[slot]);
+            }
+
+            if (remaining < rules::fixed_min_mass) continue;
+
+            if (accepts<type>(types, mass, spread_min, i, i + 1, width)) {
+                right[slot] = limit(room(mass[i + 1]), remaining, m, rules::fixed_right_divisor);
+            }
+        }
+    }
+};
+
+//------------------------------------------------------------
+// nothing for the materials that do not move, their slots stay 0
+template <material type>
+constexpr float_flows_fn
+float_flows_of() {
+    if constexpr (material_traits<type>::moves) return &material_flows<type>::floats;
+    else return nullptr;
+}
+
+//------------------------------------------------------------
+template <material type>
+constexpr fixed_flows_fn
+fixed_flows_of() {
+    if constexpr (material_traits<type>::moves) return &material_flows<type>::fixed;
+    else return nullptr;
+}
+
+//------------------------------------------------------------
+template <std::size_t... types>
+constexpr std::array<float_flows_fn, sizeof...(types)>
+make_float_flows(std::index_sequence<types...>) {
+    return {{float_flows_of<static_cast<material>(types)>()...}};
+}
+
+//------------------------------------------------------------
+template <std::size_t... types>
+constexpr std::array<fixed_flows_fn, sizeof...(types)>
+make_fixed_flows(std::index_sequence<types...>) {
+    return {{fixed_flows_of<static_cast<material>(types)>()...}};
+}
+
+constexpr auto float_flows = make_float_flows(std::make_index_sequence<material_count>{});
+constexpr auto fixed_flows = make_fixed_flows(std::make_index_sequence<material_count>{});
+
+//------------------------------------------------------------
+// the flows of the cells [first, last) of row y, a run of one material at
+// a time. slot 0 is the cell at slot_base
+template <typename value, std::size_t count>
+void
+dispatch_runs(std::array<void (*)(grid_planes const &, std::size_t, std::size_t, std::size_t, value *, value *, value *), count> const & table, grid_planes const & planes, std::size_t y, std::size_t first, std::size_t last, std::size_t slot_base, value * down, value * left, value * right) {
+    material const * row = planes.types + y * planes.width;
+
+    for (auto x = first; x < last;) {
+        auto const type = row[x];
+        auto end = x + 1;
+        while (end < last && row[end] == type) end++;
+
+        if (auto const flows = table[static_cast<std::size_t>(type)]) {
+            auto const slot = x - slot_base;
+            flows(planes, y, x, end, down + slot, left + slot, right + slot);
+        }
+
+        x = end;
+    }
+}
+
+//------------------------------------------------------------
+// anything that neither moves nor is air keeps what it has
+bool
+is_fixed_in_place(material type) {
+    return type != material::AIR && !properties_of(type).moves;
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                     material kernels                     //
+//------------------------------------------------------------
+sweep_result
+material_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, float * carry, sweep_writes writes, bool & mixed) {
+    // slot 0 is the cell before the block, slot count + 1 the one after
+    float down[block_size + 2];
+    float left[block_size + 2];
+    float right[block_size + 2];
+
+    auto const width = from.width;
+    sweep_result result {false, false};
+
+    for (auto begin = x_begin; begin < x_end; begin += block_size) {
+        auto const end = std::min(begin + block_size, x_end);
+        auto const count = end - begin;
+        float * block_carry = carry + (begin - x_begin);
+
+        // the border is ground and flows nothing
+        auto const first = (begin > 1) ? begin - 1 : begin;
+        auto const last = (end < width - 1) ? end + 1 : end;
+
+        std::fill(down, down + count + 2, 0.0f);
+        std::fill(left, left + count + 2, 0.0f);
+        std::fill(right, right + count + 2, 0.0f);
+
+        dispatch_runs(float_flows, from, y, first, last, begin - 1, down, left, right);
+
+        if (writes == sweep_writes::CARRY) {
+            for (std::size_t slot = 1; slot <= count; slot++) {
+                block_carry[slot - 1] = down[slot];
+                result.moved |= down[slot] != 0.0f;
+            }
+            continue;
+        }
+
+        for (auto x = begin; x < end; x++) {
+            auto const i = x + y * width;
+            auto const slot = x + 1 - begin;
+            auto const above = block_carry[slot - 1];
+
+            auto const next = (((((from.mass_next[i] + above) + right[slot - 1]) - down[slot]) - left[slot]) - right[slot]) + left[slot + 1];
+
+            block_carry[slot - 1] = down[slot];
+            result.moved |= right[slot - 1] != 0.0f || down[slot] != 0.0f || left[slot] != 0.0f || right[slot] != 0.0f || left[slot + 1] != 0.0f;
+
+            auto const type = from.types[i];
+
+            if (is_fixed_in_place(type)) {
+                to.types[i] = type;
+                to.mass[i] = from.mass[i];
+                to.mass_next[i] = next;
+            } else if (next < constants::min_mass) {
+                to.types[i] = material::AIR;
+                to.mass[i] = 0.0f;
+                to.mass_next[i] = 0.0f;
+            } else {
+                auto const kept = (type != material::AIR) ? type : arrival(from.types, i, width, above != 0.0f, right[slot - 1] != 0.0f, left[slot + 1] != 0.0f);
+
+                to.types[i] = kept;
+                to.mass[i] = std::min(next, constants::max_mass);
+                to.mass_next[i] = next;
+                result.water = true;
+                mixed |= needs_material_kernels(kept);
+            }
+        }
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------
+sweep_result
+fixed_material_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, std::int16_t * carry, sweep_writes writes, bool & mixed) {
+    lane down[block_size + 2];
+    lane left[block_size + 2];
+    lane right[block_size + 2];
+
+    auto const width = from.width;
+    sweep_result result {false, false};
+
+    for (auto begin = x_begin; begin < x_end; begin += block_size) {
+        auto const end = std::min(begin + block_size, x_end);
+        auto const count = end - begin;
+        lane * block_carry = carry + (begin - x_begin);
+
+        auto const first = (begin > 1) ? begin - 1 : begin;
+        auto const last = (end < width - 1) ? end + 1 : end;
+
+        std::fill(down, down + count + 2, lane{0});
+        std::fill(left, left + count + 2, lane{0});
+        std::fill(right, right + count + 2, lane{0});
+
+        dispatch_runs(fixed_flows, from, y, first, last, begin - 1, down, left, right);
+
+        if (writes == sweep_writes::CARRY) {
+            for (std::size_t slot = 1; slot <= count; slot++) {
+                block_carry[slot - 1] = down[slot];
+                result.moved |= down[slot] != 0;
+            }
+            continue;
+        }
+
+        for (auto x = begin; x < end; x++) {
+            auto const i = x + y * width;
+            auto const slot = x + 1 - begin;
+            auto const above = block_carry[slot - 1];
+            auto const from_left = right[slot - 1];
+            auto const from_right = left[slot + 1];
+            auto const out = static_cast<lane>(down[slot] + left[slot] + right[slot]);
+
+            // wrapping 16 bit sums, exact as in fixed_flow_kernel
+            auto const next = static_cast<std::uint16_t>(from.mass_next_fixed[i] + above + from_left + from_right - out);
+
+            block_carry[slot - 1] = down[slot];
+            result.moved |= (from_left | from_right | out) != 0;
+
+            auto const type = from.types[i];
+
+            if (is_fixed_in_place(type)) {
+                to.types[i] = type;
+                to.mass_fixed[i] = from.mass_fixed[i];
+                to.mass_next_fixed[i] = next;
+            } else if (next < constants::fixed_min_mass) {
+                to.types[i] = material::AIR;
+                to.mass_fixed[i] = 0;
+                to.mass_next_fixed[i] = 0;
+            } else {
+                auto const kept = (type != material::AIR) ? type : arrival(from.types, i, width, above != 0, from_left != 0, from_right != 0);
+
+                to.types[i] = kept;
+                to.mass_fixed[i] = std::min(next, static_cast<std::uint16_t>(constants::fixed_max_mass));
+                to.mass_next_fixed[i] = next;
+                result.water = true;
+                mixed |= needs_material_kernels(kept);
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,39 @@
+#ifndef MATERIAL_KERNEL_HPP
+#define MATERIAL_KERNEL_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// my
+#include "flow_kernel.hpp"
+
+//------------------------------------------------------------
+//                     material kernels                     //
+//------------------------------------------------------------
+
+// the sweep for rows with more than air, ground and water in or next to
+// them. it does what flow_kernel::sweep_row does (see sweep_row_fn), but
+// each row is cut into runs of one material and every run goes to the
+// flows of that material, a template instantiated from its rules in
+// material_registry.hpp. the loop over the cells of a run never asks what
+// they are made of, so a scene mixing materials pays one table lookup per
+// run rather than a switch per cell. the sum and commit are the same for
+// every material, air taking on whichever one flowed into it.
+//
+// a liquid only flows into air and its own kind, and air that two kinds
+// could both reach goes to the densest of them, see material_traits. with
+// only air, ground and water about that is exactly the flow_kernel's rules,
+// and the result is bit for bit the same, so a grid can pick either for any
+// span. reaching for the rivals of an empty cell means the cells either
+// side of a span now look three cells out instead of two.
+//
+// plain c++, no vector paths - only the chunks near something other than
+// water come here, and water on its own never does.
+//
+// mixed is set if a cell of the span is left as a material that
+// needs_material_kernels(), and left alone otherwise
+sweep_result material_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, float * carry, sweep_writes writes, bool & mixed);
+sweep_result fixed_material_sweep_row(grid_planes const & from, grid_planes const & to, std::size_t y, std::size_t x_begin, std::size_t x_end, std::int16_t * carry, sweep_writes writes, bool & mixed);
+
+#endif // MATERIAL_KERNEL_HPP
@@ -0,0 +1,143 @@
+#ifndef MATERIAL_REGISTRY_HPP
+#define MATERIAL_REGISTRY_HPP
+
+// std
+#include <array>
+#include <cstddef>
+#include <utility>
+
+// my
+#include "colour.hpp"
+#include "constants.hpp"
+#include "flow_rules.hpp"
+#include "material.hpp"
+
+//------------------------------------------------------------
+//                    material_registry                     //
+//------------------------------------------------------------
+
+// one specialisation of material_traits per material. a material that
+// moves names its flow rules, and the material kernels are instantiated
+// from them (see material_kernel.hpp), so a new liquid is a value in the
+// enum, a rules struct and a specialisation here - no switch anywhere has
+// to learn about it.
+//
+// density only matters where two materials meet: a liquid never flows into
+// a cell holding another one, and an empty cell that two different ones
+// could both flow into in the same tick goes to the denser, the other
+// holding back. equal densities both hold back.
+//
+// that is all density does - stacked liquids never trade places. sand that
+// lands on water rests on top of it and oil poured under water stays
+// there. a denser cell sinking through a lighter one could chain down a
+// whole column in one tick, and everything from waking chunks to the
+// subdomain halos relies on a cell reaching no further than one row and
+// three columns. sinking would need a pass of its own that pairs rows by
+// the parity of the tick.
+template <material type>
+struct material_traits;
+
+template <>
+struct material_traits<material::AIR> {
+    static constexpr char const * name = "air";
+    static constexpr bool moves = false;
+    static constexpr float density = 0.0f;
+    static constexpr colour shade = constants::air;
+};
+
+template <>
+struct material_traits<material::GROUND> {
+    static constexpr char const * name = "ground";
+    static constexpr bool moves = false;
+    static constexpr float density = 0.0f;
+    static constexpr colour shade = constants::ground;
+};
+
+template <>
+struct material_traits<material::WATER> {
+    using rules = water_flow_rules;
+    static constexpr char const * name = "water";
+    static constexpr bool moves = true;
+    static constexpr float density = 1.0f;
+    static constexpr colour shade = constants::max_mass_colour;
+};
+
+template <>
+struct material_traits<material::SAND> {
+    using rules = sand_flow_rules;
+    static constexpr char const * name = "sand";
+    static constexpr bool moves = true;
+    static constexpr float density = 1.6f;
+    static constexpr colour shade = constants::sand;
+};
+
+template <>
+struct material_traits<material::OIL> {
+    using rules = water_flow_rules;
+    static constexpr char const * name = "oil";
+    static constexpr bool moves = true;
+    static constexpr float density = 0.8f;
+    static constexpr colour shade = constants::oil;
+};
+
+template <>
+struct material_traits<material::LAVA> {
+    using rules = lava_flow_rules;
+    static constexpr char const * name = "lava";
+    static constexpr bool moves = true;
+    static constexpr float density = 3.1f;
+    static constexpr colour shade = constants::lava;
+};
+
+//------------------------------------------------------------
+// whether a material runs sideways, never for one that does not move
+template <material type>
+constexpr bool
+runs_sideways() {
+    if constexpr (material_traits<type>::moves) return material_traits<type>::rules::spreads;
+    else return false;
+}
+
+// the traits as a table, for code that only has the material at run time
+struct material_properties {
+    char const * name;
+    bool moves;
+    bool spreads;
+    float density;
+    colour shade;
+};
+
+template <std::size_t... types>
+constexpr std::array<material_properties, sizeof...(types)>
+make_material_table(std::index_sequence<types...>) {
+    return {{material_properties{
+        material_traits<static_cast<material>(types)>::name,
+        material_traits<static_cast<material>(types)>::moves,
+        runs_sideways<static_cast<material>(types)>(),
+        material_traits<static_cast<material>(types)>::density,
+        material_traits<static_cast<material>(types)>::shade}...}};
+}
+
+inline constexpr auto material_table = make_material_table(std::make_index_sequence<material_count>{});
+
+// what a byte that is no material reads as - a mapped world file is only
+// checked a chunk at a time as the grid reaches it, see water_grid, and
+// anything that looks at cells before that must not read past the table
+inline constexpr material_properties unknown_material {"unknown", false, false, 0.0f, constants::ground};
+
+//------------------------------------------------------------
+constexpr material_properties const &
+properties_of(material type) {
+    auto const i = static_cast<std::size_t>(type);
+    return (i < material_count) ? material_table[i] : unknown_material;
+}
+
+//------------------------------------------------------------
+// air, ground and water are all the vectorised flow kernels know about -
+// anything after them in the enum needs the material kernels instead
+constexpr bool
+needs_material_kernels(material type) {
+    return type > material::WATER;
+}
+
+#endif // MATERIAL_REGISTRY_HPP
@@ -0,0 +1,143 @@
+#include "page_buffer.hpp"
+
+// std
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// dependancies
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+namespace {
+
+// off unless asked for. on the machines measured so far the sweep keeps
+// too few rows in flight for the tlb to matter and it came out even
+bool
+huge_pages_requested() {
+    static bool const requested = [] {
+        auto const * value = std::getenv("AQUABLOCK_HUGE_PAGES");
+        return value != nullptr && std::strcmp(value, "1") == 0;
+    }();
+    return requested;
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                       page_buffer                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+#ifdef _WIN32
+
+// large pages on windows need a privilege most accounts do not have, so
+// it is plain committed pages there
+page_buffer::page_buffer(std::size_t bytes) noexcept(false)
+:   m_data{nullptr}
+,   m_size{bytes}
+,   m_mapping{nullptr}
+,   m_mapped{bytes > 0 ? bytes : 1}
+,   m_huge{false} {
+
+    m_mapping = VirtualAlloc(nullptr, m_mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (m_mapping == nullptr) {
+        throw std::runtime_error("could not allocate " + std::to_string(bytes) + " bytes of pages");
+    }
+    m_data = static_cast<unsigned char *>(m_mapping);
+}
+
+//------------------------------------------------------------
+page_buffer::~page_buffer() {
+    VirtualFree(m_mapping, 0, MEM_RELEASE);
+}
+
+#else
+
+page_buffer::page_buffer(std::size_t bytes) noexcept(false)
+:   m_data{nullptr}
+,   m_size{bytes}
+,   m_mapping{nullptr}
+,   m_mapped{bytes > 0 ? bytes : 1}
+,   m_huge{bytes >= huge_page_size && huge_pages_requested()} {
+
+    // a huge page has to start on a 2MB boundary, which mmap does not
+    // promise, so map a huge page more than needed and trim it to one.
+    // whole huge pages are kept so the end is on a boundary as well
+    if (m_huge) {
+        m_mapped = (m_mapped + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+    auto const want = m_huge ? m_mapped + huge_page_size : m_mapped;
+
+    auto * mapping = ::mmap(nullptr, want, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("could not allocate " + std::to_string(bytes) + " bytes of pages");
+    }
+
+    if (!m_huge) {
+        m_mapping = mapping;
+        m_data = static_cast<unsigned char *>(mapping);
+        return;
+    }
+
+    auto const start = reinterpret_cast<std::uintptr_t>(mapping);
+    auto const aligned = (start + huge_page_size - 1) & ~(std::uintptr_t{huge_page_size} - 1);
+    auto const head = aligned - start;
+    auto const tail = want - head - m_mapped;
+
+    if (head > 0) ::munmap(mapping, head);
+    if (tail > 0) ::munmap(reinterpret_cast<void *>(aligned + m_mapped), tail);
+
+    m_mapping = reinterpret_cast<void *>(aligned);
+    m_data = static_cast<unsigned char *>(m_mapping);
+
+#ifdef MADV_HUGEPAGE
+    // only advice - without transparent huge pages this does nothing
+    ::madvise(m_mapping, m_mapped, MADV_HUGEPAGE);
+#endif
+}
+
+//------------------------------------------------------------
+page_buffer::~page_buffer() {
+    ::munmap(m_mapping, m_mapped);
+}
+
+#endif
+
+//                       functions                         //
+//------------------------------------------------------------
+unsigned char *
+page_buffer::data() {
+    return m_data;
+}
+
+//------------------------------------------------------------
+unsigned char const *
+page_buffer::data() const {
+    return m_data;
+}
+
+//------------------------------------------------------------
+std::size_t
+page_buffer::size() const {
+    return m_size;
+}
+
+//------------------------------------------------------------
+bool
+page_buffer::wants_huge_pages() const {
+    return m_huge;
+}
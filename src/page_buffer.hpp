@@ -0,0 +1,55 @@
+#ifndef PAGE_BUFFER_HPP
+#define PAGE_BUFFER_HPP
+
+// std
+#include <cstddef>
+
+//------------------------------------------------------------
+//                       page_buffer                        //
+//------------------------------------------------------------
+
+// zeroed memory straight from the os rather than the heap, for the cell
+// planes. a plane of a big grid is walked a row at a time but reads the
+// rows above and below as well, each a whole row stride away, so with 4k
+// pages nearly every vertical neighbour is on a page of its own and the
+// tlb misses add up.
+//
+// with the AQUABLOCK_HUGE_PAGES environment variable set to 1, buffers of
+// huge_page_size or more are aligned to it and, on linux, advised as
+// transparent huge pages, so one tlb entry covers 2MB of cells. when the
+// kernel has none to give it quietly stays on small pages.
+class page_buffer final {
+public:
+    static constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+//                         RAII                             //
+//------------------------------------------------------------
+    explicit page_buffer(std::size_t bytes) noexcept(false);
+    ~page_buffer();
+
+    page_buffer(page_buffer const &) = delete;
+    page_buffer & operator=(page_buffer const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    unsigned char * data();
+    unsigned char const * data() const;
+    std::size_t size() const;
+
+    // aligned and advised, not a promise the kernel backed it with them
+    bool wants_huge_pages() const;
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    unsigned char * m_data;
+    std::size_t m_size;
+
+    // what was mapped, which can be more than size
+    void * m_mapping;
+    std::size_t m_mapped;
+    bool m_huge;
+
+}; // page_buffer
+
+#endif // PAGE_BUFFER_HPP
@@ -0,0 +1,329 @@
+#include "profiler.hpp"
+
+#ifdef AQUABLOCK_PROFILE
+
+// std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// log linear buckets: values below 8 get one each, above that every power
+// of two is split into 8, so a percentile is off by at most 1/16th
+constexpr int sub_buckets = 8;
+constexpr int bucket_count = 62 * sub_buckets;
+
+// phases a thread keeps histograms for, more than any thread ever uses.
+// the rest still go in the ring but not the csv
+constexpr std::size_t max_phases = 32;
+
+// the fields are atomic so an exporter can read an event while its thread
+// writes another one. relaxed loads and stores are plain moves
+struct event {
+    std::atomic<char const *> name;
+    std::atomic<std::uint64_t> begin;
+    std::atomic<std::uint64_t> end;
+};
+
+struct histogram {
+    std::atomic<char const *> name;
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> total;
+    std::atomic<std::uint64_t> max;
+    std::array<std::atomic<std::uint64_t>, bucket_count> buckets;
+};
+
+// a copy of an event taken by an exporter
+struct phase_event {
+    char const * name;
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+// a copy of a histogram taken by an exporter
+struct phase_totals {
+    char const * name;
+    std::uint64_t count;
+    std::uint64_t total;
+    std::uint64_t max;
+    std::array<std::uint64_t, bucket_count> buckets;
+};
+
+// everything one thread has recorded. only that thread writes it, so
+// recording takes no lock. it bumps claimed before it writes over a slot
+// of the ring and written after, so an exporter copying the ring can tell
+// which of the slots it copied were written over meanwhile. a phase's
+// name is set before phase_count takes it in. the mutex is only for the
+// thread's name
+struct thread_log {
+    std::mutex mutex;
+    std::string name;
+    std::size_t id;
+    std::unique_ptr<event[]> ring;
+    std::atomic<std::uint64_t> claimed;
+    std::atomic<std::uint64_t> written;
+    std::unique_ptr<histogram[]> histograms;
+    std::atomic<std::size_t> phase_count;
+};
+
+// logs live until exit, so a thread that has finished still shows up
+struct registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<thread_log>> logs;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+//------------------------------------------------------------
+// the only writer of an atomic can add to it without a locked add
+void
+bump(std::atomic<std::uint64_t> & counter, std::uint64_t by) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+registry &
+all_logs() {
+    static registry logs;
+    return logs;
+}
+
+//------------------------------------------------------------
+thread_log &
+this_thread_log() {
+    thread_local thread_log * log = [] {
+        auto & logs = all_logs();
+        std::lock_guard<std::mutex> lock(logs.mutex);
+
+        logs.logs.push_back(std::make_unique<thread_log>());
+
+        auto * created = logs.logs.back().get();
+        created->id = logs.logs.size();
+        created->name = "thread " + std::to_string(created->id);
+        created->ring = std::make_unique<event[]>(profiler::ring_capacity);
+        created->claimed.store(0, std::memory_order_relaxed);
+        created->written.store(0, std::memory_order_relaxed);
+        created->histograms = std::make_unique<histogram[]>(max_phases);
+        created->phase_count.store(0, std::memory_order_relaxed);
+        return created;
+    }();
+
+    return *log;
+}
+
+//------------------------------------------------------------
+int
+bucket_of(std::uint64_t value) {
+    if (value < sub_buckets) return static_cast<int>(value);
+
+    int exponent = 63;
+    while (!(value >> exponent)) exponent--;
+
+    auto const sub = static_cast<int>((value >> (exponent - 3)) & (sub_buckets - 1));
+    return std::min((exponent - 2) * sub_buckets + sub, bucket_count - 1);
+}
+
+//------------------------------------------------------------
+// the middle of the range of values that land in a bucket
+double
+bucket_value(int bucket) {
+    if (bucket < sub_buckets) return bucket;
+
+    auto const exponent = bucket / sub_buckets + 2;
+    auto const sub = bucket % sub_buckets;
+    auto const low = static_cast<double>(sub_buckets + sub) * static_cast<double>(std::uint64_t{1} << (exponent - 3));
+    auto const width = static_cast<double>(std::uint64_t{1} << (exponent - 3));
+    return low + width / 2.0;
+}
+
+//------------------------------------------------------------
+double
+percentile(phase_totals const & h, double fraction) {
+    auto const target = static_cast<std::uint64_t>(fraction * static_cast<double>(h.count - 1));
+    std::uint64_t seen = 0;
+
+    for (int bucket = 0; bucket < bucket_count; bucket++) {
+        seen += h.buckets[bucket];
+        if (seen > target) {
+            return std::min(bucket_value(bucket), static_cast<double>(h.max));
+        }
+    }
+    return static_cast<double>(h.max);
+}
+
+//------------------------------------------------------------
+void
+write_json_string(std::ostream & out, char const * text) {
+    out << '"';
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') out << '\\';
+        out << *text;
+    }
+    out << '"';
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                         profiler                         //
+//------------------------------------------------------------
+
+//------------------------------------------------------------
+std::uint64_t
+profiler::now_ns() {
+    auto const since = std::chrono::steady_clock::now() - all_logs().epoch;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(since).count());
+}
+
+//------------------------------------------------------------
+void
+profiler::record(char const * name, std::uint64_t begin_ns, std::uint64_t end_ns) {
+    auto & log = this_thread_log();
+
+    auto const written = log.written.load(std::memory_order_relaxed);
+    log.claimed.store(written + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto & e = log.ring[written % ring_capacity];
+    e.name.store(name, std::memory_order_relaxed);
+    e.begin.store(begin_ns, std::memory_order_relaxed);
+    e.end.store(end_ns, std::memory_order_relaxed);
+    log.written.store(written + 1, std::memory_order_release);
+
+    // a thread only ever sees a handful of phases
+    auto const phases = log.phase_count.load(std::memory_order_relaxed);
+    auto * const first = log.histograms.get();
+    auto * h = std::find_if(first, first + phases, [name](histogram const & h) { return h.name.load(std::memory_order_relaxed) == name; });
+    if (h == first + phases) {
+        if (phases == max_phases) return;
+        h->name.store(name, std::memory_order_relaxed);
+        log.phase_count.store(phases + 1, std::memory_order_release);
+    }
+
+    auto const duration = end_ns - begin_ns;
+    bump(h->count, 1);
+    bump(h->total, duration);
+    if (duration > h->max.load(std::memory_order_relaxed)) h->max.store(duration, std::memory_order_relaxed);
+    bump(h->buckets[bucket_of(duration)], 1);
+}
+
+//------------------------------------------------------------
+void
+profiler::set_thread_name(char const * name) {
+    auto & log = this_thread_log();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.name = name;
+}
+
+//------------------------------------------------------------
+void
+profiler::write_chrome_trace(std::ostream & out) {
+    auto & logs = all_logs();
+    std::lock_guard<std::mutex> registry_lock(logs.mutex);
+
+    out << "{\"traceEvents\": [\n";
+    bool first = true;
+
+    auto separator = [&] {
+        out << (first ? "  " : ",\n  ");
+        first = false;
+    };
+
+    for (auto const & log : logs.logs) {
+        separator();
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << log->id << ", \"args\": {\"name\": ";
+        {
+            std::lock_guard<std::mutex> lock(log->mutex);
+            write_json_string(out, log->name.c_str());
+        }
+        out << "}}";
+
+        // copy the ring out while the thread carries on recording, then
+        // throw away whatever it wrote over during the copy
+        auto const written = log->written.load(std::memory_order_acquire);
+        auto const count = std::min<std::uint64_t>(written, ring_capacity);
+
+        std::vector<phase_event> events;
+        events.reserve(static_cast<std::size_t>(count));
+        for (auto i = written - count; i < written; i++) {
+            auto const & e = log->ring[i % ring_capacity];
+            events.push_back(phase_event{e.name.load(std::memory_order_relaxed), e.begin.load(std::memory_order_relaxed), e.end.load(std::memory_order_relaxed)});
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto const claimed = log->claimed.load(std::memory_order_relaxed);
+        auto const oldest = (claimed > ring_capacity) ? claimed - ring_capacity : 0;
+        auto const stale = std::min<std::uint64_t>((oldest > written - count) ? oldest - (written - count) : 0, count);
+
+        // the oldest event still in the ring first
+        for (auto i = static_cast<std::size_t>(stale); i < events.size(); i++) {
+            auto const & e = events[i];
+
+            separator();
+            out << "{\"name\": ";
+            write_json_string(out, e.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << log->id
+                << ", \"ts\": " << static_cast<double>(e.begin) / 1000.0
+                << ", \"dur\": " << static_cast<double>(e.end - e.begin) / 1000.0 << "}";
+        }
+    }
+
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+//------------------------------------------------------------
+void
+profiler::write_csv(std::ostream & out) {
+    auto & logs = all_logs();
+    std::lock_guard<std::mutex> registry_lock(logs.mutex);
+
+    // the same phase on several threads - pool workers - is merged. names
+    // are compared by contents, one literal may live at several addresses
+    std::vector<phase_totals> phases;
+
+    for (auto const & log : logs.logs) {
+        auto const count = log->phase_count.load(std::memory_order_acquire);
+
+        for (std::size_t i = 0; i < count; i++) {
+            auto const & h = log->histograms[i];
+            auto const name = h.name.load(std::memory_order_relaxed);
+
+            auto merged = std::find_if(phases.begin(), phases.end(), [name](phase_totals const & p) { return std::strcmp(p.name, name) == 0; });
+            if (merged == phases.end()) {
+                phases.push_back(phase_totals{name, 0, 0, 0, {}});
+                merged = phases.end() - 1;
+            }
+
+            // the thread may be recording into it, so the counts are a
+            // moment apart from each other - close enough for percentiles
+            merged->count += h.count.load(std::memory_order_relaxed);
+            merged->total += h.total.load(std::memory_order_relaxed);
+            merged->max = std::max(merged->max, h.max.load(std::memory_order_relaxed));
+            for (int bucket = 0; bucket < bucket_count; bucket++) {
+                merged->buckets[bucket] += h.buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::sort(phases.begin(), phases.end(), [](phase_totals const & a, phase_totals const & b) { return std::strcmp(a.name, b.name) < 0; });
+
+    out << "phase,count,total_ms,mean_us,p50_us,p99_us,max_us\n";
+    for (auto const & p : phases) {
+        out << p.name << ","
+            << p.count << ","
+            << static_cast<double>(p.total) / 1e6 << ","
+            << static_cast<double>(p.total) / static_cast<double>(p.count) / 1e3 << ","
+            << percentile(p, 0.50) / 1e3 << ","
+            << percentile(p, 0.99) / 1e3 << ","
+            << static_cast<double>(p.max) / 1e3 << "\n";
+    }
+}
+
+#endif // AQUABLOCK_PROFILE
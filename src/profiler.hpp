@@ -0,0 +1,80 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+/*
+    ------------ profiler -------------
+    scoped timers for the phases of a frame and a tick. only built when
+    AQUABLOCK_PROFILE is defined (cmake -DAQUABLOCK_PROFILE=ON), otherwise
+    the macros expand to nothing and none of this is compiled.
+
+    AQUABLOCK_PROFILE_SCOPE("grid.sweep");  times the rest of the block
+    AQUABLOCK_PROFILE_THREAD("sim");        names the calling thread
+
+    every thread records into its own ring buffer of the last ring_capacity
+    events and its own latency histogram per phase. only that thread ever
+    writes them, so recording takes no lock and never waits on the
+    exporters - they copy what they need and skip the events written over
+    while they copied. write_chrome_trace() gives the events as
+    chrome trace json (chrome://tracing or ui.perfetto.dev) and write_csv()
+    the histograms as p50 / p99 / max per phase.
+ */
+
+#ifdef AQUABLOCK_PROFILE
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace profiler {
+    constexpr std::size_t ring_capacity = std::size_t{1} << 16;
+
+    // nanoseconds on the steady clock since the profiler started
+    std::uint64_t now_ns();
+
+    // name must outlive the profiler, a string literal in practice
+    void record(char const * name, std::uint64_t begin_ns, std::uint64_t end_ns);
+    void set_thread_name(char const * name);
+
+    // safe to call while other threads are recording
+    void write_chrome_trace(std::ostream & out);
+    void write_csv(std::ostream & out);
+
+    //------------------------------------------------------------
+    //                          scope                           //
+    //------------------------------------------------------------
+
+    class scope final {
+    public:
+        explicit scope(char const * name)
+        :   m_name{name}
+        ,   m_begin{now_ns()} {
+        }
+
+        ~scope() {
+            record(m_name, m_begin, now_ns());
+        }
+
+        scope(scope const &) = delete;
+        scope & operator=(scope const &) = delete;
+
+    private:
+        char const * m_name;
+        std::uint64_t m_begin;
+
+    }; // scope
+}
+
+#define AQUABLOCK_PROFILE_JOIN_(a, b) a##b
+#define AQUABLOCK_PROFILE_JOIN(a, b) AQUABLOCK_PROFILE_JOIN_(a, b)
+#define AQUABLOCK_PROFILE_SCOPE(name) ::profiler::scope AQUABLOCK_PROFILE_JOIN(profile_scope_, __LINE__)(name)
+#define AQUABLOCK_PROFILE_THREAD(name) ::profiler::set_thread_name(name)
+
+#else
+
+#define AQUABLOCK_PROFILE_SCOPE(name) ((void)0)
+#define AQUABLOCK_PROFILE_THREAD(name) ((void)0)
+
+#endif // AQUABLOCK_PROFILE
+
+#endif // PROFILER_HPP
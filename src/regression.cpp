@@ -0,0 +1,239 @@
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// my
+#include "constants.hpp"
+#include "grid_snapshot.hpp"
+#include "water_grid.hpp"
+#include "world_file.hpp"
+#include "world_saver.hpp"
+
+/*
+    ---------- aquablock_regression ----------
+    small fixed cases for bugs that were fixed once and should stay fixed,
+    each one the cells that showed the bug. ctest runs it, every case is
+    run in both mass formats and any that fails is printed. world files
+    are written to the working directory and removed again.
+
+    usage: aquablock_regression
+ */
+
+namespace {
+
+//------------------------------------------------------------
+//                          cases                           //
+//------------------------------------------------------------
+
+struct regression {
+    char const * name;
+
+    // true if the grid behaves, the message says what it did if not
+    std::function<bool(mass_format, std::string &)> check;
+};
+
+//------------------------------------------------------------
+// water over an empty cell on the floor with next_to resting beside it.
+// only a material that runs sideways can compete for that cell
+bool
+falls_beside(material next_to, mass_format format, std::string & message) {
+    water_grid grid(12, 10, format);
+    grid.set_water(6, 7, 200.0f);
+    grid.fill_rect(5, 8, 5, 8, next_to, constants::max_mass);
+    grid.step();
+
+    if (grid.material_at(6, 8) != material::WATER) {
+        message = "the water ran sideways instead of falling";
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------
+// a saved pool with one cell next to it overwritten by a byte that is no
+// material. opening the file must not read the material plane, the first
+// tick that reaches the cell must refuse it
+bool
+rejects_unknown_material(mass_format format, std::string & message) {
+    std::string const path = "regression_unknown_material.world";
+
+    {
+        water_grid grid(100, 60, format);
+        grid.fill_rect(5, 5, 30, 30, material::WATER, constants::max_mass);
+
+        world_saver saver(path);
+        saver.save(grid);
+        saver.flush();
+    }
+
+    bool rejected = false;
+
+    try {
+        {
+            world_file const file(path);
+            std::fstream out(path, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp(static_cast<std::streamoff>(file.header().material_offset + 40 * 100 + 40));
+            out.put(static_cast<char>(200));
+        }
+
+        world_file const file(path);
+        water_grid grid(file);
+
+        try {
+            grid.step();
+        } catch (std::runtime_error const &) {
+            rejected = true;
+        }
+    } catch (std::exception const & e) {
+        message = std::string("the file was refused on opening: ") + e.what();
+        std::remove(path.c_str());
+        return false;
+    }
+
+    std::remove(path.c_str());
+
+    if (!rejected) {
+        message = "a tick ran over the unknown material";
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------
+// cell for cell, bits and all, the first difference in the message
+bool
+same_cells(water_grid const & a, water_grid const & b, char const * what, std::string & message) {
+    auto same_bits = [](float x, float y) { return std::memcmp(&x, &y, sizeof(float)) == 0; };
+
+    for (int y = 0; y < a.height(); y++) {
+        for (int x = 0; x < a.width(); x++) {
+            bool const same =
+                a.material_at(x, y) == b.material_at(x, y) &&
+                same_bits(a.mass_at(x, y), b.mass_at(x, y)) &&
+                same_bits(a.mass_next_at(x, y), b.mass_next_at(x, y));
+
+            if (!same) {
+                message = std::string(what) + " differs first at " + std::to_string(x) + ", " + std::to_string(y);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------
+// the same edits and ticks on a row major and a tiled grid, neither a
+// whole number of tiles, must leave the same cells - and so must a
+// snapshot of the tiled one and the world file saved from it
+bool
+tiled_matches_row_major(mass_format format, std::string & message) {
+    std::string const path = "regression_tiled.world";
+
+    water_grid grids[2] {{150, 90, format, cell_layout::ROW_MAJOR}, {150, 90, format, cell_layout::TILED}};
+    std::vector<unsigned char> cells;
+
+    for (auto & grid : grids) {
+        grid.fill_rect(20, 60, 120, 62, material::GROUND);
+        grid.fill_circle(70, 30, 20, material::WATER, constants::max_mass);
+        grid.fill_line(5, 10, 140, 40, 2, material::SAND, constants::max_mass);
+        grid.flood_fill(2, 85, material::WATER, 0.5f);
+        for (int tick = 0; tick < 40; tick++) grid.step();
+
+        grid.settle_basins();
+        grid.clear_material(material::SAND);
+
+        cells.resize(static_cast<std::size_t>(grid.width()) * grid.cell_bytes());
+        grid.read_cells(0, 50, grid.width(), cells.data());
+        grid.write_cells(0, 20, grid.width(), cells.data());
+        for (int tick = 0; tick < 20; tick++) grid.step();
+    }
+
+    if (!same_cells(grids[0], grids[1], "the tiled grid", message)) return false;
+
+    grid_snapshot snapshot;
+    snapshot.capture(grids[1], 0);
+
+    for (int y = 0; y < grids[0].height(); y++) {
+        for (int x = 0; x < grids[0].width(); x++) {
+            if (snapshot.material_at(x, y) != grids[0].material_at(x, y) || snapshot.mass_at(x, y) != grids[0].mass_at(x, y)) {
+                message = "the snapshot differs first at " + std::to_string(x) + ", " + std::to_string(y);
+                return false;
+            }
+        }
+    }
+
+    {
+        world_saver saver(path);
+        saver.save(grids[1]);
+        saver.flush();
+    }
+
+    bool same = false;
+    try {
+        world_file const file(path);
+        water_grid const loaded(file);
+        same = same_cells(grids[0], loaded, "the saved world", message);
+    } catch (std::exception const & e) {
+        message = std::string("the saved world would not load: ") + e.what();
+    }
+
+    std::remove(path.c_str());
+    return same;
+}
+
+//------------------------------------------------------------
+std::vector<regression>
+make_regressions() {
+    std::vector<regression> regressions;
+
+    // resting sand next to the cell held the water back, as if it could
+    // run sideways into it
+    regressions.push_back({"water_falls_beside_sand", [](mass_format format, std::string & message) {
+        return falls_beside(material::SAND, format, message);
+    }});
+
+    regressions.push_back({"water_falls_beside_ground", [](mass_format format, std::string & message) {
+        return falls_beside(material::GROUND, format, message);
+    }});
+
+    // world files were scanned whole on opening, which read every page of
+    // the material plane up front
+    regressions.push_back({"world_file_unknown_material", rejects_unknown_material});
+
+    // the tiled layout fills a halo about each tile and splits spans at
+    // tile edges, either of which can go wrong a cell out
+    regressions.push_back({"tiled_matches_row_major", tiled_matches_row_major});
+
+    return regressions;
+}
+
+} // namespace
+
+int main() {
+    int failed = 0;
+
+    for (auto const & r : make_regressions()) {
+        for (auto const format : {mass_format::FLOAT32, mass_format::FIXED16}) {
+            auto const format_name = (format == mass_format::FLOAT32) ? "float32" : "fixed16";
+            std::string message;
+
+            if (r.check(format, message)) {
+                std::cout << "ok     " << r.name << " " << format_name << std::endl;
+            } else {
+                std::cout << "FAILED " << r.name << " " << format_name << ": " << message << std::endl;
+                failed++;
+            }
+        }
+    }
+
+    return (failed == 0) ? 0 : 1;
+}
@@ -25,7 +25,7 @@ sdl_module::sdl_module(std::string title, int window_width, int window_height) n
         throw sdl_module_exception(SDL_GetError());
     }
 
-    if ((m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED)) == nullptr) {
+    if ((m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC)) == nullptr) {
         throw sdl_module_exception(SDL_GetError());
     }
 
@@ -0,0 +1,254 @@
+#include "sim_thread.hpp"
+
+// std
+#include <stdexcept>
+#include <string>
+
+// my
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "water_grid.hpp"
+#include "world_saver.hpp"
+
+namespace {
+
+using clock = tick_scheduler::clock;
+
+clock::duration
+seconds(double value, char const * what) {
+    if (!(value > 0.0)) {
+        throw std::invalid_argument(std::string("sim_thread needs a positive ") + what);
+    }
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(value));
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                        sim_thread                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+sim_thread::sim_thread(water_grid & grid, double ticks_per_second, thread_pool * pool, world_saver * saver, double frame_budget) noexcept(false)
+:   m_grid{grid}
+,   m_pool{pool}
+,   m_saver{saver}
+,   m_schedule{seconds(ticks_per_second > 0.0 ? 1.0 / ticks_per_second : 0.0, "tick rate"), seconds(frame_budget, "frame budget"), max_catch_up}
+,   m_running{true}
+,   m_save_requested{false}
+,   m_failed{false}
+,   m_ticks{0}
+,   m_behind_ns{0}
+,   m_tick_cost_ns{0}
+,   m_idle{false} {
+
+    // the ui has something to draw before the first tick
+    publish();
+
+    m_thread = std::thread([this] { loop(); });
+}
+
+//------------------------------------------------------------
+sim_thread::~sim_thread() {
+    stop();
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+bool
+sim_thread::push_edit(grid_edit const & edit) {
+    auto const pushed = m_edits.push(edit);
+    wake();
+    return pushed;
+}
+
+//------------------------------------------------------------
+void
+sim_thread::request_save() {
+    m_save_requested.store(true, std::memory_order_release);
+    wake();
+}
+
+//------------------------------------------------------------
+grid_snapshot const &
+sim_thread::latest() {
+    return m_snapshots.read();
+}
+
+//------------------------------------------------------------
+void
+sim_thread::check() {
+    if (m_failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+//------------------------------------------------------------
+void
+sim_thread::stop() {
+    m_running.store(false, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+    }
+    m_woken.notify_one();
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+//------------------------------------------------------------
+std::uint64_t
+sim_thread::tick_count() const {
+    return m_ticks.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+std::chrono::nanoseconds
+sim_thread::behind() const {
+    return std::chrono::nanoseconds(m_behind_ns.load(std::memory_order_relaxed));
+}
+
+//------------------------------------------------------------
+std::chrono::nanoseconds
+sim_thread::tick_cost() const {
+    return std::chrono::nanoseconds(m_tick_cost_ns.load(std::memory_order_relaxed));
+}
+
+//------------------------------------------------------------
+bool
+sim_thread::is_idle() const {
+    return m_idle.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+void
+sim_thread::loop() {
+    AQUABLOCK_PROFILE_THREAD("sim");
+
+    try {
+        while (m_running.load(std::memory_order_acquire)) {
+            auto const now = clock::now();
+            auto const ticks = m_schedule.due(now);
+
+            if (ticks == 0) {
+                std::this_thread::sleep_until(m_schedule.next());
+                continue;
+            }
+
+            for (int i = 0; i < ticks; i++) {
+                tick();
+            }
+
+            auto const done = clock::now();
+            m_schedule.ran(ticks, done - now, done);
+
+            m_behind_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(m_schedule.behind(done)).count(), std::memory_order_relaxed);
+            m_tick_cost_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(m_schedule.tick_cost()).count(), std::memory_order_relaxed);
+
+            publish();
+
+            if (m_saver && m_save_requested.exchange(false, std::memory_order_acq_rel)) {
+                AQUABLOCK_PROFILE_SCOPE("sim.save");
+                m_saver->save(m_grid);
+            }
+
+            if (m_grid.is_settled()) {
+                wait_while_idle();
+            }
+        }
+
+    } catch (...) {
+        m_error = std::current_exception();
+        m_failed.store(true, std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------
+void
+sim_thread::tick() {
+    AQUABLOCK_PROFILE_SCOPE("sim.tick");
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("sim.edits");
+
+        grid_edit edit;
+        while (m_edits.pop(edit)) {
+            edit.apply(m_grid);
+        }
+    }
+
+    if (m_pool) {
+        m_grid.step(*m_pool);
+    } else {
+        m_grid.step();
+    }
+
+    m_ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------
+void
+sim_thread::publish() {
+    AQUABLOCK_PROFILE_SCOPE("sim.publish");
+
+    auto const ticks = m_ticks.load(std::memory_order_relaxed);
+
+    // stamp what changed since the last publish, so the snapshot only
+    // copies and the ui only redraws those chunks
+    m_grid.take_changed_chunks(m_changed);
+
+    auto const chunk_count = m_grid.chunks_x() * m_grid.chunks_y();
+    if (m_chunk_ticks.size() != chunk_count) {
+        m_chunk_ticks.assign(chunk_count, ticks);
+    }
+
+    for (auto const chunk : m_changed) {
+        m_chunk_ticks[chunk] = ticks;
+    }
+
+    m_snapshots.back().capture(m_grid, ticks, m_chunk_ticks);
+    m_snapshots.publish();
+}
+
+//------------------------------------------------------------
+void
+sim_thread::wait_while_idle() {
+    AQUABLOCK_PROFILE_SCOPE("sim.idle");
+
+    // idle goes up before the queue is looked at, and wake() pushes before
+    // it looks at idle. with the fences one of the two sees the other, so
+    // an edit can not slip in between and be left waiting
+    m_idle.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    {
+        std::unique_lock<std::mutex> lock(m_wake_mutex);
+        m_woken.wait(lock, [this] {
+            return !m_edits.empty() ||
+                   m_save_requested.load(std::memory_order_acquire) ||
+                   !m_running.load(std::memory_order_acquire);
+        });
+    }
+
+    m_idle.store(false, std::memory_order_relaxed);
+    m_schedule.restart(clock::now());
+}
+
+//------------------------------------------------------------
+void
+sim_thread::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // the lock is only taken while the thread is idle, which is when the
+    // ui has nothing else to do anyway
+    if (m_idle.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(m_wake_mutex);
+        }
+        m_woken.notify_one();
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef SIM_THREAD_HPP
+#define SIM_THREAD_HPP
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// my
+#include "grid_edit.hpp"
+#include "grid_snapshot.hpp"
+#include "spsc_queue.hpp"
+#include "tick_scheduler.hpp"
+#include "triple_buffer.hpp"
+
+class thread_pool;
+class water_grid;
+class world_saver;
+
+//------------------------------------------------------------
+//                        sim_thread                        //
+//------------------------------------------------------------
+
+// steps a water_grid at a fixed rate on its own thread, so a slow frame
+// does not slow the simulation and a heavy tick does not stall the ui.
+//
+// while it runs the grid belongs to this thread. edits come in through a
+// wait free queue and are applied before the next tick, and the grid goes
+// out as a grid_snapshot through a triple buffer after every batch of
+// ticks, copying only the chunks that changed since that buffer was last
+// filled. the ui thread calls push_edit() and latest() and never waits.
+//
+// a tick_scheduler keeps the time. each batch runs the ticks that are due,
+// but only as many as fit in frame_budget seconds at the measured cost of
+// a tick and never more than max_catch_up, so a slow machine publishes as
+// often as a fast one. a backlog too big to catch up is dropped instead of
+// spiralling, and behind() says how much simulated time that has cost.
+//
+// once the grid has settled and no edits are waiting the thread goes idle.
+// a tick of a settled grid changes nothing, so instead of running them it
+// blocks until an edit, a save or stop() comes in, and picks up from then
+// without counting the idle time as behind.
+//
+// with a world_saver, request_save() has the grid saved after the current
+// batch of ticks. only the copy of the changed chunks happens on this
+// thread, the writing is done by the saver's own.
+class sim_thread final {
+public:
+    static constexpr std::size_t edit_capacity = 4096;
+    static constexpr int max_catch_up = tick_scheduler::default_max_catch_up;
+    static constexpr double default_frame_budget = 1.0 / 60.0;
+
+//                         RAII                             //
+//------------------------------------------------------------
+    sim_thread(water_grid & grid, double ticks_per_second, thread_pool * pool = nullptr, world_saver * saver = nullptr, double frame_budget = default_frame_budget) noexcept(false);
+    ~sim_thread();
+
+    sim_thread(sim_thread const &) = delete;
+    sim_thread & operator=(sim_thread const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // ui thread. false if the queue is full and the edit was dropped
+    bool push_edit(grid_edit const & edit);
+
+    // ui thread. ignored without a world_saver
+    void request_save();
+
+    // ui thread. the newest snapshot, valid until the next call
+    grid_snapshot const & latest();
+
+    // rethrows on the calling thread if the simulation thread failed
+    void check();
+
+    void stop();
+
+    std::uint64_t tick_count() const;
+
+    // any thread. idle as described above, so the picture will not change
+    // until there is an edit
+    bool is_idle() const;
+
+    // any thread. simulated time lost to wall time so far, and the moving
+    // average cost of one tick, as of the last batch
+    std::chrono::nanoseconds behind() const;
+    std::chrono::nanoseconds tick_cost() const;
+
+private:
+    void loop();
+    void tick();
+    void publish();
+    void wait_while_idle();
+    void wake();
+
+//                         data                             //
+//------------------------------------------------------------
+    water_grid & m_grid;
+    thread_pool * m_pool;
+    world_saver * m_saver;
+    tick_scheduler m_schedule;
+
+    spsc_queue<grid_edit, edit_capacity> m_edits;
+    triple_buffer<grid_snapshot> m_snapshots;
+
+    // the tick each chunk last changed on, only touched by this thread
+    std::vector<std::uint64_t> m_chunk_ticks;
+    std::vector<std::size_t> m_changed;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_save_requested;
+    std::atomic<bool> m_failed;
+    std::atomic<std::uint64_t> m_ticks;
+    std::atomic<std::int64_t> m_behind_ns;
+    std::atomic<std::int64_t> m_tick_cost_ns;
+    std::atomic<bool> m_idle;
+    std::exception_ptr m_error;
+
+    // only for waking the thread when idle, the queue itself stays wait free
+    std::mutex m_wake_mutex;
+    std::condition_variable m_woken;
+
+    std::thread m_thread;
+
+}; // sim_thread
+
+#endif // SIM_THREAD_HPP
@@ -0,0 +1,79 @@
+#ifndef SLAB_POOL_HPP
+#define SLAB_POOL_HPP
+
+// std
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+//------------------------------------------------------------
+//                        slab_pool                         //
+//------------------------------------------------------------
+
+// hands out fixed size objects carved from slabs of slab_size at a time and
+// keeps released ones on a free list, so allocating and freeing chunks as
+// the water moves around never goes back to the system allocator. slabs
+// are only returned when the pool is destroyed.
+template <typename T, std::size_t slab_size = 64>
+class slab_pool final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    slab_pool() = default;
+
+    slab_pool(slab_pool const &) = delete;
+    slab_pool & operator=(slab_pool const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // the object is in whatever state it was released in
+    T * allocate() {
+        if (m_free.empty()) {
+            m_slabs.push_back(std::make_unique<T[]>(slab_size));
+
+            auto * slab = m_slabs.back().get();
+            for (std::size_t i = slab_size; i > 0; i--) {
+                m_free.push_back(slab + i - 1);
+            }
+        }
+
+        auto * object = m_free.back();
+        m_free.pop_back();
+        return object;
+    }
+
+    void release(T * object) {
+        m_free.push_back(object);
+    }
+
+    void release_all() {
+        m_free.clear();
+
+        for (auto & slab : m_slabs) {
+            for (std::size_t i = slab_size; i > 0; i--) {
+                m_free.push_back(slab.get() + i - 1);
+            }
+        }
+    }
+
+    std::size_t capacity() const {
+        return m_slabs.size() * slab_size;
+    }
+
+    std::size_t in_use() const {
+        return capacity() - m_free.size();
+    }
+
+    std::size_t memory_bytes() const {
+        return capacity() * sizeof(T) + m_free.capacity() * sizeof(T *) + m_slabs.capacity() * sizeof(std::unique_ptr<T[]>);
+    }
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::vector<std::unique_ptr<T[]>> m_slabs;
+    std::vector<T *> m_free;
+
+}; // slab_pool
+
+#endif // SLAB_POOL_HPP
@@ -0,0 +1,169 @@
+#include "socket_transport.hpp"
+
+// std
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// dependancies
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+//------------------------------------------------------------
+[[noreturn]] void
+fail(char const * what, int peer) {
+    throw std::runtime_error(std::string(what) + " rank " + std::to_string(peer) + " failed: " + std::strerror(errno));
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                     socket_transport                     //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+socket_transport::socket_transport(std::vector<int> sockets) noexcept(false)
+:   m_sockets{std::move(sockets)} {
+}
+
+//------------------------------------------------------------
+socket_transport::~socket_transport() {
+    for (auto const socket : m_sockets) {
+        if (socket >= 0) ::close(socket);
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+socket_transport::exchange(int peer, void const * out, void * in, std::size_t bytes) {
+    auto const socket = socket_to(peer);
+    auto const * sending = static_cast<unsigned char const *>(out);
+    auto * receiving = static_cast<unsigned char *>(in);
+    std::size_t sent = 0;
+    std::size_t received = 0;
+
+    // both ways at once - a halo can be more than the socket buffers hold,
+    // and the peer is doing the same thing the other way round
+    while (sent < bytes || received < bytes) {
+        pollfd wait {socket, 0, 0};
+        if (sent < bytes) wait.events |= POLLOUT;
+        if (received < bytes) wait.events |= POLLIN;
+
+        if (::poll(&wait, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            fail("waiting on", peer);
+        }
+
+        if (sent < bytes && (wait.revents & POLLOUT)) {
+            auto const n = ::send(socket, sending + sent, bytes - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("sending to", peer);
+            if (n > 0) sent += static_cast<std::size_t>(n);
+        }
+
+        if (received < bytes && (wait.revents & (POLLIN | POLLHUP | POLLERR))) {
+            auto const n = ::recv(socket, receiving + received, bytes - received, MSG_DONTWAIT);
+            if (n == 0) throw std::runtime_error("rank " + std::to_string(peer) + " hung up mid exchange");
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("receiving from", peer);
+            if (n > 0) received += static_cast<std::size_t>(n);
+        }
+    }
+}
+
+//------------------------------------------------------------
+void
+socket_transport::send(int peer, void const * data, std::size_t bytes) {
+    auto const socket = socket_to(peer);
+    auto const * sending = static_cast<unsigned char const *>(data);
+
+    for (std::size_t sent = 0; sent < bytes;) {
+        auto const n = ::send(socket, sending + sent, bytes - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("sending to", peer);
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+}
+
+//------------------------------------------------------------
+void
+socket_transport::receive(int peer, void * data, std::size_t bytes) {
+    auto const socket = socket_to(peer);
+    auto * receiving = static_cast<unsigned char *>(data);
+
+    for (std::size_t received = 0; received < bytes;) {
+        auto const n = ::recv(socket, receiving + received, bytes - received, 0);
+        if (n == 0) throw std::runtime_error("rank " + std::to_string(peer) + " hung up");
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fail("receiving from", peer);
+        }
+        received += static_cast<std::size_t>(n);
+    }
+}
+
+//------------------------------------------------------------
+std::vector<std::vector<int>>
+socket_transport::local_links(int ranks_x, int ranks_y) noexcept(false) {
+    auto const ranks = ranks_x * ranks_y;
+    std::vector<std::vector<int>> links(static_cast<std::size_t>(ranks), std::vector<int>(static_cast<std::size_t>(ranks), -1));
+
+    auto link = [&](int a, int b) {
+        auto & from = links[static_cast<std::size_t>(a)][static_cast<std::size_t>(b)];
+        if (from >= 0) return;
+
+        int pair[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+            auto const error = errno;
+            close_links(links, -1);
+            errno = error;
+            fail("linking", b);
+        }
+
+        from = pair[0];
+        links[static_cast<std::size_t>(b)][static_cast<std::size_t>(a)] = pair[1];
+    };
+
+    // the right and lower neighbour of every rank cover all four sides,
+    // and everyone gathers to rank 0
+    for (int rank = 0; rank < ranks; rank++) {
+        auto const rank_x = rank % ranks_x;
+        auto const rank_y = rank / ranks_x;
+
+        if (rank_x + 1 < ranks_x) link(rank, rank + 1);
+        if (rank_y + 1 < ranks_y) link(rank, rank + ranks_x);
+        if (rank != 0) link(0, rank);
+    }
+
+    return links;
+}
+
+//------------------------------------------------------------
+void
+socket_transport::close_links(std::vector<std::vector<int>> & links, int keep) {
+    for (std::size_t rank = 0; rank < links.size(); rank++) {
+        if (static_cast<int>(rank) == keep) continue;
+
+        for (auto & socket : links[rank]) {
+            if (socket >= 0) ::close(socket);
+            socket = -1;
+        }
+    }
+}
+
+//------------------------------------------------------------
+int
+socket_transport::socket_to(int peer) const {
+    if (peer < 0 || static_cast<std::size_t>(peer) >= m_sockets.size() || m_sockets[static_cast<std::size_t>(peer)] < 0) {
+        throw std::invalid_argument("no link to rank " + std::to_string(peer));
+    }
+    return m_sockets[static_cast<std::size_t>(peer)];
+}
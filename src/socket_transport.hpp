@@ -0,0 +1,54 @@
+#ifndef SOCKET_TRANSPORT_HPP
+#define SOCKET_TRANSPORT_HPP
+
+// std
+#include <cstddef>
+#include <vector>
+
+// my
+#include "halo_transport.hpp"
+
+//------------------------------------------------------------
+//                     socket_transport                     //
+//------------------------------------------------------------
+
+// a halo_transport over connected unix domain stream sockets, one per peer.
+// local_links() makes a socket pair for every pair of ranks that talk -
+// grid neighbours and rank 0 with everyone - before the ranks are forked,
+// so a distributed run can be tested on one machine.
+//
+// posix only. the sockets are owned and closed by the transport.
+class socket_transport final : public halo_transport {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    // sockets[peer] is the one to that rank, -1 where there is none
+    explicit socket_transport(std::vector<int> sockets) noexcept(false);
+    ~socket_transport() override;
+
+    socket_transport(socket_transport const &) = delete;
+    socket_transport & operator=(socket_transport const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    void exchange(int peer, void const * out, void * in, std::size_t bytes) override;
+    void send(int peer, void const * data, std::size_t bytes) override;
+    void receive(int peer, void * data, std::size_t bytes) override;
+
+    // links[rank][peer] is rank's end of its socket to peer, -1 for ranks
+    // that never talk, for ranks_x by ranks_y ranks numbered as subdomain
+    // does. once forked a rank keeps its own row and closes every other one
+    // with close_links()
+    static std::vector<std::vector<int>> local_links(int ranks_x, int ranks_y) noexcept(false);
+    static void close_links(std::vector<std::vector<int>> & links, int keep);
+
+private:
+    int socket_to(int peer) const;
+
+//                         data                             //
+//------------------------------------------------------------
+    std::vector<int> m_sockets;
+
+}; // socket_transport
+
+#endif // SOCKET_TRANSPORT_HPP
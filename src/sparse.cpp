@@ -0,0 +1,241 @@
+// std
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// my
+#include "constants.hpp"
+#include "sparse_world.hpp"
+#include "thread_pool.hpp"
+#include "water_grid.hpp"
+#include "world_file.hpp"
+
+/*
+    ------------ aquablock_sparse -------------
+    runs a huge, mostly empty world on a sparse_world, which only stores
+    the chunks that hold something. loads a world file, or scatters pools
+    of water on ledges over an empty world of --size.
+
+    usage: aquablock_sparse [--world big.world | --size 16384x16384]
+                            [--background air|ground] [--ticks 500]
+                            [--threads 0] [--verify]
+
+    --background ground makes the world solid rock, the ledges become
+    caves carved out of it. a world file is loaded as it is, --background
+    only picks which of its chunks go unstored.
+    --verify runs the same ticks on a water_grid with a ground border and
+    checks the sparse world against it cell for cell. that grid is dense,
+    so keep --size within memory when verifying.
+ */
+
+namespace {
+
+//------------------------------------------------------------
+void
+parse_size(std::string const & text, int & width, int & height) {
+    auto const split = text.find('x');
+    if (split == std::string::npos) {
+        throw std::invalid_argument("--size wants WIDTHxHEIGHT, not " + text);
+    }
+
+    width = std::stoi(text.substr(0, split));
+    height = std::stoi(text.substr(split + 1));
+}
+
+//------------------------------------------------------------
+// a rectangle [x_begin, x_end) x [y_begin, y_end) of one material, in
+// sparse_world cells
+struct feature {
+    material type;
+    int x_begin;
+    int y_begin;
+    int x_end;
+    int y_end;
+};
+
+//------------------------------------------------------------
+// one pool every 1024x1024, a block of water falling onto a ledge that
+// spills it off both ends. on a ground background the ledge sits in a
+// cave, so the water runs into the walls as well
+std::vector<feature>
+scenario(int width, int height, material background) {
+    constexpr int spacing = 1024;
+    std::vector<feature> features;
+
+    for (int y = spacing / 4; y + 200 < height; y += spacing) {
+        for (int x = spacing / 4; x + 300 < width; x += spacing) {
+            if (background == material::GROUND) {
+                features.push_back({material::AIR, x - 40, y - 20, x + 340, y + 240});
+            }
+            features.push_back({material::GROUND, x, y + 160, x + 300, y + 164});
+            features.push_back({material::WATER, x + 100, y, x + 200, y + 100});
+        }
+    }
+
+    return features;
+}
+
+//------------------------------------------------------------
+void
+apply(feature const & f, sparse_world & world) {
+    if (f.type == material::WATER) {
+        for (int y = f.y_begin; y < f.y_end; y++) {
+            for (int x = f.x_begin; x < f.x_end; x++) {
+                world.set_water(x, y, constants::max_mass);
+            }
+        }
+    } else if (f.type == material::GROUND) {
+        world.fill_ground(f.x_begin, f.y_begin, f.x_end, f.y_end);
+    } else {
+        world.fill_air(f.x_begin, f.y_begin, f.x_end, f.y_end);
+    }
+}
+
+//------------------------------------------------------------
+// the same cells one in, inside the grid's ground border
+void
+apply(feature const & f, water_grid & grid) {
+    auto const mass = (f.type == material::WATER) ? constants::max_mass : 0.0f;
+    grid.fill_rect(f.x_begin + 1, f.y_begin + 1, f.x_end, f.y_end, f.type, mass);
+}
+
+//------------------------------------------------------------
+bool
+same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+//------------------------------------------------------------
+// cell for cell against the grid, cell (x, y) of the world being (x + 1,
+// y + 1) of the grid
+bool
+verify(sparse_world const & world, water_grid const & grid) {
+    for (int y = 0; y < world.height(); y++) {
+        for (int x = 0; x < world.width(); x++) {
+            bool const same =
+                world.material_at(x, y) == grid.material_at(x + 1, y + 1) &&
+                same_bits(world.mass_at(x, y), grid.mass_at(x + 1, y + 1)) &&
+                same_bits(world.mass_next_at(x, y), grid.mass_next_at(x + 1, y + 1));
+
+            if (!same) {
+                std::cout << "differs first at " << x << ", " << y << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::cout << "identical to a water_grid" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    std::string world_path;
+    int width = 16384;
+    int height = 16384;
+    material background = material::AIR;
+    int ticks = 500;
+    std::size_t threads = 0;
+    bool check = false;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument(std::string("missing value for ") + argv[i]);
+                return argv[++i];
+            };
+
+            if (std::strcmp(argv[i], "--world") == 0) {
+                world_path = value();
+            } else if (std::strcmp(argv[i], "--size") == 0) {
+                parse_size(value(), width, height);
+            } else if (std::strcmp(argv[i], "--background") == 0) {
+                auto const name = value();
+                if (name == "air") {
+                    background = material::AIR;
+                } else if (name == "ground") {
+                    background = material::GROUND;
+                } else {
+                    throw std::invalid_argument("--background wants air or ground, not " + name);
+                }
+            } else if (std::strcmp(argv[i], "--ticks") == 0) {
+                ticks = std::stoi(value());
+            } else if (std::strcmp(argv[i], "--threads") == 0) {
+                threads = static_cast<std::size_t>(std::stoul(value()));
+            } else if (std::strcmp(argv[i], "--verify") == 0) {
+                check = true;
+            } else {
+                throw std::invalid_argument(std::string("unknown argument ") + argv[i]);
+            }
+        }
+
+        if (ticks < 0) {
+            throw std::invalid_argument("--ticks must not be negative");
+        }
+
+        std::unique_ptr<sparse_world> world;
+        std::unique_ptr<water_grid> grid;
+
+        auto const load_start = std::chrono::steady_clock::now();
+
+        if (!world_path.empty()) {
+            world_file const file(world_path);
+            world = std::make_unique<sparse_world>(file, background);
+            if (check) grid = std::make_unique<water_grid>(file);
+        } else {
+            world = std::make_unique<sparse_world>(width, height, background);
+            if (check) {
+                grid = std::make_unique<water_grid>(width + 2, height + 2);
+                if (background == material::GROUND) grid->fill_rect(1, 1, width, height, material::GROUND);
+            }
+
+            for (auto const & f : scenario(width, height, background)) {
+                apply(f, *world);
+                if (grid) apply(f, *grid);
+            }
+        }
+
+        auto const load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+
+        std::cout << world->width() << "x" << world->height() << " world, "
+                  << world->chunk_count() << " chunks stored, "
+                  << static_cast<double>(world->memory_bytes()) / (1024.0 * 1024.0) << " MiB, built in "
+                  << load_seconds << " s" << std::endl;
+
+        std::unique_ptr<thread_pool> pool;
+        if (threads > 0) pool = std::make_unique<thread_pool>(threads);
+
+        auto const start = std::chrono::steady_clock::now();
+        for (int tick = 0; tick < ticks; tick++) {
+            if (pool) world->step(*pool); else world->step();
+        }
+        auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << ticks << " ticks in " << seconds << " s, "
+                  << (seconds > 0.0 ? ticks / seconds : 0.0) << " ticks/s, "
+                  << world->chunk_count() << " chunks stored, "
+                  << static_cast<double>(world->memory_bytes()) / (1024.0 * 1024.0) << " MiB" << std::endl;
+
+        if (grid) {
+            for (int tick = 0; tick < ticks; tick++) {
+                if (pool) grid->step(*pool); else grid->step();
+            }
+
+            if (!verify(*world, *grid)) {
+                return 1;
+            }
+        }
+
+    } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,789 @@
+#include "sparse_world.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// my
+#include "material_registry.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "world_file.hpp"
+
+namespace {
+    constexpr int cells_per_chunk = sparse_chunk::size * sparse_chunk::size;
+
+    // +0.0f and nothing else, as a fresh chunk holds, so a chunk that is
+    // left as a sentinel loses nothing
+    bool is_zero(float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits == 0;
+    }
+}
+
+//------------------------------------------------------------
+//                       sparse_world                       //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+sparse_world::sparse_world(int width, int height, material background, mass_format format) noexcept(false)
+:   m_width{width}
+,   m_height{height}
+,   m_chunks_x{(width + chunk_size - 1) / chunk_size}
+,   m_chunks_y{(height + chunk_size - 1) / chunk_size}
+,   m_kernel{&active_flow_kernel()}
+,   m_background{background} {
+
+    if (width < 1 || height < 1) {
+        throw std::invalid_argument("sparse_world must be at least 1x1, got " + std::to_string(width) + "x" + std::to_string(height));
+    }
+
+    if (background != material::AIR && background != material::GROUND) {
+        throw std::invalid_argument("sparse_world background must be air or ground");
+    }
+
+    // the chunks only have float planes and run the float kernels
+    if (format != mass_format::FLOAT32) {
+        throw std::invalid_argument("sparse_world only holds FLOAT32 mass, a FIXED16 world needs a water_grid");
+    }
+
+    // the air sentinel for each kind of edge chunk, see edge_kind
+    for (int kind = 0; kind < 4; kind++) {
+        m_air[kind] = std::make_unique<sparse_chunk>();
+
+        auto const chunk_x = (kind & 1) ? m_chunks_x - 1 : 0;
+        auto const chunk_y = (kind & 2) ? m_chunks_y - 1 : 0;
+        make_air(*m_air[kind], chunk_x, chunk_y);
+    }
+
+    m_ground = std::make_unique<sparse_chunk>();
+    make_ground(*m_ground);
+}
+
+//------------------------------------------------------------
+sparse_world::sparse_world(world_file const & file, material background) noexcept(false)
+:   sparse_world(file.header().width - 2, file.header().height - 2, background, file.header().grid_format()) {
+
+    for (int chunk_y = 0; chunk_y < m_chunks_y; chunk_y++) {
+        for (int chunk_x = 0; chunk_x < m_chunks_x; chunk_x++) {
+            load_chunk(file, chunk_x, chunk_y);
+        }
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+sparse_world::step() {
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.wake");
+        grow_around_water();
+        wake_chunks();
+    }
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.flow");
+        for (auto * chunk : m_awake) {
+            fill_halo(*chunk);
+            flow_chunk(*chunk);
+        }
+    }
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.commit");
+        for (auto * chunk : m_awake) {
+            commit_chunk(*chunk);
+        }
+    }
+
+    AQUABLOCK_PROFILE_SCOPE("sparse.shrink");
+    shrink();
+}
+
+//------------------------------------------------------------
+void
+sparse_world::step(thread_pool & pool) {
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.wake");
+        grow_around_water();
+        wake_chunks();
+    }
+
+    // a chunk only reads its neighbours while filling its halo and only
+    // writes its own cells, so halo and flow can share one phase
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.flow");
+        pool.run(m_awake.size(), [this](std::size_t i) {
+            fill_halo(*m_awake[i]);
+            flow_chunk(*m_awake[i]);
+        });
+    }
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("sparse.commit");
+        pool.run(m_awake.size(), [this](std::size_t i) {
+            commit_chunk(*m_awake[i]);
+        });
+    }
+
+    AQUABLOCK_PROFILE_SCOPE("sparse.shrink");
+    shrink();
+}
+
+//------------------------------------------------------------
+void
+sparse_world::set_kernel(flow_kernel const & kernel) {
+    m_kernel = &kernel;
+}
+
+//------------------------------------------------------------
+flow_kernel const &
+sparse_world::kernel() const {
+    return *m_kernel;
+}
+
+//------------------------------------------------------------
+void
+sparse_world::set_ground(int x, int y) {
+    set_cell(x, y, material::GROUND, 0.0f);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::set_air(int x, int y) {
+    set_cell(x, y, material::AIR, 0.0f);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::set_water(int x, int y, float mass) {
+    set_cell(x, y, material::WATER, mass);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::fill_ground(int x_begin, int y_begin, int x_end, int y_end) {
+    fill_region(x_begin, y_begin, x_end, y_end, material::GROUND);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::fill_air(int x_begin, int y_begin, int x_end, int y_end) {
+    fill_region(x_begin, y_begin, x_end, y_end, material::AIR);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::clear() {
+    // back to nothing but background, which is all that is not stored
+    m_chunks.clear();
+    m_pool.release_all();
+    m_stored.clear();
+    m_awake.clear();
+}
+
+//------------------------------------------------------------
+void
+sparse_world::clear_water() {
+    for (auto * chunk : m_stored) {
+        if (!chunk->water) continue;
+
+        for (int y = 0; y < chunk_size; y++) {
+            for (int x = 0; x < chunk_size; x++) {
+                auto const i = sparse_chunk::index(x, y);
+
+                if (chunk->types[i] == material::WATER) {
+                    chunk->types[i] = material::AIR;
+                    chunk->mass[i] = 0.0f;
+                    chunk->mass_next[i] = 0.0f;
+                }
+            }
+        }
+
+        chunk->water = 0;
+        chunk->dirty = 1;
+    }
+}
+
+//------------------------------------------------------------
+material
+sparse_world::material_at(int x, int y) const {
+    if (!in_world(x, y)) return material::GROUND;
+    return chunk_at(x / chunk_size, y / chunk_size).types[sparse_chunk::index(x % chunk_size, y % chunk_size)];
+}
+
+//------------------------------------------------------------
+float
+sparse_world::mass_at(int x, int y) const {
+    if (!in_world(x, y)) return 0.0f;
+    return chunk_at(x / chunk_size, y / chunk_size).mass[sparse_chunk::index(x % chunk_size, y % chunk_size)];
+}
+
+//------------------------------------------------------------
+float
+sparse_world::mass_next_at(int x, int y) const {
+    if (!in_world(x, y)) return 0.0f;
+    return chunk_at(x / chunk_size, y / chunk_size).mass_next[sparse_chunk::index(x % chunk_size, y % chunk_size)];
+}
+
+//------------------------------------------------------------
+bool
+sparse_world::in_world(int x, int y) const {
+    return x >= 0 && y >= 0 && x < m_width && y < m_height;
+}
+
+//------------------------------------------------------------
+material
+sparse_world::background() const {
+    return m_background;
+}
+
+//------------------------------------------------------------
+int
+sparse_world::width() const {
+    return m_width;
+}
+
+//------------------------------------------------------------
+int
+sparse_world::height() const {
+    return m_height;
+}
+
+//------------------------------------------------------------
+std::size_t
+sparse_world::chunk_count() const {
+    return m_pool.in_use();
+}
+
+//------------------------------------------------------------
+std::size_t
+sparse_world::awake_chunk_count() const {
+    return m_awake.size();
+}
+
+//------------------------------------------------------------
+std::size_t
+sparse_world::memory_bytes() const {
+    // a node per entry holds the key, the value and the next pointer
+    auto const map_bytes = m_chunks.bucket_count() * sizeof(void *) + m_chunks.size() * (sizeof(key) + 2 * sizeof(void *));
+    auto const sentinel_bytes = 5 * sizeof(sparse_chunk);
+
+    auto const list_bytes = (m_stored.capacity() + m_awake.capacity()) * sizeof(sparse_chunk *);
+
+    return m_pool.memory_bytes() + map_bytes + sentinel_bytes + list_bytes;
+}
+
+//------------------------------------------------------------
+sparse_world::key
+sparse_world::make_key(int chunk_x, int chunk_y) {
+    return (static_cast<key>(static_cast<std::uint32_t>(chunk_x)) << 32) | static_cast<std::uint32_t>(chunk_y);
+}
+
+//------------------------------------------------------------
+bool
+sparse_world::chunk_in_world(int chunk_x, int chunk_y) const {
+    return chunk_x >= 0 && chunk_y >= 0 && chunk_x < m_chunks_x && chunk_y < m_chunks_y;
+}
+
+//------------------------------------------------------------
+// bit 0 - the chunk hangs over the right edge, bit 1 - over the bottom
+int
+sparse_world::edge_kind(int chunk_x, int chunk_y) const {
+    bool const right = chunk_x == m_chunks_x - 1 && m_width % chunk_size != 0;
+    bool const bottom = chunk_y == m_chunks_y - 1 && m_height % chunk_size != 0;
+    return (right ? 1 : 0) | (bottom ? 2 : 0);
+}
+
+//------------------------------------------------------------
+int
+sparse_world::outside_cells(int chunk_x, int chunk_y) const {
+    auto const inside_x = std::min(chunk_size, m_width - chunk_x * chunk_size);
+    auto const inside_y = std::min(chunk_size, m_height - chunk_y * chunk_size);
+    return cells_per_chunk - inside_x * inside_y;
+}
+
+//------------------------------------------------------------
+sparse_chunk const &
+sparse_world::chunk_at(int chunk_x, int chunk_y) const {
+    if (!chunk_in_world(chunk_x, chunk_y)) return *m_ground;
+
+    auto const it = m_chunks.find(make_key(chunk_x, chunk_y));
+    return (it != m_chunks.end()) ? *it->second : *sentinel(chunk_x, chunk_y, m_background);
+}
+
+//------------------------------------------------------------
+// the chunk allocated at these coordinates, nullptr for a sentinel
+sparse_chunk *
+sparse_world::find(int chunk_x, int chunk_y) const {
+    auto const it = m_chunks.find(make_key(chunk_x, chunk_y));
+    return (it != m_chunks.end() && !is_sentinel(it->second)) ? it->second : nullptr;
+}
+
+//------------------------------------------------------------
+sparse_chunk *
+sparse_world::sentinel(int chunk_x, int chunk_y, material type) const {
+    return (type == material::GROUND) ? m_ground.get() : m_air[edge_kind(chunk_x, chunk_y)].get();
+}
+
+//------------------------------------------------------------
+bool
+sparse_world::is_sentinel(sparse_chunk const * chunk) const {
+    return chunk == m_ground.get() || chunk == m_air[0].get() || chunk == m_air[1].get() || chunk == m_air[2].get() || chunk == m_air[3].get();
+}
+
+//------------------------------------------------------------
+// the stored chunk at these coordinates, allocating it from the sentinel
+// it stands in for if there is not one yet
+sparse_chunk *
+sparse_world::materialise(int chunk_x, int chunk_y) {
+    auto & slot = m_chunks[make_key(chunk_x, chunk_y)];
+
+    if (slot != nullptr && !is_sentinel(slot)) {
+        return slot;
+    }
+
+    auto const * source = (slot != nullptr) ? slot : sentinel(chunk_x, chunk_y, m_background);
+    auto * chunk = m_pool.allocate();
+
+    *chunk = *source;
+    chunk->chunk_x = chunk_x;
+    chunk->chunk_y = chunk_y;
+    chunk->stored_index = m_stored.size();
+    m_stored.push_back(chunk);
+
+    slot = chunk;
+    return chunk;
+}
+
+//------------------------------------------------------------
+// back to the pool, the map entry is up to the caller
+void
+sparse_world::release(sparse_chunk * chunk) {
+    auto * last = m_stored.back();
+    last->stored_index = chunk->stored_index;
+    m_stored[chunk->stored_index] = last;
+    m_stored.pop_back();
+
+    m_pool.release(chunk);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::set_cell(int x, int y, material type, float mass) {
+    if (!in_world(x, y)) return;
+
+    auto const chunk_x = x / chunk_size;
+    auto const chunk_y = y / chunk_size;
+    auto const i = sparse_chunk::index(x % chunk_size, y % chunk_size);
+
+    // no need to allocate a chunk to write what its sentinel already says
+    auto const & current = chunk_at(chunk_x, chunk_y);
+    if (is_sentinel(&current) && type != material::WATER && current.types[i] == type) return;
+
+    auto * chunk = materialise(chunk_x, chunk_y);
+
+    chunk->ground_count += (type == material::GROUND) - (chunk->types[i] == material::GROUND);
+    chunk->types[i] = type;
+    chunk->mass[i] = mass;
+    chunk->mass_next[i] = mass;
+    chunk->dirty = 1;
+    chunk->idle_ticks = 0;
+
+    if (type == material::WATER) {
+        chunk->water = 1;
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::mark_neighbours_dirty(int chunk_x, int chunk_y) {
+    for (int y = chunk_y - 1; y <= chunk_y + 1; y++) {
+        for (int x = chunk_x - 1; x <= chunk_x + 1; x++) {
+            if (auto * chunk = find(x, y)) {
+                chunk->dirty = 1;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------
+// water can only move into the chunks left, right and below of it, so
+// those are allocated if they are air and something around the water moved
+void
+sparse_world::grow_around_water() {
+    std::vector<key> wanted;
+
+    for (auto const * chunk : m_stored) {
+        if (!chunk->water) continue;
+
+        bool dirty = false;
+        for (int y = chunk->chunk_y - 1; y <= chunk->chunk_y + 1; y++) {
+            for (int x = chunk->chunk_x - 1; x <= chunk->chunk_x + 1; x++) {
+                auto const * other = find(x, y);
+                dirty |= other != nullptr && other->dirty;
+            }
+        }
+
+        if (!dirty) continue;
+
+        int const targets[3][2] = {
+            {chunk->chunk_x - 1, chunk->chunk_y},
+            {chunk->chunk_x + 1, chunk->chunk_y},
+            {chunk->chunk_x, chunk->chunk_y + 1},
+        };
+
+        for (auto const & target : targets) {
+            if (!chunk_in_world(target[0], target[1])) continue;
+
+            auto const * other = &chunk_at(target[0], target[1]);
+            if (other != m_ground.get() && is_sentinel(other)) {
+                wanted.push_back(make_key(target[0], target[1]));
+            }
+        }
+    }
+
+    for (auto const k : wanted) {
+        materialise(static_cast<int>(static_cast<std::int32_t>(k >> 32)), static_cast<int>(static_cast<std::int32_t>(k & 0xffffffffu)));
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::wake_chunks() {
+    m_awake.clear();
+
+    auto dirty_at = [this](int x, int y) {
+        auto const * chunk = find(x, y);
+        return chunk != nullptr && chunk->dirty;
+    };
+
+    auto water_at = [this](int x, int y) {
+        auto const * chunk = find(x, y);
+        return chunk != nullptr && chunk->water;
+    };
+
+    for (auto * chunk : m_stored) {
+        auto const cx = chunk->chunk_x;
+        auto const cy = chunk->chunk_y;
+
+        // woken by any dirty chunk in the 3x3 around it
+        bool dirty = false;
+        for (int y = cy - 1; y <= cy + 1; y++) {
+            for (int x = cx - 1; x <= cx + 1; x++) {
+                dirty |= dirty_at(x, y);
+            }
+        }
+
+        // water can only arrive from the chunk itself, either side or above
+        bool const water = chunk->water || water_at(cx - 1, cy) || water_at(cx + 1, cy) || water_at(cx, cy - 1);
+
+        chunk->awake = dirty && water;
+        if (chunk->awake) {
+            m_awake.push_back(chunk);
+        }
+    }
+
+    for (auto * chunk : m_stored) {
+        chunk->dirty = 0;
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::fill_halo(sparse_chunk & chunk) const {
+    constexpr int size = chunk_size;
+    constexpr int halo_x = sparse_chunk::halo_x;
+
+    // copies count cells of a row of source, starting at its own cell
+    // (source_x, source_y), into the padded cells starting at (x, y)
+    auto copy = [&chunk](int x, int y, sparse_chunk const & source, int source_x, int source_y, int count) {
+        auto const from = sparse_chunk::index(source_x, source_y);
+        auto const to = static_cast<std::size_t>(x) + static_cast<std::size_t>(y) * sparse_chunk::padded_width;
+
+        std::copy_n(source.types + from, count, chunk.types + to);
+        std::copy_n(source.mass + from, count, chunk.mass + to);
+    };
+
+    auto const cx = chunk.chunk_x;
+    auto const cy = chunk.chunk_y;
+    auto const right = halo_x + size;
+    auto const bottom = sparse_chunk::padded_height - 1;
+
+    // row above, with the corners from the diagonal chunks
+    copy(0, 0, chunk_at(cx - 1, cy - 1), size - halo_x, size - 1, halo_x);
+    copy(halo_x, 0, chunk_at(cx, cy - 1), 0, size - 1, size);
+    copy(right, 0, chunk_at(cx + 1, cy - 1), 0, size - 1, halo_x);
+
+    // row below
+    copy(0, bottom, chunk_at(cx - 1, cy + 1), size - halo_x, 0, halo_x);
+    copy(halo_x, bottom, chunk_at(cx, cy + 1), 0, 0, size);
+    copy(right, bottom, chunk_at(cx + 1, cy + 1), 0, 0, halo_x);
+
+    // columns either side
+    auto const & left_chunk = chunk_at(cx - 1, cy);
+    auto const & right_chunk = chunk_at(cx + 1, cy);
+
+    for (int y = 0; y < size; y++) {
+        copy(0, y + 1, left_chunk, size - halo_x, y, halo_x);
+        copy(right, y + 1, right_chunk, 0, y, halo_x);
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::flow_chunk(sparse_chunk & chunk) const {
+    grid_planes const planes {
+        static_cast<std::size_t>(sparse_chunk::padded_width),
+        static_cast<std::size_t>(sparse_chunk::padded_height),
+        chunk.types,
+        chunk.mass,
+        chunk.mass_next,
+        nullptr,
+        nullptr};
+
+    // the halo keeps the span two cells clear of either side, so every row
+    // is a fixed width, fixed span chunk_flow_row
+    auto const flow_row = m_kernel->chunk_flow_row(planes.width);
+    auto const x_begin = static_cast<std::size_t>(sparse_chunk::halo_x);
+
+    // the halo row above only brings its down flows in, and the last row
+    // leaves the chunk below alone, as in water_grid::flow_chunk_row
+    bool moved = flow_row(planes, 0, x_begin, flow_writes::DOWN);
+
+    auto const last = static_cast<std::size_t>(chunk_size);
+
+    for (std::size_t y = 1; y < last; y++) {
+        moved |= flow_row(planes, y, x_begin, flow_writes::ALL);
+    }
+
+    moved |= flow_row(planes, last, x_begin, flow_writes::ROW);
+
+    if (moved) {
+        chunk.dirty = 1;
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::commit_chunk(sparse_chunk & chunk) const {
+    grid_planes const planes {
+        static_cast<std::size_t>(sparse_chunk::padded_width),
+        static_cast<std::size_t>(sparse_chunk::padded_height),
+        chunk.types,
+        chunk.mass,
+        chunk.mass_next,
+        nullptr,
+        nullptr};
+
+    bool water = false;
+
+    for (int y = 0; y < chunk_size; y++) {
+        water |= m_kernel->commit(planes, sparse_chunk::index(0, y), sparse_chunk::index(chunk_size, y));
+    }
+
+    chunk.water = water;
+}
+
+//------------------------------------------------------------
+// hands chunks that have been plain air or plain ground for a while back
+// to the pool. they did not change, so no neighbour needs waking
+void
+sparse_world::shrink() {
+    // backwards, as releasing moves the last stored chunk into the gap
+    for (auto i = m_stored.size(); i-- > 0;) {
+        auto * chunk = m_stored[i];
+
+        if (chunk->water || chunk->dirty) {
+            chunk->idle_ticks = 0;
+            continue;
+        }
+
+        bool const air = chunk->ground_count == outside_cells(chunk->chunk_x, chunk->chunk_y);
+        bool const ground = chunk->ground_count == cells_per_chunk;
+
+        if ((!air && !ground) || ++chunk->idle_ticks < release_after) {
+            continue;
+        }
+
+        auto const type = ground ? material::GROUND : material::AIR;
+        auto const it = m_chunks.find(make_key(chunk->chunk_x, chunk->chunk_y));
+
+        if (type == m_background) {
+            m_chunks.erase(it);
+        } else {
+            it->second = sentinel(chunk->chunk_x, chunk->chunk_y, type);
+        }
+
+        release(chunk);
+    }
+}
+
+//------------------------------------------------------------
+void
+sparse_world::fill_region(int x_begin, int y_begin, int x_end, int y_end, material type) {
+    x_begin = std::max(x_begin, 0);
+    y_begin = std::max(y_begin, 0);
+    x_end = std::min(x_end, m_width);
+    y_end = std::min(y_end, m_height);
+
+    for (int chunk_y = y_begin / chunk_size; chunk_y * chunk_size < y_end; chunk_y++) {
+        for (int chunk_x = x_begin / chunk_size; chunk_x * chunk_size < x_end; chunk_x++) {
+            auto const cell_x = chunk_x * chunk_size;
+            auto const cell_y = chunk_y * chunk_size;
+
+            // a chunk hanging over the edge counts as covered when the
+            // region reaches the edge, the rest of it is outside anyway
+            bool const covered =
+                x_begin <= cell_x && std::min(cell_x + chunk_size, m_width) <= x_end &&
+                y_begin <= cell_y && std::min(cell_y + chunk_size, m_height) <= y_end;
+
+            if (!covered) {
+                for (int y = std::max(y_begin, cell_y); y < std::min(y_end, cell_y + chunk_size); y++) {
+                    for (int x = std::max(x_begin, cell_x); x < std::min(x_end, cell_x + chunk_size); x++) {
+                        set_cell(x, y, type, 0.0f);
+                    }
+                }
+                continue;
+            }
+
+            // the whole chunk becomes a sentinel, nothing allocated. the
+            // background one is not stored at all
+            auto * stand_in = sentinel(chunk_x, chunk_y, type);
+            auto const it = m_chunks.find(make_key(chunk_x, chunk_y));
+
+            if (it == m_chunks.end()) {
+                if (type == m_background) continue;
+                m_chunks.emplace(make_key(chunk_x, chunk_y), stand_in);
+            } else {
+                if (it->second == stand_in) continue;
+                if (!is_sentinel(it->second)) release(it->second);
+
+                if (type == m_background) {
+                    m_chunks.erase(it);
+                } else {
+                    it->second = stand_in;
+                }
+            }
+
+            mark_neighbours_dirty(chunk_x, chunk_y);
+        }
+    }
+}
+
+//------------------------------------------------------------
+// the cells of one chunk out of a world file. a chunk of nothing but air
+// or nothing but ground is left to a sentinel, anything else is stored
+void
+sparse_world::load_chunk(world_file const & file, int chunk_x, int chunk_y) {
+    auto const & header = file.header();
+    auto const * data = file.mapping()->data();
+    auto const * types = reinterpret_cast<material const *>(data + header.material_offset);
+    auto const * mass = reinterpret_cast<float const *>(data + header.mass_offset);
+    auto const * mass_next = reinterpret_cast<float const *>(data + header.mass_next_offset);
+
+    auto const x_begin = chunk_x * chunk_size;
+    auto const y_begin = chunk_y * chunk_size;
+    auto const x_end = std::min(x_begin + chunk_size, m_width);
+    auto const y_end = std::min(y_begin + chunk_size, m_height);
+
+    // the world's cell (x, y) is the file's (x + 1, y + 1), inside the
+    // ground border of the grid that saved it
+    auto const stride = static_cast<std::size_t>(header.width);
+    auto at = [stride](int x, int y) {
+        return static_cast<std::size_t>(x + 1) + static_cast<std::size_t>(y + 1) * stride;
+    };
+
+    auto const first = types[at(x_begin, y_begin)];
+    bool uniform = first != material::WATER;
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int x = x_begin; x < x_end; x++) {
+            auto const i = at(x, y);
+            auto const type = types[i];
+
+            if (type != material::AIR && type != material::GROUND && type != material::WATER) {
+                throw std::runtime_error(file.path() + " holds " + properties_of(type).name + ", sparse_world only runs air, ground and water");
+            }
+
+            uniform = uniform && type == first && is_zero(mass[i]) && is_zero(mass_next[i]);
+        }
+    }
+
+    if (uniform) {
+        if (first != m_background) fill_region(x_begin, y_begin, x_end, y_end, first);
+        return;
+    }
+
+    auto * chunk = materialise(chunk_x, chunk_y);
+    auto ground = outside_cells(chunk_x, chunk_y);
+    bool water = false;
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int x = x_begin; x < x_end; x++) {
+            auto const from = at(x, y);
+            auto const to = sparse_chunk::index(x - x_begin, y - y_begin);
+
+            chunk->types[to] = types[from];
+            chunk->mass[to] = mass[from];
+            chunk->mass_next[to] = mass_next[from];
+
+            ground += types[from] == material::GROUND;
+            water |= types[from] == material::WATER;
+        }
+    }
+
+    chunk->ground_count = ground;
+    chunk->water = water;
+    chunk->dirty = 1;
+    chunk->idle_ticks = 0;
+}
+
+//------------------------------------------------------------
+// air, with ground wherever the chunk hangs over the edge of the world
+void
+sparse_world::make_air(sparse_chunk & chunk, int chunk_x, int chunk_y) const {
+    fill(chunk, material::AIR);
+
+    auto const inside_x = std::min(chunk_size, m_width - chunk_x * chunk_size);
+    auto const inside_y = std::min(chunk_size, m_height - chunk_y * chunk_size);
+
+    for (int y = 0; y < chunk_size; y++) {
+        for (int x = 0; x < chunk_size; x++) {
+            if (x >= inside_x || y >= inside_y) {
+                chunk.types[sparse_chunk::index(x, y)] = material::GROUND;
+            }
+        }
+    }
+
+    chunk.ground_count = outside_cells(chunk_x, chunk_y);
+}
+
+//------------------------------------------------------------
+void
+sparse_world::make_ground(sparse_chunk & chunk) {
+    fill(chunk, material::GROUND);
+    chunk.ground_count = cells_per_chunk;
+}
+
+//------------------------------------------------------------
+void
+sparse_world::fill(sparse_chunk & chunk, material type) {
+    std::fill(std::begin(chunk.types), std::end(chunk.types), type);
+    std::fill(std::begin(chunk.mass), std::end(chunk.mass), 0.0f);
+    std::fill(std::begin(chunk.mass_next), std::end(chunk.mass_next), 0.0f);
+
+    chunk.chunk_x = 0;
+    chunk.chunk_y = 0;
+    chunk.stored_index = 0;
+    chunk.ground_count = 0;
+    chunk.idle_ticks = 0;
+    chunk.dirty = 0;
+    chunk.awake = 0;
+    chunk.water = 0;
+}
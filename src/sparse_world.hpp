@@ -0,0 +1,191 @@
+#ifndef SPARSE_WORLD_HPP
+#define SPARSE_WORLD_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// my
+#include "flow_kernel.hpp"
+#include "material.hpp"
+#include "slab_pool.hpp"
+
+class thread_pool;
+class world_file;
+
+//------------------------------------------------------------
+//                       sparse_chunk                       //
+//------------------------------------------------------------
+
+// chunk_size x chunk_size cells with a halo of copies of the neighbouring
+// cells - two columns either side and one row above and below - so the
+// flow kernels can run on a chunk as if it was a small grid. the halo is
+// refreshed from the neighbours before the chunk flows.
+struct sparse_chunk {
+    static constexpr int size = 32;
+    static constexpr int halo_x = 2;
+    static constexpr int halo_y = 1;
+    static constexpr int padded_width = size + 2 * halo_x;
+    static constexpr int padded_height = size + 2 * halo_y;
+    static constexpr int padded_cells = padded_width * padded_height;
+    static_assert(size == flow_chunk_span && halo_x > 1, "chunks flow with flow_kernel::chunk_flow_row");
+
+    static std::size_t index(int local_x, int local_y) {
+        return static_cast<std::size_t>(local_x + halo_x) + static_cast<std::size_t>(local_y + halo_y) * padded_width;
+    }
+
+    material types[padded_cells];
+    float mass[padded_cells];
+    float mass_next[padded_cells];
+
+    int chunk_x;
+    int chunk_y;
+    std::size_t stored_index;
+    int ground_count;
+    int idle_ticks;
+    std::uint8_t dirty;
+    std::uint8_t awake;
+    std::uint8_t water;
+
+}; // sparse_chunk
+
+//------------------------------------------------------------
+//                       sparse_world                       //
+//------------------------------------------------------------
+
+// water simulation over a huge, mostly empty world. only chunks that hold
+// something other than plain air or solid ground are stored: they live in
+// a hash map keyed by chunk coordinates and come from a slab_pool. a chunk
+// that is all air or all ground maps to a shared sentinel instead, and a
+// chunk of the background material - air, or ground for a world that is
+// mostly rock - is not in the map at all. so memory follows the region that
+// actually has water or carved out ground, not the bounding box.
+//
+// the world is width x height cells and everything outside it is ground,
+// so a sparse_world of w x h behaves exactly like a water_grid of
+// (w + 2) x (h + 2) with the cells shifted by one.
+//
+// air chunks next to moving water are allocated so the water can flow into
+// them, and handed back to the pool once they have sat empty for
+// release_after ticks, so a chunk beside a falling column is not freed and
+// allocated again every tick. sleeping works as in water_grid: only chunks
+// with a dirty chunk around them and water in or next to them are stepped,
+// and that is exact.
+//
+// it runs the flow kernels on its chunks, so it knows air, ground and water
+// and nothing else, and mass is always FLOAT32 - asking for FIXED16 or
+// loading a world file with either throws. aquablock_sparse runs one and
+// with --verify checks it against a water_grid.
+class sparse_world final {
+public:
+    static constexpr int chunk_size = sparse_chunk::size;
+    static constexpr int release_after = 64;
+
+//                         RAII                             //
+//------------------------------------------------------------
+    sparse_world(int width, int height, material background = material::AIR, mass_format format = mass_format::FLOAT32) noexcept(false);
+
+    // the inside of the grid saved in file, without its ground border, so
+    // a w x h file gives a (w - 2) x (h - 2) world. the whole material
+    // plane is read, but only chunks that are not all background stored
+    explicit sparse_world(world_file const & file, material background = material::AIR) noexcept(false);
+
+    sparse_world(sparse_world const &) = delete;
+    sparse_world & operator=(sparse_world const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    void step();
+    void step(thread_pool & pool);
+
+    void set_kernel(flow_kernel const & kernel);
+    flow_kernel const & kernel() const;
+
+    void set_ground(int x, int y);
+    void set_air(int x, int y);
+    void set_water(int x, int y, float mass);
+
+    // fill a whole rectangle, storing the chunks it covers as sentinels
+    // without allocating them. covering a chunk with the background drops it
+    // from the map, anything else costs one map entry per chunk
+    void fill_ground(int x_begin, int y_begin, int x_end, int y_end);
+    void fill_air(int x_begin, int y_begin, int x_end, int y_end);
+
+    // back to nothing but background
+    void clear();
+    void clear_water();
+
+    material material_at(int x, int y) const;
+    float mass_at(int x, int y) const;
+    float mass_next_at(int x, int y) const;
+    bool in_world(int x, int y) const;
+
+    material background() const;
+    int width() const;
+    int height() const;
+
+    std::size_t chunk_count() const;
+    std::size_t awake_chunk_count() const;
+
+    // pool slabs, hash map and bookkeeping
+    std::size_t memory_bytes() const;
+
+private:
+    using key = std::uint64_t;
+
+    static key make_key(int chunk_x, int chunk_y);
+
+    bool chunk_in_world(int chunk_x, int chunk_y) const;
+    int edge_kind(int chunk_x, int chunk_y) const;
+    int outside_cells(int chunk_x, int chunk_y) const;
+    sparse_chunk const & chunk_at(int chunk_x, int chunk_y) const;
+    sparse_chunk * find(int chunk_x, int chunk_y) const;
+    sparse_chunk * sentinel(int chunk_x, int chunk_y, material type) const;
+    bool is_sentinel(sparse_chunk const * chunk) const;
+    sparse_chunk * materialise(int chunk_x, int chunk_y);
+    void release(sparse_chunk * chunk);
+    void set_cell(int x, int y, material type, float mass);
+    void mark_neighbours_dirty(int chunk_x, int chunk_y);
+
+    void grow_around_water();
+    void wake_chunks();
+    void fill_halo(sparse_chunk & chunk) const;
+    void flow_chunk(sparse_chunk & chunk) const;
+    void commit_chunk(sparse_chunk & chunk) const;
+    void shrink();
+
+    void fill_region(int x_begin, int y_begin, int x_end, int y_end, material type);
+    void load_chunk(world_file const & file, int chunk_x, int chunk_y);
+    void make_air(sparse_chunk & chunk, int chunk_x, int chunk_y) const;
+    static void make_ground(sparse_chunk & chunk);
+    static void fill(sparse_chunk & chunk, material type);
+
+//                         data                             //
+//------------------------------------------------------------
+    int m_width;
+    int m_height;
+    int m_chunks_x;
+    int m_chunks_y;
+    flow_kernel const * m_kernel;
+    material m_background;
+
+    slab_pool<sparse_chunk, 16> m_pool;
+    std::unordered_map<key, sparse_chunk *> m_chunks;
+
+    // shared stand ins, never written after construction. the air ones are
+    // indexed by edge_kind: a chunk that hangs over the right or bottom edge
+    // of the world has ground where the world ends
+    std::unique_ptr<sparse_chunk> m_air[4];
+    std::unique_ptr<sparse_chunk> m_ground;
+
+    // every allocated chunk, so a tick never walks the sentinel entries,
+    // and the ones that are awake this tick, rebuilt by wake_chunks
+    std::vector<sparse_chunk *> m_stored;
+    std::vector<sparse_chunk *> m_awake;
+
+}; // sparse_world
+
+#endif // SPARSE_WORLD_HPP
@@ -0,0 +1,65 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+// std
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+//------------------------------------------------------------
+//                        spsc_queue                        //
+//------------------------------------------------------------
+
+// fixed capacity ring buffer for one producer thread and one consumer
+// thread. push and pop are wait free - each is a couple of atomic loads
+// and one store, and push fails instead of blocking when the ring is full.
+template <typename T, std::size_t capacity>
+class spsc_queue final {
+    static_assert(capacity > 1 && (capacity & (capacity - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+public:
+//                       functions                         //
+//------------------------------------------------------------
+    // producer side, false if the queue is full
+    bool push(T const & value) {
+        auto const tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_head.load(std::memory_order_acquire) == capacity) {
+            return false;
+        }
+
+        m_slots[tail & (capacity - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false if the queue is empty
+    bool pop(T & value) {
+        auto const head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = m_slots[head & (capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool empty() const {
+        return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::array<T, capacity> m_slots {};
+
+    // kept on separate cache lines so the two threads do not share one
+    alignas(64) std::atomic<std::size_t> m_head {0};
+    alignas(64) std::atomic<std::size_t> m_tail {0};
+
+}; // spsc_queue
+
+#endif // SPSC_QUEUE_HPP
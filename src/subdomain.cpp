@@ -0,0 +1,292 @@
+#include "subdomain.hpp"
+
+// std
+#include <stdexcept>
+#include <string>
+
+// my
+#include "halo_transport.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+//------------------------------------------------------------
+int
+checked_ranks(int ranks, int cells, int halo, char const * axis) {
+    // a rank has to own at least a halo's worth, or its neighbours' halos
+    // would reach past it to ranks they do not talk to
+    if (ranks < 1 || cells / ranks < halo) {
+        throw std::invalid_argument(std::string("can not split ") + std::to_string(cells) + " cells in " + axis + " between " + std::to_string(ranks) + " ranks");
+    }
+    return ranks;
+}
+
+//------------------------------------------------------------
+int
+checked_rank(int rank, int ranks) {
+    if (rank < 0 || rank >= ranks) {
+        throw std::invalid_argument("rank " + std::to_string(rank) + " is not one of the " + std::to_string(ranks));
+    }
+    return rank;
+}
+
+//------------------------------------------------------------
+int
+split(int cells, int parts, int part) {
+    return static_cast<int>(static_cast<long long>(cells) * part / parts);
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                        subdomain                         //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+subdomain::subdomain(int width, int height, int ranks_x, int ranks_y, int rank, halo_transport & transport, mass_format format) noexcept(false)
+:   m_width{width}
+,   m_height{height}
+,   m_ranks_x{checked_ranks(ranks_x, width, halo_x, "x")}
+,   m_ranks_y{checked_ranks(ranks_y, height, halo_y, "y")}
+,   m_rank{checked_rank(rank, ranks_x * ranks_y)}
+,   m_rank_x{rank % ranks_x}
+,   m_rank_y{rank / ranks_x}
+,   m_transport{transport}
+,   m_x0{split(width, ranks_x, m_rank_x)}
+,   m_y0{split(height, ranks_y, m_rank_y)}
+,   m_x1{split(width, ranks_x, m_rank_x + 1)}
+,   m_y1{split(height, ranks_y, m_rank_y + 1)}
+,   m_grid{(m_x1 - m_x0) + 2 * halo_x + 2, (m_y1 - m_y0) + 2 * halo_y + 2, format} {
+
+    seal();
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+subdomain::apply(grid_edit const & edit) {
+    switch (edit.type) {
+        case grid_edit::kind::CLEAR:
+            apply(grid_edit::rect(grid_edit::kind::AIR, 1, 1, m_width - 2, m_height - 2));
+            return;
+
+        // cell by cell with no coordinates, so the same on every rank
+        case grid_edit::kind::CLEAR_WATER:
+        case grid_edit::kind::CLEAR_MATERIAL:
+            edit.apply(m_grid);
+            seal();
+            return;
+
+        case grid_edit::kind::SETTLE:
+            throw std::invalid_argument("settling basins needs the whole grid, it can not be split between ranks");
+
+        default:
+            break;
+    }
+
+    if (edit.area == grid_edit::shape::FLOOD) {
+        throw std::invalid_argument("a flood fill needs the whole grid, it can not be split between ranks");
+    }
+
+    auto local = edit;
+    local.x = local_x(edit.x);
+    local.y = local_y(edit.y);
+    local.x2 = local_x(edit.x2);
+    local.y2 = local_y(edit.y2);
+    local.apply(m_grid);
+
+    // whatever landed on the border of the whole grid goes back to ground
+    seal();
+}
+
+//------------------------------------------------------------
+void
+subdomain::step() {
+    m_grid.step();
+    exchange();
+}
+
+//------------------------------------------------------------
+void
+subdomain::step(thread_pool & pool) {
+    m_grid.step(pool);
+    exchange();
+}
+
+//------------------------------------------------------------
+void
+subdomain::gather(row_sink const & row) {
+    auto const cell_bytes = m_grid.cell_bytes();
+
+    if (m_rank != 0) {
+        auto const row_bytes = static_cast<std::size_t>(m_x1 - m_x0) * cell_bytes;
+        m_out.resize(row_bytes * static_cast<std::size_t>(m_y1 - m_y0));
+
+        for (int y = m_y0; y < m_y1; y++) {
+            m_grid.read_cells(local_x(m_x0), local_y(y), m_x1 - m_x0, m_out.data() + static_cast<std::size_t>(y - m_y0) * row_bytes);
+        }
+
+        m_transport.send(0, m_out.data(), m_out.size());
+        return;
+    }
+
+    // a row at a time, so rank 0 never holds more than one
+    for (int rank = 0; rank < m_ranks_x * m_ranks_y; rank++) {
+        int x0, y0, x1, y1;
+        owned_of(rank, x0, y0, x1, y1);
+
+        m_in.resize(static_cast<std::size_t>(x1 - x0) * cell_bytes);
+
+        for (int y = y0; y < y1; y++) {
+            if (rank == 0) {
+                m_grid.read_cells(local_x(x0), local_y(y), x1 - x0, m_in.data());
+            } else {
+                m_transport.receive(rank, m_in.data(), m_in.size());
+            }
+
+            row(x0, y, x1 - x0, m_in.data());
+        }
+    }
+}
+
+//------------------------------------------------------------
+int
+subdomain::rank() const {
+    return m_rank;
+}
+
+//------------------------------------------------------------
+int
+subdomain::left() const {
+    return m_x0;
+}
+
+//------------------------------------------------------------
+int
+subdomain::top() const {
+    return m_y0;
+}
+
+//------------------------------------------------------------
+int
+subdomain::right() const {
+    return m_x1;
+}
+
+//------------------------------------------------------------
+int
+subdomain::bottom() const {
+    return m_y1;
+}
+
+//------------------------------------------------------------
+water_grid const &
+subdomain::grid() const {
+    return m_grid;
+}
+
+//------------------------------------------------------------
+int
+subdomain::local_x(int x) const {
+    return x - m_x0 + halo_x + 1;
+}
+
+//------------------------------------------------------------
+int
+subdomain::local_y(int y) const {
+    return y - m_y0 + halo_y + 1;
+}
+
+//------------------------------------------------------------
+int
+subdomain::rank_at(int rank_x, int rank_y) const {
+    return rank_x + rank_y * m_ranks_x;
+}
+
+//------------------------------------------------------------
+void
+subdomain::owned_of(int rank, int & x0, int & y0, int & x1, int & y1) const {
+    auto const rank_x = rank % m_ranks_x;
+    auto const rank_y = rank / m_ranks_x;
+
+    x0 = split(m_width, m_ranks_x, rank_x);
+    x1 = split(m_width, m_ranks_x, rank_x + 1);
+    y0 = split(m_height, m_ranks_y, rank_y);
+    y1 = split(m_height, m_ranks_y, rank_y + 1);
+}
+
+//------------------------------------------------------------
+void
+subdomain::exchange() {
+    auto const left = (m_rank_x > 0) ? rank_at(m_rank_x - 1, m_rank_y) : -1;
+    auto const right = (m_rank_x + 1 < m_ranks_x) ? rank_at(m_rank_x + 1, m_rank_y) : -1;
+    auto const up = (m_rank_y > 0) ? rank_at(m_rank_x, m_rank_y - 1) : -1;
+    auto const down = (m_rank_y + 1 < m_ranks_y) ? rank_at(m_rank_x, m_rank_y + 1) : -1;
+
+    auto with_left = [&] { if (left >= 0) swap_columns(left, m_x0, m_x0 - halo_x); };
+    auto with_right = [&] { if (right >= 0) swap_columns(right, m_x1 - halo_x, m_x1); };
+    auto with_up = [&] { if (up >= 0) swap_row(up, m_y0, m_y0 - halo_y); };
+    auto with_down = [&] { if (down >= 0) swap_row(down, m_y1 - halo_y, m_y1); };
+
+    // even ranks take the next one first and odd ranks the one before, so
+    // the pairs line up and nobody waits on a rank busy with someone else
+    if (m_rank_x % 2 == 0) { with_right(); with_left(); } else { with_left(); with_right(); }
+    if (m_rank_y % 2 == 0) { with_down(); with_up(); } else { with_up(); with_down(); }
+}
+
+//------------------------------------------------------------
+void
+subdomain::swap_columns(int peer, int send_x, int receive_x) {
+    auto const row_bytes = static_cast<std::size_t>(halo_x) * m_grid.cell_bytes();
+    auto const bytes = row_bytes * static_cast<std::size_t>(m_y1 - m_y0);
+    m_out.resize(bytes);
+    m_in.resize(bytes);
+
+    for (int y = m_y0; y < m_y1; y++) {
+        m_grid.read_cells(local_x(send_x), local_y(y), halo_x, m_out.data() + static_cast<std::size_t>(y - m_y0) * row_bytes);
+    }
+
+    m_transport.exchange(peer, m_out.data(), m_in.data(), bytes);
+
+    for (int y = m_y0; y < m_y1; y++) {
+        m_grid.write_cells(local_x(receive_x), local_y(y), halo_x, m_in.data() + static_cast<std::size_t>(y - m_y0) * row_bytes);
+    }
+}
+
+//------------------------------------------------------------
+void
+subdomain::swap_row(int peer, int send_y, int receive_y) {
+    // with the halo columns, which the column exchange has just filled in
+    auto const count = (m_x1 - m_x0) + 2 * halo_x;
+    auto const row_bytes = static_cast<std::size_t>(count) * m_grid.cell_bytes();
+
+    for (int row = 0; row < halo_y; row++) {
+        m_out.resize(row_bytes);
+        m_in.resize(row_bytes);
+
+        m_grid.read_cells(local_x(m_x0 - halo_x), local_y(send_y + row), count, m_out.data());
+        m_transport.exchange(peer, m_out.data(), m_in.data(), row_bytes);
+        m_grid.write_cells(local_x(m_x0 - halo_x), local_y(receive_y + row), count, m_in.data());
+    }
+}
+
+//------------------------------------------------------------
+void
+subdomain::seal() {
+    auto const width = m_grid.width();
+    auto const height = m_grid.height();
+
+    // the local cells that are the border of the whole grid or past it,
+    // inclusive. fill_rect only reaches the local interior
+    auto const inside_x0 = local_x(1);
+    auto const inside_x1 = local_x(m_width - 2);
+    auto const inside_y0 = local_y(1);
+    auto const inside_y1 = local_y(m_height - 2);
+
+    if (inside_x0 > 1) m_grid.fill_rect(1, 1, inside_x0 - 1, height - 2, material::GROUND);
+    if (inside_x1 < width - 2) m_grid.fill_rect(inside_x1 + 1, 1, width - 2, height - 2, material::GROUND);
+    if (inside_y0 > 1) m_grid.fill_rect(1, 1, width - 2, inside_y0 - 1, material::GROUND);
+    if (inside_y1 < height - 2) m_grid.fill_rect(1, inside_y1 + 1, width - 2, height - 2, material::GROUND);
+}
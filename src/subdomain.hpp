@@ -0,0 +1,109 @@
+#ifndef SUBDOMAIN_HPP
+#define SUBDOMAIN_HPP
+
+// std
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// my
+#include "flow_kernel.hpp"
+#include "grid_edit.hpp"
+#include "water_grid.hpp"
+
+class halo_transport;
+class thread_pool;
+
+//------------------------------------------------------------
+//                        subdomain                         //
+//------------------------------------------------------------
+
+// one rank's part of a grid too big or too slow for one process. the
+// whole grid is cut into ranks_x by ranks_y rectangles, rank x + y *
+// ranks_x owning one, and each rank steps a water_grid of its own cells
+// plus a halo of its neighbours' around them.
+//
+// a cell's next state depends on the cells up to three either side of it -
+// the right flow of its left neighbour depends on what that one gives to
+// its own left, which with more than one material depends on who else
+// could flow there (see material_kernel.hpp) - and one above and below, so
+// the halo is halo_x columns and halo_y rows. after every tick each rank
+// sends its edge cells to its neighbours and takes theirs into the halo,
+// columns first and then rows including the halo columns, so the corners
+// arrive without talking to the diagonal ranks. every owned cell then
+// ticks from exactly what it would have seen in one grid, and the result
+// is bit for bit the same.
+//
+// outside the owned cells and the halo the local grid is its own ground
+// border, and so is anything past the edge of the whole grid.
+class subdomain final {
+public:
+    static constexpr int halo_x = 3;
+    static constexpr int halo_y = 1;
+
+//                         RAII                             //
+//------------------------------------------------------------
+    subdomain(int width, int height, int ranks_x, int ranks_y, int rank, halo_transport & transport, mass_format format = mass_format::FLOAT32) noexcept(false);
+
+//                       functions                         //
+//------------------------------------------------------------
+    // an edit in whole grid coordinates, made by every rank alike. shapes
+    // that depend on cells elsewhere - flood fills, settle_basins - can not
+    // be split up and throw
+    void apply(grid_edit const & edit);
+
+    // one tick of the local grid then the halo exchange, on every rank
+    void step();
+    void step(thread_pool & pool);
+
+    // every rank calls it. rank 0 is handed every owned row of the whole
+    // grid in turn, in the layout of water_grid::read_cells(), and the rest
+    // send theirs to it and never call row
+    using row_sink = std::function<void(int x, int y, int count, unsigned char const * cells)>;
+    void gather(row_sink const & row);
+
+    int rank() const;
+
+    // the owned cells, whole grid coordinates, end exclusive
+    int left() const;
+    int top() const;
+    int right() const;
+    int bottom() const;
+
+    water_grid const & grid() const;
+
+private:
+    int local_x(int x) const;
+    int local_y(int y) const;
+    int rank_at(int rank_x, int rank_y) const;
+    void owned_of(int rank, int & x0, int & y0, int & x1, int & y1) const;
+
+    void exchange();
+    void swap_columns(int peer, int send_x, int receive_x);
+    void swap_row(int peer, int send_y, int receive_y);
+    void seal();
+
+//                         data                             //
+//------------------------------------------------------------
+    int m_width;
+    int m_height;
+    int m_ranks_x;
+    int m_ranks_y;
+    int m_rank;
+    int m_rank_x;
+    int m_rank_y;
+    halo_transport & m_transport;
+
+    int m_x0;
+    int m_y0;
+    int m_x1;
+    int m_y1;
+
+    water_grid m_grid;
+
+    std::vector<unsigned char> m_out;
+    std::vector<unsigned char> m_in;
+
+}; // subdomain
+
+#endif // SUBDOMAIN_HPP
@@ -0,0 +1,116 @@
+#include "thread_pool.hpp"
+
+// my
+#include "profiler.hpp"
+
+//------------------------------------------------------------
+//                       thread_pool                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+thread_pool::thread_pool(std::size_t thread_count)
+:   m_task{nullptr}
+,   m_count{0}
+,   m_next{0}
+,   m_busy{0}
+,   m_generation{0}
+,   m_stopping{false} {
+
+    // hardware_concurrency is allowed to report 0
+    auto const workers = thread_count > 1 ? thread_count - 1 : 0;
+
+    m_workers.reserve(workers);
+    for (std::size_t i = 0; i < workers; i++) {
+        m_workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+//------------------------------------------------------------
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto & worker : m_workers) {
+        worker.join();
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+thread_pool::run(std::size_t count, std::function<void(std::size_t)> const & task) {
+    if (m_workers.empty() || count <= 1) {
+        for (std::size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next.store(0, std::memory_order_relaxed);
+        m_busy = m_workers.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_task = nullptr;
+}
+
+//------------------------------------------------------------
+std::size_t
+thread_pool::size() const {
+    return m_workers.size() + 1;
+}
+
+//------------------------------------------------------------
+void
+thread_pool::worker_loop() {
+    AQUABLOCK_PROFILE_THREAD("pool");
+    std::uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != seen; });
+
+            if (m_stopping) return;
+            seen = m_generation;
+        }
+
+        {
+            AQUABLOCK_PROFILE_SCOPE("pool.work");
+            drain();
+        }
+
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            last = --m_busy == 0;
+        }
+
+        if (last) {
+            m_done.notify_one();
+        }
+    }
+}
+
+//------------------------------------------------------------
+void
+thread_pool::drain() {
+    // tasks are handed out one at a time so uneven bands balance themselves
+    for (auto i = m_next.fetch_add(1, std::memory_order_relaxed); i < m_count; i = m_next.fetch_add(1, std::memory_order_relaxed)) {
+        (*m_task)(i);
+    }
+}
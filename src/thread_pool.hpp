@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------
+//                       thread_pool                        //
+//------------------------------------------------------------
+
+// fixed set of worker threads that run batches of numbered tasks. the
+// calling thread joins in, so a pool of size 1 has no workers and runs
+// everything inline. tasks must not throw.
+class thread_pool final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool & operator=(thread_pool const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    // runs task(0) .. task(count - 1) and returns once every one of them
+    // has finished, so consecutive calls act as a barrier
+    void run(std::size_t count, std::function<void(std::size_t)> const & task);
+
+    std::size_t size() const;
+
+private:
+    void worker_loop();
+    void drain();
+
+//                         data                             //
+//------------------------------------------------------------
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    std::function<void(std::size_t)> const * m_task;
+    std::size_t m_count;
+    std::atomic<std::size_t> m_next;
+    std::size_t m_busy;
+    std::uint64_t m_generation;
+    bool m_stopping;
+
+}; // thread_pool
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,115 @@
+#include "tick_scheduler.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+// weight of the newest batch in the moving average of the tick cost. an
+// eighth follows a change in load within a few dozen batches but does not
+// jump on one slow batch
+constexpr double cost_weight = 0.125;
+
+} // namespace
+
+//------------------------------------------------------------
+//                      tick_scheduler                      //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+tick_scheduler::tick_scheduler(clock::duration tick_length, clock::duration budget, int max_catch_up, clock::time_point start) noexcept(false)
+:   m_tick_length{tick_length}
+,   m_budget{budget}
+,   m_max_catch_up{max_catch_up}
+,   m_next{start}
+,   m_cost_ns{0.0}
+,   m_dropped{0} {
+
+    if (tick_length <= clock::duration::zero() || budget <= clock::duration::zero() || max_catch_up < 1) {
+        throw std::invalid_argument("tick_scheduler needs a positive tick length and budget and a catch up of at least 1");
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+int
+tick_scheduler::due(clock::time_point now) const {
+    if (now < m_next) return 0;
+
+    auto const backlog = 1 + (now - m_next) / m_tick_length;
+
+    // until a tick has been timed there is nothing to fit to the budget
+    auto fit = static_cast<std::remove_const_t<decltype(backlog)>>(m_max_catch_up);
+    if (m_cost_ns > 0.0) {
+        auto const budget_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_budget).count());
+        fit = std::max<decltype(fit)>(static_cast<decltype(fit)>(budget_ns / m_cost_ns), 1);
+    }
+
+    return static_cast<int>(std::min({backlog, fit, static_cast<decltype(fit)>(m_max_catch_up)}));
+}
+
+//------------------------------------------------------------
+void
+tick_scheduler::ran(int ticks, clock::duration took, clock::time_point now) {
+    if (ticks <= 0) return;
+
+    auto const cost_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count()) / ticks;
+    m_cost_ns = (m_cost_ns > 0.0) ? m_cost_ns + cost_weight * (cost_ns - m_cost_ns) : cost_ns;
+
+    m_next += ticks * m_tick_length;
+
+    // more due than one batch may catch up - drop it all and carry on at
+    // full rate, on the same beat as before
+    if (now >= m_next + m_max_catch_up * m_tick_length) {
+        auto const backlog = 1 + (now - m_next) / m_tick_length;
+        m_next += backlog * m_tick_length;
+        m_dropped += static_cast<std::uint64_t>(backlog);
+    }
+}
+
+//------------------------------------------------------------
+void
+tick_scheduler::restart(clock::time_point now) {
+    m_next = now;
+}
+
+//------------------------------------------------------------
+tick_scheduler::clock::time_point
+tick_scheduler::next() const {
+    return m_next;
+}
+
+//------------------------------------------------------------
+tick_scheduler::clock::duration
+tick_scheduler::tick_length() const {
+    return m_tick_length;
+}
+
+//------------------------------------------------------------
+tick_scheduler::clock::duration
+tick_scheduler::budget() const {
+    return m_budget;
+}
+
+//------------------------------------------------------------
+tick_scheduler::clock::duration
+tick_scheduler::tick_cost() const {
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::nano>(m_cost_ns));
+}
+
+//------------------------------------------------------------
+tick_scheduler::clock::duration
+tick_scheduler::behind(clock::time_point now) const {
+    auto const backlog = std::max(now - m_next, clock::duration::zero());
+    return static_cast<clock::rep>(m_dropped) * m_tick_length + backlog;
+}
+
+//------------------------------------------------------------
+std::uint64_t
+tick_scheduler::dropped_ticks() const {
+    return m_dropped;
+}
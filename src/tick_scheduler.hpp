@@ -0,0 +1,72 @@
+#ifndef TICK_SCHEDULER_HPP
+#define TICK_SCHEDULER_HPP
+
+// std
+#include <chrono>
+#include <cstdint>
+
+//------------------------------------------------------------
+//                      tick_scheduler                      //
+//------------------------------------------------------------
+
+// decides how many fixed length ticks to run at a time so simulated time
+// keeps up with wall time, without ever spending more than a time budget
+// on one batch. it only keeps time, whoever owns it runs the ticks.
+//
+// the cost of a tick is measured as it runs and kept as an exponentially
+// weighted moving average, so a batch holds as many of the due ticks as
+// the budget has room for at the current cost, at least one and at most
+// max_catch_up. a backlog of more than max_catch_up ticks can not be
+// caught up without the batches growing, so it is dropped instead of
+// spiralling, and the simulated time it cost is added to behind().
+class tick_scheduler final {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int default_max_catch_up = 4;
+
+//                         RAII                             //
+//------------------------------------------------------------
+    tick_scheduler(clock::duration tick_length, clock::duration budget, int max_catch_up = default_max_catch_up, clock::time_point start = clock::now()) noexcept(false);
+
+//                       functions                         //
+//------------------------------------------------------------
+    // how many ticks to run now, 0 until the next one is due
+    int due(clock::time_point now) const;
+
+    // after running ticks that took that long, finishing at now
+    void ran(int ticks, clock::duration took, clock::time_point now);
+
+    // the next tick is due at now. for picking up again after the ticks
+    // were left out on purpose, which is not falling behind
+    void restart(clock::time_point now);
+
+    // when the next tick is due
+    clock::time_point next() const;
+
+    clock::duration tick_length() const;
+    clock::duration budget() const;
+
+    // the moving average, 0 until a tick has run
+    clock::duration tick_cost() const;
+
+    // how far simulated time is behind wall time - ticks dropped so far
+    // plus the backlog still due at now
+    clock::duration behind(clock::time_point now) const;
+
+    std::uint64_t dropped_ticks() const;
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    clock::duration m_tick_length;
+    clock::duration m_budget;
+    int m_max_catch_up;
+
+    clock::time_point m_next;
+    double m_cost_ns;
+    std::uint64_t m_dropped;
+
+}; // tick_scheduler
+
+#endif // TICK_SCHEDULER_HPP
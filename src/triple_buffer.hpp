@@ -0,0 +1,66 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+// std
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+//------------------------------------------------------------
+//                      triple_buffer                       //
+//------------------------------------------------------------
+
+// lock free hand over of the latest value from one writer thread to one
+// reader thread. the writer fills back() and publish()es it, the reader
+// calls read() to get the newest published value. neither side ever
+// waits on the other: the three slots are swapped through one atomic byte,
+// so the writer always has a slot to fill and the reader always keeps the
+// one it is looking at until its next read().
+template <typename T>
+class triple_buffer final {
+public:
+//                       functions                         //
+//------------------------------------------------------------
+    // writer side
+    T & back() {
+        return m_slots[m_back];
+    }
+
+    void publish() {
+        auto const previous = m_middle.exchange(static_cast<std::uint8_t>(m_back | fresh), std::memory_order_acq_rel);
+        m_back = previous & index_mask;
+    }
+
+    // reader side - swaps in the newest value if one was published since
+    // the last read, otherwise returns the same value again
+    T const & read() {
+        if (m_middle.load(std::memory_order_relaxed) & fresh) {
+            auto const previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = previous & index_mask;
+        }
+        return m_slots[m_front];
+    }
+
+    // reader side, true if read() would return something new
+    bool has_fresh() const {
+        return (m_middle.load(std::memory_order_relaxed) & fresh) != 0;
+    }
+
+private:
+    static constexpr std::uint8_t index_mask = 0x3;
+    static constexpr std::uint8_t fresh = 0x4;
+
+//                         data                             //
+//------------------------------------------------------------
+    std::array<T, 3> m_slots {};
+
+    // slot index in the low bits, plus the fresh bit once published
+    std::atomic<std::uint8_t> m_middle {1};
+
+    // only ever touched by their own thread
+    std::uint8_t m_back {0};
+    std::uint8_t m_front {2};
+
+}; // triple_buffer
+
+#endif // TRIPLE_BUFFER_HPP
@@ -0,0 +1,1403 @@
+#include "water_grid.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// my
+#include "constants.hpp"
+#include "mapped_file.hpp"
+#include "material_kernel.hpp"
+#include "material_registry.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "world_file.hpp"
+
+namespace {
+
+//------------------------------------------------------------
+// the halo of chunk (chunk_x, chunk_y) of a tiled grid, from the cells of
+// the tiles about it, or ground where there is no tile. the padding of the
+// last tiles is air that is never written, which no flow can tell from
+// ground as the border is always in between. only the chunk's own sweep
+// reads its halo, so it can be written into the front buffer while other
+// chunks sweep
+void
+fill_halo(grid_planes const & grid, plane_layout const & layout, std::size_t chunk_x, std::size_t chunk_y) {
+    constexpr auto size = plane_layout::tile;
+    constexpr auto width = plane_layout::tile_width;
+    constexpr auto halo_x = plane_layout::halo_x;
+    constexpr auto halo_y = plane_layout::halo_y;
+    static_assert(halo_y == 1, "the halo rows are filled as one row each");
+
+    auto fill = [&](auto * plane, auto outside) {
+        using value = std::remove_pointer_t<decltype(plane)>;
+
+        // the tile dx, dy chunks away, nullptr if there is none
+        auto tile_at = [&](int dx, int dy) -> value const * {
+            if ((dx < 0 && chunk_x == 0) || (dx > 0 && chunk_x + 1 >= layout.tiles_x)) return nullptr;
+            if ((dy < 0 && chunk_y == 0) || (dy > 0 && chunk_y + 1 >= layout.tiles_y)) return nullptr;
+            return plane + layout.tile_first(chunk_x + dx, chunk_y + dy);
+        };
+
+        auto * tile = plane + layout.tile_first(chunk_x, chunk_y);
+
+        // count cells of row y of a neighbour from x, the length known at
+        // compile time so the copies are a few moves
+        auto take = [&](value * target, value const * source, std::size_t x, std::size_t y, auto count) {
+            if (source) {
+                std::memcpy(target, source + x + y * width, decltype(count)::value * sizeof(value));
+            } else {
+                std::fill_n(target, decltype(count)::value, outside);
+            }
+        };
+
+        using side = std::integral_constant<std::size_t, halo_x>;
+        using whole = std::integral_constant<std::size_t, size>;
+
+        auto const * left = tile_at(-1, 0);
+        auto const * right = tile_at(1, 0);
+
+        for (auto y = halo_y; y < halo_y + size; y++) {
+            take(tile + y * width, left, size, y, side{});
+            take(tile + y * width + halo_x + size, right, halo_x, y, side{});
+        }
+
+        // the last row of the tiles above and the first of those below,
+        // their own cells only as their halos may be out of date
+        for (auto const & [target_y, dy, source_y] : {std::tuple{std::size_t{0}, -1, size}, std::tuple{halo_y + size, 1, halo_y}}) {
+            auto * row = tile + target_y * width;
+            take(row, tile_at(-1, dy), size, source_y, side{});
+            take(row + halo_x, tile_at(0, dy), halo_x, source_y, whole{});
+            take(row + halo_x + size, tile_at(1, dy), halo_x, source_y, side{});
+        }
+    };
+
+    fill(grid.types, material::GROUND);
+
+    if (grid.mass_fixed) {
+        fill(grid.mass_fixed, std::uint16_t{0});
+        fill(grid.mass_next_fixed, std::uint16_t{0});
+    } else {
+        fill(grid.mass, 0.0f);
+        fill(grid.mass_next, 0.0f);
+    }
+}
+
+//------------------------------------------------------------
+// one tile and its halo as a small row major grid, which the kernels run
+// on in place
+grid_planes
+tile_planes(grid_planes const & grid, plane_layout const & layout, std::size_t chunk_x, std::size_t chunk_y) {
+    auto const first = layout.tile_first(chunk_x, chunk_y);
+    auto shift = [first](auto * plane) { return plane ? plane + first : plane; };
+
+    return grid_planes{
+        plane_layout::tile_width,
+        plane_layout::tile + 2 * plane_layout::halo_y,
+        shift(grid.types),
+        shift(grid.mass),
+        shift(grid.mass_next),
+        shift(grid.mass_fixed),
+        shift(grid.mass_next_fixed)};
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                       water_grid                         //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+water_grid::water_grid(int width, int height, mass_format format, cell_layout layout) noexcept(false)
+:   m_width{width}
+,   m_height{height}
+,   m_front{0}
+,   m_format{format}
+,   m_layout{plane_layout::make(layout, static_cast<std::size_t>(std::max(width, 0)), static_cast<std::size_t>(std::max(height, 0)))}
+,   m_kernel{&active_flow_kernel()}
+,   m_chunks_x{(static_cast<std::size_t>(width) + chunk_size - 1) / chunk_size}
+,   m_chunks_y{(static_cast<std::size_t>(height) + chunk_size - 1) / chunk_size} {
+
+    // anything smaller than 3x3 is nothing but ground border
+    if (width < 3 || height < 3) {
+        throw std::invalid_argument("water_grid must be at least 3x3, got " + std::to_string(width) + "x" + std::to_string(height));
+    }
+
+    auto const cell_count = m_layout.cell_count();
+
+    for (auto & cells : m_cells) {
+        cells.types.assign(cell_count, material::AIR);
+
+        if (m_format == mass_format::FIXED16) {
+            cells.mass_fixed.assign(cell_count, 0);
+            cells.mass_next_fixed.assign(cell_count, 0);
+        } else {
+            cells.mass.assign(cell_count, 0.0f);
+            cells.mass_next.assign(cell_count, 0.0f);
+        }
+    }
+
+    // everything starts dirty so the first tick looks at the whole grid
+    m_chunk_dirty.assign(m_chunks_x * m_chunks_y, 1);
+    m_chunk_awake.assign(m_chunks_x * m_chunks_y, 0);
+    m_chunk_water.assign(m_chunks_x * m_chunks_y, 0);
+    m_chunk_mixed.assign(m_chunks_x * m_chunks_y, 0);
+    m_chunk_mixed_near.assign(m_chunks_x * m_chunks_y, 0);
+    m_chunk_unsaved.assign(m_chunks_x * m_chunks_y, 1);
+    m_chunk_changed.assign(m_chunks_x * m_chunks_y, 1);
+    m_chunk_stale.assign(m_chunks_x * m_chunks_y, 0);
+    m_unchecked = 0;
+
+    // the border is in both buffers and never touched again
+    for (auto & cells : m_cells) {
+        // set the top and bottom rows to ground blocks
+        for (int x = 0; x < m_width; x++) {
+            set_cell(cells, index(x, 0), material::GROUND, 0.0f);
+            set_cell(cells, index(x, m_height - 1), material::GROUND, 0.0f);
+        }
+
+        // set the left and right columns to ground blocks
+        for (int y = 0; y < m_height; y++) {
+            set_cell(cells, index(0, y), material::GROUND, 0.0f);
+            set_cell(cells, index(m_width - 1, y), material::GROUND, 0.0f);
+        }
+    }
+}
+
+//------------------------------------------------------------
+water_grid::water_grid(world_file const & file) noexcept(false)
+:   m_width{file.header().width}
+,   m_height{file.header().height}
+,   m_front{0}
+,   m_format{file.header().grid_format()}
+,   m_layout{plane_layout::make(cell_layout::ROW_MAJOR, static_cast<std::size_t>(file.header().width), static_cast<std::size_t>(file.header().height))}
+,   m_kernel{&active_flow_kernel()}
+,   m_chunks_x{file.header().chunks_x}
+,   m_chunks_y{file.header().chunks_y} {
+
+    auto const & header = file.header();
+    auto const cell_count = header.cell_count();
+
+    // the back buffer maps the file again. both mappings are private, so
+    // they start out the same and only part ways where the ticks write
+    std::shared_ptr<mapped_file> const mappings[2] {file.mapping(), std::make_shared<mapped_file>(file.path())};
+
+    if (mappings[1]->size() != mappings[0]->size()) {
+        throw std::runtime_error(file.path() + " changed while it was being loaded");
+    }
+
+    for (std::size_t i = 0; i < 2; i++) {
+        auto & cells = m_cells[i];
+        cells.types.map(mappings[i], header.material_offset, cell_count);
+
+        if (m_format == mass_format::FIXED16) {
+            cells.mass_fixed.map(mappings[i], header.mass_offset, cell_count);
+            cells.mass_next_fixed.map(mappings[i], header.mass_next_offset, cell_count);
+        } else {
+            cells.mass.map(mappings[i], header.mass_offset, cell_count);
+            cells.mass_next.map(mappings[i], header.mass_next_offset, cell_count);
+        }
+    }
+
+    auto const chunk_count = m_chunks_x * m_chunks_y;
+    m_chunk_awake.assign(chunk_count, 0);
+    m_chunk_water.resize(chunk_count);
+
+    for (std::size_t i = 0; i < chunk_count; i++) {
+        m_chunk_water[i] = file.chunk(i).water;
+    }
+
+    // only chunks with water need to start dirty: a chunk that would wake
+    // has water in or next to it, so one of those is in its 3x3 anyway. the
+    // rest of the grid is left unread and matches the file
+    m_chunk_dirty = m_chunk_water;
+
+    // which of them hold other materials is not known without reading
+    // them, so they all take the material kernels until their first tick
+    // finds out
+    m_chunk_mixed = m_chunk_water;
+    m_chunk_mixed_near.assign(chunk_count, 0);
+    m_chunk_unsaved.assign(chunk_count, 0);
+    m_chunk_changed.assign(chunk_count, 1);
+    m_chunk_stale.assign(chunk_count, 0);
+
+    // nothing in the material plane has been read, see check_awake_chunks()
+    m_chunk_unchecked.assign(chunk_count, 1);
+    m_unchecked = chunk_count;
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+water_grid::step() {
+    auto const width = static_cast<std::size_t>(m_width);
+    auto const height = static_cast<std::size_t>(m_height);
+    auto const from = planes(front(), width, height);
+    auto const to = planes(back(), width, height);
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("grid.wake");
+        wake_chunks();
+    }
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("grid.sweep");
+        for (std::size_t chunk_y = 0; chunk_y < m_chunks_y; chunk_y++) {
+            sweep_chunk_row(from, to, chunk_y);
+        }
+    }
+
+    swap_buffers();
+}
+
+//------------------------------------------------------------
+void
+water_grid::step(thread_pool & pool) {
+    auto const width = static_cast<std::size_t>(m_width);
+    auto const height = static_cast<std::size_t>(m_height);
+    auto const from = planes(front(), width, height);
+    auto const to = planes(back(), width, height);
+
+    {
+        AQUABLOCK_PROFILE_SCOPE("grid.wake");
+        wake_chunks();
+    }
+
+    // the front is read only and each row of chunks writes its own cells
+    // of the back, so one phase is enough
+    {
+        AQUABLOCK_PROFILE_SCOPE("grid.sweep");
+        pool.run(m_chunks_y, [&](std::size_t chunk_y) {
+            sweep_chunk_row(from, to, chunk_y);
+        });
+    }
+
+    swap_buffers();
+}
+
+//------------------------------------------------------------
+bool
+water_grid::is_settled() const {
+    return std::none_of(m_chunk_dirty.begin(), m_chunk_dirty.end(), [](std::uint8_t dirty) { return dirty; });
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::awake_chunk_count() const {
+    return static_cast<std::size_t>(std::count(m_chunk_awake.begin(), m_chunk_awake.end(), 1));
+}
+
+//------------------------------------------------------------
+void
+water_grid::set_kernel(flow_kernel const & kernel) {
+    m_kernel = &kernel;
+}
+
+//------------------------------------------------------------
+flow_kernel const &
+water_grid::kernel() const {
+    return *m_kernel;
+}
+
+//------------------------------------------------------------
+void
+water_grid::set_ground(int x, int y) {
+    if (!is_interior(x, y)) return;
+    set_cell(front(), index(x, y), material::GROUND, 0.0f);
+    mark_dirty(x, y);
+}
+
+//------------------------------------------------------------
+void
+water_grid::set_air(int x, int y) {
+    if (!is_interior(x, y)) return;
+    set_cell(front(), index(x, y), material::AIR, 0.0f);
+    mark_dirty(x, y);
+}
+
+//------------------------------------------------------------
+void
+water_grid::set_water(int x, int y, float mass) {
+    if (!is_interior(x, y)) return;
+    set_cell(front(), index(x, y), material::WATER, mass);
+    mark_dirty(x, y);
+    m_chunk_water[(x / chunk_size) + (y / chunk_size) * m_chunks_x] = 1;
+}
+
+//------------------------------------------------------------
+void
+water_grid::clear() {
+    // set all blocks to air - ignore the ground block border
+    fill_rect(1, 1, m_width - 2, m_height - 2, material::AIR);
+}
+
+//------------------------------------------------------------
+void
+water_grid::clear_water() {
+    // set all active water blocks to air
+    clear_material(material::WATER);
+}
+
+//------------------------------------------------------------
+void
+water_grid::fill_rect(int x0, int y0, int x1, int y1, material type, float mass) {
+    auto const x_begin = std::max(std::min(x0, x1), 1);
+    auto const x_end = std::min(std::max(x0, x1) + 1, m_width - 1);
+    auto const y_begin = std::max(std::min(y0, y1), 1);
+    auto const y_end = std::min(std::max(y0, y1) + 1, m_height - 1);
+
+    for (int y = y_begin; y < y_end; y++) {
+        fill_span(y, x_begin, x_end, type, mass);
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::fill_circle(int x, int y, int radius, material type, float mass) {
+    if (radius < 0) return;
+
+    // r * r + r instead of r * r rounds the rim out so small brushes are
+    // not diamonds
+    auto const limit = static_cast<long>(radius) * radius + radius;
+
+    for (int dy = -radius; dy <= radius; dy++) {
+        auto half = static_cast<int>(std::sqrt(static_cast<double>(limit - static_cast<long>(dy) * dy)));
+        while (static_cast<long>(half) * half + static_cast<long>(dy) * dy > limit) half--;
+
+        fill_span(y + dy, x - half, x + half + 1, type, mass);
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::fill_line(int x0, int y0, int x1, int y1, int radius, material type, float mass) {
+    if (radius < 0) return;
+
+    // stamp a circle at every step of the line, but only to widen the span
+    // kept for each row. consecutive stamps are at most a cell apart, so
+    // the stamps cover one unbroken span per row and each row is written once
+    auto const top = std::min(y0, y1) - radius;
+    auto const rows = static_cast<std::size_t>(std::abs(y1 - y0) + 2 * radius + 1);
+    auto const limit = static_cast<long>(radius) * radius + radius;
+
+    std::vector<int> half(static_cast<std::size_t>(2 * radius + 1));
+    for (int dy = -radius; dy <= radius; dy++) {
+        auto h = static_cast<int>(std::sqrt(static_cast<double>(limit - static_cast<long>(dy) * dy)));
+        while (static_cast<long>(h) * h + static_cast<long>(dy) * dy > limit) h--;
+        half[static_cast<std::size_t>(dy + radius)] = h;
+    }
+
+    std::vector<int> span_begin(rows, std::numeric_limits<int>::max());
+    std::vector<int> span_end(rows, std::numeric_limits<int>::min());
+
+    auto stamp = [&](int x, int y) {
+        for (int dy = -radius; dy <= radius; dy++) {
+            auto const row = static_cast<std::size_t>(y + dy - top);
+            auto const h = half[static_cast<std::size_t>(dy + radius)];
+
+            span_begin[row] = std::min(span_begin[row], x - h);
+            span_end[row] = std::max(span_end[row], x + h + 1);
+        }
+    };
+
+    // bresenham
+    auto const dx = std::abs(x1 - x0);
+    auto const dy = -std::abs(y1 - y0);
+    auto const step_x = (x0 < x1) ? 1 : -1;
+    auto const step_y = (y0 < y1) ? 1 : -1;
+    auto error = dx + dy;
+
+    for (int x = x0, y = y0;;) {
+        stamp(x, y);
+        if (x == x1 && y == y1) break;
+
+        auto const error2 = 2 * error;
+        if (error2 >= dy) { error += dy; x += step_x; }
+        if (error2 <= dx) { error += dx; y += step_y; }
+    }
+
+    for (std::size_t row = 0; row < rows; row++) {
+        fill_span(top + static_cast<int>(row), span_begin[row], span_end[row], type, mass);
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::flood_fill(int x, int y, material type, float mass) {
+    if (!is_interior(x, y)) return;
+
+    auto & cells = front();
+    auto const target = cells.types[index(x, y)];
+
+    // refilling a region with its own material only changes the mass, so
+    // the material can not mark what has been filled and a bitmap does
+    auto const same = (target == type);
+    if (same && !properties_of(type).moves) return;
+
+    std::vector<std::uint8_t> filled(same ? cells.types.size() : 0);
+
+    auto open = [&](int cx, int cy) {
+        auto const i = index(cx, cy);
+        return cells.types[i] == target && (!same || !filled[i]);
+    };
+
+    // scanline fill - grow each seed into the widest open span of its row,
+    // fill that in one go and seed the open runs directly above and below
+    std::vector<std::pair<int, int>> seeds {{x, y}};
+
+    while (!seeds.empty()) {
+        auto const [seed_x, seed_y] = seeds.back();
+        seeds.pop_back();
+
+        if (!open(seed_x, seed_y)) continue;
+
+        auto left = seed_x;
+        auto right = seed_x + 1;
+        while (left > 1 && open(left - 1, seed_y)) left--;
+        while (right < m_width - 1 && open(right, seed_y)) right++;
+
+        fill_span(seed_y, left, right, type, mass);
+        if (same) {
+            for (int cx = left; cx < right; cx++) filled[index(cx, seed_y)] = 1;
+        }
+
+        for (auto const row : {seed_y - 1, seed_y + 1}) {
+            if (row < 1 || row > m_height - 2) continue;
+
+            for (int cx = left; cx < right; cx++) {
+                if (open(cx, row) && (cx == left || !open(cx - 1, row))) {
+                    seeds.emplace_back(cx, row);
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::clear_material(material type) {
+    auto const * types = front().types.data();
+
+    // one row at a time, turning each run of the material into air as a
+    // span so only the chunks that held some are woken
+    for (int y = 1; y < m_height - 1; y++) {
+        for (int x = 1; x < m_width - 1;) {
+            if (types[index(x, y)] != type) {
+                x++;
+                continue;
+            }
+
+            auto end = x + 1;
+            while (end < m_width - 1 && types[index(end, y)] == type) end++;
+
+            fill_span(y, x, end, material::AIR, 0.0f);
+            x = end;
+        }
+    }
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::settle_basins() {
+    AQUABLOCK_PROFILE_SCOPE("grid.settle");
+
+    auto const * types = front().types.data();
+    std::vector<std::uint8_t> seen(front().types.size());
+    std::vector<basin_row> rows;
+    std::size_t settled = 0;
+
+    // a chunk that is not dirty has not moved, so neither has any basin
+    // that lies only in chunks like it
+    for (std::size_t chunk = 0; chunk < m_chunk_dirty.size(); chunk++) {
+        if (!m_chunk_dirty[chunk] || !m_chunk_water[chunk]) continue;
+
+        auto const chunk_x = static_cast<int>((chunk % m_chunks_x) * chunk_size);
+        auto const chunk_y = static_cast<int>((chunk / m_chunks_x) * chunk_size);
+        auto const x_end = std::min(chunk_x + static_cast<int>(chunk_size), m_width - 1);
+        auto const y_end = std::min(chunk_y + static_cast<int>(chunk_size), m_height - 1);
+
+        for (int y = std::max(chunk_y, 1); y < y_end; y++) {
+            for (int x = std::max(chunk_x, 1); x < x_end; x++) {
+                auto const i = index(x, y);
+                if (types[i] == material::WATER && !seen[i] && settle_basin(x, y, seen, rows)) {
+                    settled++;
+                }
+            }
+        }
+    }
+
+    return settled;
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::cell_bytes() const {
+    auto const mass_bytes = (m_format == mass_format::FIXED16) ? sizeof(std::uint16_t) : sizeof(float);
+    return sizeof(material) + 2 * mass_bytes;
+}
+
+//------------------------------------------------------------
+void
+water_grid::read_cells(int x, int y, int count, unsigned char * out) const {
+    auto const & cells = front();
+    auto const n = static_cast<std::size_t>(count);
+    auto * mass_out = out + n * sizeof(material);
+
+    // a run of the layout at a time, one plane's part of the span each
+    auto copy = [&](auto const * plane, unsigned char * to, std::size_t i, std::size_t offset, std::size_t run) {
+        std::memcpy(to + offset * sizeof(*plane), plane + i, run * sizeof(*plane));
+    };
+
+    for (std::size_t done = 0; done < n;) {
+        auto const cx = static_cast<std::size_t>(x) + done;
+        auto const i = index(static_cast<int>(cx), y);
+        auto const run = m_layout.run(cx, n - done);
+
+        copy(cells.types.data(), out, i, done, run);
+
+        if (m_format == mass_format::FIXED16) {
+            copy(cells.mass_fixed.data(), mass_out, i, done, run);
+            copy(cells.mass_next_fixed.data(), mass_out + n * sizeof(std::uint16_t), i, done, run);
+        } else {
+            copy(cells.mass.data(), mass_out, i, done, run);
+            copy(cells.mass_next.data(), mass_out + n * sizeof(float), i, done, run);
+        }
+
+        done += run;
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::write_cells(int x, int y, int count, unsigned char const * in) {
+    auto const x_begin = std::max(x, 1);
+    auto const x_end = std::min(x + count, m_width - 1);
+    if (y < 1 || y > m_height - 2 || x_begin >= x_end) return;
+
+    auto & cells = front();
+    auto const n = static_cast<std::size_t>(count);
+    auto const * mass_in = in + n * sizeof(material);
+    bool changed = false;
+    bool moves = false;
+    bool mixed = false;
+
+    // a run of the layout at a time
+    for (auto cx = x_begin; cx < x_end;) {
+        auto const skip = static_cast<std::size_t>(cx - x);
+        auto const kept = m_layout.run(static_cast<std::size_t>(cx), static_cast<std::size_t>(x_end - cx));
+        auto const i = index(cx, y);
+
+        // one plane's part of the run, true if it was any different
+        auto copy = [&](auto * plane, unsigned char const * from) {
+            using value = std::remove_pointer_t<decltype(plane)>;
+            auto const * source = from + skip * sizeof(value);
+            auto const bytes = kept * sizeof(value);
+
+            if (std::memcmp(plane + i, source, bytes) == 0) return false;
+            std::memcpy(plane + i, source, bytes);
+            return true;
+        };
+
+        changed |= copy(cells.types.data(), in);
+
+        if (m_format == mass_format::FIXED16) {
+            changed |= copy(cells.mass_fixed.data(), mass_in);
+            changed |= copy(cells.mass_next_fixed.data(), mass_in + n * sizeof(std::uint16_t));
+        } else {
+            changed |= copy(cells.mass.data(), mass_in);
+            changed |= copy(cells.mass_next.data(), mass_in + n * sizeof(float));
+        }
+
+        auto const * types = cells.types.data() + i;
+        moves |= std::any_of(types, types + kept, [](material type) { return properties_of(type).moves; });
+        mixed |= std::any_of(types, types + kept, [](material type) { return needs_material_kernels(type); });
+        cx += static_cast<int>(kept);
+    }
+
+    if (!changed) return;
+
+    mark_span(y, x_begin, x_end, moves, mixed);
+}
+
+//------------------------------------------------------------
+material
+water_grid::material_at(int x, int y) const {
+    return front().types[index(x, y)];
+}
+
+//------------------------------------------------------------
+float
+water_grid::mass_at(int x, int y) const {
+    if (m_format == mass_format::FIXED16) {
+        return static_cast<float>(front().mass_fixed[index(x, y)]) / constants::fixed_mass_scale;
+    }
+    return front().mass[index(x, y)];
+}
+
+//------------------------------------------------------------
+float
+water_grid::mass_next_at(int x, int y) const {
+    if (m_format == mass_format::FIXED16) {
+        return static_cast<float>(front().mass_next_fixed[index(x, y)]) / constants::fixed_mass_scale;
+    }
+    return front().mass_next[index(x, y)];
+}
+
+//------------------------------------------------------------
+bool
+water_grid::is_interior(int x, int y) const {
+    return x > 0 && y > 0 && x < m_width - 1 && y < m_height - 1;
+}
+
+//------------------------------------------------------------
+material const *
+water_grid::material_data() const {
+    return front().types.data();
+}
+
+//------------------------------------------------------------
+float const *
+water_grid::mass_data() const {
+    return front().mass.data();
+}
+
+//------------------------------------------------------------
+float const *
+water_grid::mass_next_data() const {
+    return front().mass_next.data();
+}
+
+//------------------------------------------------------------
+std::uint16_t const *
+water_grid::fixed_mass_data() const {
+    return front().mass_fixed.data();
+}
+
+//------------------------------------------------------------
+std::uint16_t const *
+water_grid::fixed_mass_next_data() const {
+    return front().mass_next_fixed.data();
+}
+
+//------------------------------------------------------------
+mass_format
+water_grid::format() const {
+    return m_format;
+}
+
+//------------------------------------------------------------
+plane_layout const &
+water_grid::layout() const {
+    return m_layout;
+}
+
+//------------------------------------------------------------
+int
+water_grid::width() const {
+    return m_width;
+}
+
+//------------------------------------------------------------
+int
+water_grid::height() const {
+    return m_height;
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::memory_bytes() const {
+    std::size_t bytes = 0;
+
+    for (auto const & cells : m_cells) {
+        bytes += cells.types.size() * sizeof(material)
+               + cells.mass.size() * sizeof(float)
+               + cells.mass_next.size() * sizeof(float)
+               + cells.mass_fixed.size() * sizeof(std::uint16_t)
+               + cells.mass_next_fixed.size() * sizeof(std::uint16_t);
+    }
+
+    return bytes + m_chunk_dirty.capacity() + m_chunk_awake.capacity() + m_chunk_water.capacity() + m_chunk_mixed.capacity() + m_chunk_mixed_near.capacity() + m_chunk_unsaved.capacity() + m_chunk_changed.capacity() + m_chunk_stale.capacity() + m_chunk_unchecked.capacity();
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::chunks_x() const {
+    return m_chunks_x;
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::chunks_y() const {
+    return m_chunks_y;
+}
+
+//------------------------------------------------------------
+bool
+water_grid::chunk_has_water(std::size_t chunk) const {
+    return m_chunk_water[chunk] != 0;
+}
+
+//------------------------------------------------------------
+void
+water_grid::take_unsaved_chunks(std::vector<std::size_t> & chunks) {
+    take_chunks(m_chunk_unsaved, chunks);
+}
+
+//------------------------------------------------------------
+void
+water_grid::take_changed_chunks(std::vector<std::size_t> & chunks) {
+    take_chunks(m_chunk_changed, chunks);
+}
+
+//------------------------------------------------------------
+std::size_t
+water_grid::index(int x, int y) const {
+    return m_layout.index(static_cast<std::size_t>(x), static_cast<std::size_t>(y));
+}
+
+//------------------------------------------------------------
+water_grid::cell_buffer &
+water_grid::front() {
+    return m_cells[m_front];
+}
+
+//------------------------------------------------------------
+water_grid::cell_buffer const &
+water_grid::front() const {
+    return m_cells[m_front];
+}
+
+//------------------------------------------------------------
+water_grid::cell_buffer &
+water_grid::back() {
+    return m_cells[m_front ^ 1];
+}
+
+//------------------------------------------------------------
+void
+water_grid::set_cell(cell_buffer & cells, std::size_t i, material type, float mass) {
+    cells.types[i] = type;
+
+    if (m_format == mass_format::FIXED16) {
+        auto const fixed = to_fixed(mass);
+
+        cells.mass_fixed[i] = fixed;
+        cells.mass_next_fixed[i] = fixed;
+    } else {
+        cells.mass[i] = mass;
+        cells.mass_next[i] = mass;
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::fill_span(int y, int x_begin, int x_end, material type, float mass) {
+    x_begin = std::max(x_begin, 1);
+    x_end = std::min(x_end, m_width - 1);
+    if (y < 1 || y > m_height - 2 || x_begin >= x_end) return;
+
+    auto & cells = front();
+    auto const moves = properties_of(type).moves;
+    auto const cell_mass = moves ? mass : 0.0f;
+    auto const fixed = to_fixed(cell_mass);
+
+    // plain fills over contiguous runs, which the compiler turns into
+    // memset or wide stores. a row major span is a single run
+    for (auto x = x_begin; x < x_end;) {
+        auto const i = index(x, y);
+        auto const count = m_layout.run(static_cast<std::size_t>(x), static_cast<std::size_t>(x_end - x));
+
+        std::fill_n(cells.types.data() + i, count, type);
+
+        if (m_format == mass_format::FIXED16) {
+            std::fill_n(cells.mass_fixed.data() + i, count, fixed);
+            std::fill_n(cells.mass_next_fixed.data() + i, count, fixed);
+        } else {
+            std::fill_n(cells.mass.data() + i, count, cell_mass);
+            std::fill_n(cells.mass_next.data() + i, count, cell_mass);
+        }
+
+        x += static_cast<int>(count);
+    }
+
+    mark_span(y, x_begin, x_end, moves, needs_material_kernels(type));
+}
+
+//------------------------------------------------------------
+void
+water_grid::mark_span(int y, int x_begin, int x_end, bool moves, bool mixed) {
+    auto const row = (static_cast<std::size_t>(y) / chunk_size) * m_chunks_x;
+    auto const first = row + static_cast<std::size_t>(x_begin) / chunk_size;
+    auto const last = row + static_cast<std::size_t>(x_end - 1) / chunk_size;
+
+    for (auto chunk = first; chunk <= last; chunk++) {
+        m_chunk_dirty[chunk] = 1;
+        m_chunk_unsaved[chunk] = 1;
+        m_chunk_changed[chunk] = 1;
+        m_chunk_stale[chunk] = 1;
+        if (moves) m_chunk_water[chunk] = 1;
+        if (mixed) m_chunk_mixed[chunk] = 1;
+    }
+}
+
+//------------------------------------------------------------
+std::uint16_t
+water_grid::to_fixed(float mass) const {
+    // round to the nearest step. the fixed kernels rely on mass never
+    // being above max_mass, so more than that is clamped
+    auto const scaled = std::lround(mass * constants::fixed_mass_scale);
+    return static_cast<std::uint16_t>(std::clamp<long>(scaled, 0, constants::fixed_max_mass));
+}
+
+//------------------------------------------------------------
+bool
+water_grid::settle_basin(int x, int y, std::vector<std::uint8_t> & seen, std::vector<basin_row> & rows) {
+    auto & cells = front();
+    auto const * types = cells.types.data();
+    auto const fixed = (m_format == mass_format::FIXED16);
+
+    auto water = [&](int cx, int cy) { return types[index(cx, cy)] == material::WATER; };
+
+    // the basin is everything but ground that can be reached from the top
+    // of the water without going above it. water resting on top of the
+    // first guess, or pouring into it, moves the top up and it is redone
+    auto column = x;
+    auto top = y;
+    while (water(column, top - 1)) top--;
+
+    bool simple = true;
+    for (bool grew = true; simple && grew;) {
+        simple = explore_basin(column, top, rows);
+        grew = false;
+
+        for (int cx = rows[0].begin; simple && cx < rows[0].end; cx++) {
+            if (water(cx, top - 1)) {
+                column = cx;
+                while (water(column, top - 1)) top--;
+                grew = true;
+                break;
+            }
+        }
+    }
+
+    // the cellular rules keep the rest. only the body of water is marked,
+    // so its cells are not each tried again but other basins the search
+    // ran into still are
+    if (!simple) {
+        constexpr std::uint8_t in_body = 2;
+        std::vector<std::pair<int, int>> body {{x, y}};
+        seen[index(x, y)] = in_body;
+
+        while (!body.empty()) {
+            auto const [cx, cy] = body.back();
+            body.pop_back();
+
+            for (auto const & [nx, ny] : {std::pair{cx - 1, cy}, std::pair{cx + 1, cy}, std::pair{cx, cy - 1}, std::pair{cx, cy + 1}}) {
+                auto const i = index(nx, ny);
+                if (types[i] == material::WATER && seen[i] != in_body) {
+                    seen[i] = in_body;
+                    body.emplace_back(nx, ny);
+                }
+            }
+        }
+        return false;
+    }
+
+    auto bottom = top;
+    for (std::size_t row = 0; row < rows.size() && rows[row].begin != rows[row].end; row++) {
+        auto const & span = rows[row];
+        bottom = top + static_cast<int>(row);
+        for (int cx = span.begin; cx < span.end; cx++) seen[index(cx, bottom)] = 1;
+    }
+
+    // everything is in mass_next units - fixed point steps or floats - so
+    // the fixed total is exact and spreads back out without losing any
+    auto next_at = [&](std::size_t i) {
+        return fixed ? static_cast<double>(cells.mass_next_fixed[i]) : static_cast<double>(cells.mass_next[i]);
+    };
+    auto const full = fixed ? static_cast<double>(constants::fixed_max_mass) : static_cast<double>(constants::max_mass);
+    auto const least = fixed ? static_cast<double>(constants::fixed_min_mass) : static_cast<double>(constants::min_mass);
+    auto const scale = fixed ? static_cast<double>(constants::fixed_mass_scale) : 1.0;
+
+    auto span_of = [&](int row_y) { return rows[static_cast<std::size_t>(row_y - top)]; };
+    auto width_of = [&](int row_y) { return span_of(row_y).end - span_of(row_y).begin; };
+
+    double total = 0.0;
+    for (int row_y = top; row_y <= bottom; row_y++) {
+        for (int cx = span_of(row_y).begin; cx < span_of(row_y).end; cx++) {
+            total += next_at(index(cx, row_y));
+        }
+    }
+
+    // with no pressure in the rules water only ever ends up lower, so the
+    // rows fill up full from the bottom and what is left lies level on top
+    auto left = total;
+    auto level = bottom;
+    while (level >= top && left >= width_of(level) * full) {
+        left -= width_of(level) * full;
+        level--;
+    }
+
+    // more than fits below the top spills over the rim
+    if (level < top) return false;
+
+    // share for every cell of the top row, and extra cells one step more.
+    // a share too thin to stay water lies on the full row below instead,
+    // as mass_next over max_mass the way the rules leave it
+    auto const surface = width_of(level);
+    auto share = fixed ? std::floor(left / surface) : left / surface;
+    auto extra = static_cast<int>(left - share * surface);
+    auto spill = 0.0;
+    auto spill_extra = 0;
+
+    if (share < least) {
+        if (level == bottom || left > width_of(level + 1) * least) return false;
+
+        spill = fixed ? std::floor(left / width_of(level + 1)) : left / width_of(level + 1);
+        spill_extra = static_cast<int>(left - spill * width_of(level + 1));
+        share = 0.0;
+        extra = 0;
+    }
+
+    auto target = [&](int row_y, int k) {
+        if (row_y < level) return 0.0;
+        if (row_y == level) return share + (k < extra ? 1.0 : 0.0);
+        if (row_y == level + 1) return full + spill + (k < spill_extra ? 1.0 : 0.0);
+        return full;
+    };
+
+    // the surface never stops sloshing under the rules, so a basin that is
+    // already about right is left alone rather than rewritten every time.
+    // the rows below the surface only need to be full, as the rules leave
+    // any extra there as mass_next, and the two at the surface only need
+    // to hold about the right amount between them
+    bool settled = true;
+    auto surface_total = 0.0;
+    auto surface_goal = 0.0;
+
+    for (int row_y = top; settled && row_y <= bottom; row_y++) {
+        auto const & span = span_of(row_y);
+        auto const at_surface = (row_y == level || row_y == level + 1);
+
+        for (int cx = span.begin; settled && cx < span.end; cx++) {
+            auto const i = index(cx, row_y);
+            auto const goal = target(row_y, cx - span.begin);
+
+            if (at_surface) {
+                surface_total += next_at(i);
+                surface_goal += goal;
+            } else {
+                settled = (goal > 0.0) ? types[i] == material::WATER && next_at(i) >= goal * (1.0 - 1e-4) : types[i] != material::WATER;
+            }
+        }
+    }
+    settled = settled && std::abs(surface_total - surface_goal) <= surface * least;
+
+    if (settled) return false;
+
+    for (int row_y = top; row_y <= bottom; row_y++) {
+        auto const & span = span_of(row_y);
+
+        if (row_y < level || (row_y == level && share == 0.0)) {
+            fill_span(row_y, span.begin, span.end, material::AIR, 0.0f);
+        } else if (row_y == level) {
+            fill_span(row_y, span.begin, span.begin + extra, material::WATER, static_cast<float>((share + 1.0) / scale));
+            fill_span(row_y, span.begin + extra, span.end, material::WATER, static_cast<float>(share / scale));
+        } else {
+            fill_span(row_y, span.begin, span.end, material::WATER, constants::max_mass);
+        }
+    }
+
+    if (spill > 0.0 || spill_extra > 0) {
+        auto const & span = span_of(level + 1);
+
+        for (int cx = span.begin; cx < span.end; cx++) {
+            auto const i = index(cx, level + 1);
+            auto const goal = target(level + 1, cx - span.begin);
+
+            if (fixed) {
+                cells.mass_next_fixed[i] = static_cast<std::uint16_t>(goal);
+            } else {
+                cells.mass_next[i] = static_cast<float>(goal);
+            }
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------
+bool
+water_grid::explore_basin(int x, int top, std::vector<basin_row> & rows) const {
+    auto const * types = front().types.data();
+    auto open = [&](int cx, int cy) { return types[index(cx, cy)] != material::GROUND; };
+
+    rows.assign(static_cast<std::size_t>(m_height - top), basin_row{});
+
+    // scanline fill over everything but ground. a basin the solver can do
+    // has one span per row, so any row that turns up a second one means
+    // it is not and the rest is not worth looking at
+    std::vector<std::pair<int, int>> seeds {{x, top}};
+
+    while (!seeds.empty()) {
+        auto const [seed_x, seed_y] = seeds.back();
+        seeds.pop_back();
+
+        auto & row = rows[static_cast<std::size_t>(seed_y - top)];
+        if (row.begin != row.end) {
+            if (seed_x >= row.begin && seed_x < row.end) continue;
+            return false;
+        }
+
+        // the border is ground, so the spans stop before it
+        auto left = seed_x;
+        auto right = seed_x + 1;
+        while (open(left - 1, seed_y)) left--;
+        while (open(right, seed_y)) right++;
+        row = basin_row{left, right};
+
+        // the levels are worked out for water alone
+        for (int cx = left; cx < right; cx++) {
+            if (needs_material_kernels(types[index(cx, seed_y)])) return false;
+        }
+
+        for (auto const next_y : {seed_y - 1, seed_y + 1}) {
+            if (next_y < top) continue;
+
+            for (int cx = left; cx < right; cx++) {
+                if (open(cx, next_y) && (cx == left || !open(cx - 1, next_y))) {
+                    seeds.emplace_back(cx, next_y);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------
+grid_planes
+water_grid::planes(cell_buffer & cells, std::size_t width, std::size_t height) {
+    return grid_planes{
+        width,
+        height,
+        cells.types.data(),
+        cells.mass.data(),
+        cells.mass_next.data(),
+        cells.mass_fixed.data(),
+        cells.mass_next_fixed.data()};
+}
+
+//------------------------------------------------------------
+void
+water_grid::wake_chunks() {
+    auto chunk = [this](std::size_t x, std::size_t y) { return x + y * m_chunks_x; };
+
+    for (std::size_t chunk_y = 0; chunk_y < m_chunks_y; chunk_y++) {
+        for (std::size_t chunk_x = 0; chunk_x < m_chunks_x; chunk_x++) {
+            auto const x_begin = chunk_x > 0 ? chunk_x - 1 : 0;
+            auto const x_end = std::min(chunk_x + 2, m_chunks_x);
+            auto const y_begin = chunk_y > 0 ? chunk_y - 1 : 0;
+            auto const y_end = std::min(chunk_y + 2, m_chunks_y);
+
+            // woken by any dirty chunk in the 3x3 around it, and it needs
+            // the material kernels if any of them holds other materials -
+            // the flows of a chunk look no further than the next one
+            bool dirty = false;
+            bool mixed = false;
+            for (auto y = y_begin; y < y_end; y++) {
+                for (auto x = x_begin; x < x_end; x++) {
+                    dirty |= m_chunk_dirty[chunk(x, y)] != 0;
+                    mixed |= m_chunk_mixed[chunk(x, y)] != 0;
+                }
+            }
+
+            // anything that moves can only arrive from the chunk itself,
+            // either side or above
+            bool const water =
+                m_chunk_water[chunk(chunk_x, chunk_y)] ||
+                (chunk_x > 0 && m_chunk_water[chunk(chunk_x - 1, chunk_y)]) ||
+                (chunk_x + 1 < m_chunks_x && m_chunk_water[chunk(chunk_x + 1, chunk_y)]) ||
+                (chunk_y > 0 && m_chunk_water[chunk(chunk_x, chunk_y - 1)]);
+
+            m_chunk_awake[chunk(chunk_x, chunk_y)] = dirty && water;
+            m_chunk_mixed_near[chunk(chunk_x, chunk_y)] = mixed;
+        }
+    }
+
+    if (m_unchecked > 0) check_awake_chunks();
+
+    std::fill(m_chunk_dirty.begin(), m_chunk_dirty.end(), 0);
+}
+
+//------------------------------------------------------------
+// the sweep of an awake chunk reads the 3x3 around it, and looks up what
+// it finds in the material tables. a chunk mapped from a world file is
+// checked the first time that happens, so a damaged file costs a scan of
+// the chunks it reaches and nothing up front
+void
+water_grid::check_awake_chunks() {
+    auto const * types = front().types.data();
+
+    for (std::size_t chunk = 0; chunk < m_chunk_awake.size(); chunk++) {
+        if (!m_chunk_awake[chunk]) continue;
+
+        auto const chunk_x = chunk % m_chunks_x;
+        auto const chunk_y = chunk / m_chunks_x;
+
+        for (auto y = chunk_y > 0 ? chunk_y - 1 : 0; y < std::min(chunk_y + 2, m_chunks_y); y++) {
+            for (auto x = chunk_x > 0 ? chunk_x - 1 : 0; x < std::min(chunk_x + 2, m_chunks_x); x++) {
+                auto const near = x + y * m_chunks_x;
+                if (!m_chunk_unchecked[near]) continue;
+
+                auto const cell_x_end = std::min((x + 1) * chunk_size, static_cast<std::size_t>(m_width));
+                auto const cell_y_end = std::min((y + 1) * chunk_size, static_cast<std::size_t>(m_height));
+
+                for (auto cell_y = y * chunk_size; cell_y < cell_y_end; cell_y++) {
+                    for (auto cell_x = x * chunk_size; cell_x < cell_x_end; cell_x++) {
+                        auto const type = static_cast<std::size_t>(types[m_layout.index(cell_x, cell_y)]);
+                        if (type >= material_count) {
+                            throw std::runtime_error("unknown material " + std::to_string(type) + " at " + std::to_string(cell_x) + ", " + std::to_string(cell_y));
+                        }
+                    }
+                }
+
+                m_chunk_unchecked[near] = 0;
+                m_unchecked--;
+            }
+        }
+    }
+
+    if (m_unchecked == 0) m_chunk_unchecked = {};
+}
+
+//------------------------------------------------------------
+void
+water_grid::sweep_chunk_row(grid_planes const & from, grid_planes const & to, std::size_t chunk_y) {
+    // the border is always ground so only the interior can flow
+    auto const y_begin = std::max<std::size_t>(chunk_y * chunk_size, 1);
+    auto const y_end = std::min(chunk_y * chunk_size + chunk_size, from.height - 1);
+
+    if (y_begin >= y_end) return;
+
+    auto const row = chunk_y * m_chunks_x;
+    bool any_awake = false;
+
+    for (std::size_t chunk_x = 0; chunk_x < m_chunks_x; chunk_x++) {
+        auto const chunk = row + chunk_x;
+
+        if (m_chunk_awake[chunk]) {
+            // once swapped the old state of the chunk is in the back buffer.
+            // and only awake chunks change in a tick, so only they need
+            // saving or drawing again
+            m_chunk_water[chunk] = 0;
+            m_chunk_mixed[chunk] = 0;
+            m_chunk_unsaved[chunk] = 1;
+            m_chunk_changed[chunk] = 1;
+            m_chunk_stale[chunk] = 1;
+            any_awake = true;
+        } else if (m_chunk_stale[chunk]) {
+            // a sleeping chunk is the same after the tick, so the back buffer
+            // only needs it if it is out of date there
+            copy_chunk(from, to, chunk_x, chunk_y);
+            m_chunk_stale[chunk] = 0;
+        }
+    }
+
+    if (!any_awake) return;
+
+    // -0.0f adds nothing to the mass under the border, as the old separate
+    // flow and commit passes did
+    auto const empty = (y_begin > 1) ? 0.0f : -0.0f;
+
+    if (m_layout.kind == cell_layout::TILED) {
+        if (m_format == mass_format::FIXED16) {
+            sweep_tiles(from, to, chunk_y, m_kernel->fixed_sweep_row, m_kernel->fixed_chunk_sweep_row(plane_layout::tile_width), &fixed_material_sweep_row, std::int16_t{0});
+        } else {
+            sweep_tiles(from, to, chunk_y, m_kernel->sweep_row, m_kernel->chunk_sweep_row(plane_layout::tile_width), &material_sweep_row, empty);
+        }
+    } else if (m_format == mass_format::FIXED16) {
+        sweep_rows(from, to, chunk_y, m_kernel->fixed_sweep_row, m_kernel->fixed_chunk_sweep_row(from.width), &fixed_material_sweep_row, std::int16_t{0});
+    } else {
+        sweep_rows(from, to, chunk_y, m_kernel->sweep_row, m_kernel->chunk_sweep_row(from.width), &material_sweep_row, empty);
+    }
+}
+
+//------------------------------------------------------------
+template <typename lane, typename row_sweep, typename chunk_sweep, typename material_sweep>
+void
+water_grid::sweep_rows(grid_planes const & from, grid_planes const & to, std::size_t chunk_y, row_sweep sweep_row, chunk_sweep chunk_sweep_row, material_sweep material_sweep_row, lane empty) {
+    auto const y_begin = std::max<std::size_t>(chunk_y * chunk_size, 1);
+    auto const y_end = std::min(chunk_y * chunk_size + chunk_size, from.height - 1);
+
+    auto const * chunks = m_chunk_awake.data() + chunk_y * m_chunks_x;
+    auto * dirty = m_chunk_dirty.data() + chunk_y * m_chunks_x;
+    auto * water = m_chunk_water.data() + chunk_y * m_chunks_x;
+    auto const * mixed_near = m_chunk_mixed_near.data() + chunk_y * m_chunks_x;
+    auto * mixed = m_chunk_mixed.data() + chunk_y * m_chunks_x;
+
+    // the down flows of the last row done, across the whole width
+    std::vector<lane> carry(from.width, empty);
+
+    // row by row across the awake chunks so memory is walked in order. the
+    // row above belongs to the chunks above, so only its down flows are
+    // worked out
+    for (auto y = (y_begin > 1) ? y_begin - 1 : y_begin; y < y_end; y++) {
+        auto const writes = (y < y_begin) ? sweep_writes::CARRY : sweep_writes::ALL;
+
+        for (std::size_t chunk_x = 0; chunk_x < m_chunks_x; chunk_x++) {
+            if (!chunks[chunk_x]) continue;
+
+            auto const x_begin = std::max<std::size_t>(chunk_x * chunk_size, 1);
+            auto const x_end = std::min(chunk_x * chunk_size + chunk_size, from.width - 1);
+
+            // chunks with other materials about them take the material
+            // kernels, whole chunks of water away from the border the fixed
+            // span kernel
+            sweep_result result;
+            if (mixed_near[chunk_x]) {
+                bool left_mixed = false;
+                result = material_sweep_row(from, to, y, x_begin, x_end, carry.data() + x_begin, writes, left_mixed);
+                mixed[chunk_x] |= left_mixed;
+            } else if (x_begin > 1 && x_end - x_begin == chunk_size && x_end < from.width - 1) {
+                result = chunk_sweep_row(from, to, y, x_begin, carry.data() + x_begin, writes);
+            } else {
+                result = sweep_row(from, to, y, x_begin, x_end, carry.data() + x_begin, writes);
+            }
+
+            dirty[chunk_x] |= result.moved;
+            water[chunk_x] |= result.water;
+        }
+    }
+}
+
+//------------------------------------------------------------
+// sweep_rows for a tiled grid, a chunk at a time on its own tile once its
+// halo is filled in. the kernels see the same cells as on a row major
+// grid, so the results are the same bit for bit
+template <typename lane, typename row_sweep, typename chunk_sweep, typename material_sweep>
+void
+water_grid::sweep_tiles(grid_planes const & from, grid_planes const & to, std::size_t chunk_y, row_sweep sweep_row, chunk_sweep chunk_sweep_row, material_sweep material_sweep_row, lane empty) {
+    auto const y_begin = std::max<std::size_t>(chunk_y * chunk_size, 1);
+    auto const y_end = std::min(chunk_y * chunk_size + chunk_size, from.height - 1);
+
+    auto const * chunks = m_chunk_awake.data() + chunk_y * m_chunks_x;
+    auto * dirty = m_chunk_dirty.data() + chunk_y * m_chunks_x;
+    auto * water = m_chunk_water.data() + chunk_y * m_chunks_x;
+    auto const * mixed_near = m_chunk_mixed_near.data() + chunk_y * m_chunks_x;
+    auto * mixed = m_chunk_mixed.data() + chunk_y * m_chunks_x;
+
+    std::vector<lane> carry(plane_layout::tile_width);
+
+    for (std::size_t chunk_x = 0; chunk_x < m_chunks_x; chunk_x++) {
+        if (!chunks[chunk_x]) continue;
+
+        auto const x_begin = std::max<std::size_t>(chunk_x * chunk_size, 1);
+        auto const x_end = std::min(chunk_x * chunk_size + chunk_size, from.width - 1);
+        fill_halo(from, m_layout, chunk_x, chunk_y);
+        auto const tile_from = tile_planes(from, m_layout, chunk_x, chunk_y);
+        auto const tile_to = tile_planes(to, m_layout, chunk_x, chunk_y);
+        std::fill(carry.begin(), carry.end(), empty);
+
+        // the same rows and kernels as sweep_rows picks for the chunk, in
+        // the tile's own coordinates
+        auto const begin = x_begin + plane_layout::halo_x - chunk_x * chunk_size;
+        auto const end = x_end + plane_layout::halo_x - chunk_x * chunk_size;
+
+        for (auto y = (y_begin > 1) ? y_begin - 1 : y_begin; y < y_end; y++) {
+            auto const writes = (y < y_begin) ? sweep_writes::CARRY : sweep_writes::ALL;
+            auto const row = y + plane_layout::halo_y - chunk_y * chunk_size;
+
+            sweep_result result;
+            if (mixed_near[chunk_x]) {
+                bool left_mixed = false;
+                result = material_sweep_row(tile_from, tile_to, row, begin, end, carry.data() + begin, writes, left_mixed);
+                mixed[chunk_x] |= left_mixed;
+            } else if (x_begin > 1 && x_end - x_begin == chunk_size && x_end < from.width - 1) {
+                result = chunk_sweep_row(tile_from, tile_to, row, begin, carry.data() + begin, writes);
+            } else {
+                result = sweep_row(tile_from, tile_to, row, begin, end, carry.data() + begin, writes);
+            }
+
+            dirty[chunk_x] |= result.moved;
+            water[chunk_x] |= result.water;
+        }
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::copy_chunk(grid_planes const & from, grid_planes const & to, std::size_t chunk_x, std::size_t chunk_y) const {
+    auto const x_begin = std::max<std::size_t>(chunk_x * chunk_size, 1);
+    auto const x_end = std::min(chunk_x * chunk_size + chunk_size, from.width - 1);
+    auto const y_begin = std::max<std::size_t>(chunk_y * chunk_size, 1);
+    auto const y_end = std::min(chunk_y * chunk_size + chunk_size, from.height - 1);
+
+    // a chunk of a tiled grid is one run. its border cells are the same in
+    // both buffers and its halo is filled before it is read, so they are
+    // copied along with the rest
+    auto copy = [&](auto const * source, auto * target) {
+        if (m_layout.kind == cell_layout::TILED) {
+            auto const first = m_layout.tile_first(chunk_x, chunk_y);
+            std::memcpy(target + first, source + first, plane_layout::tile_cells * sizeof(*source));
+            return;
+        }
+
+        auto const bytes = (x_end - x_begin) * sizeof(*source);
+
+        for (auto y = y_begin; y < y_end; y++) {
+            std::memcpy(target + x_begin + y * from.width, source + x_begin + y * from.width, bytes);
+        }
+    };
+
+    copy(from.types, to.types);
+
+    if (m_format == mass_format::FIXED16) {
+        copy(from.mass_fixed, to.mass_fixed);
+        copy(from.mass_next_fixed, to.mass_next_fixed);
+    } else {
+        copy(from.mass, to.mass);
+        copy(from.mass_next, to.mass_next);
+    }
+}
+
+//------------------------------------------------------------
+void
+water_grid::swap_buffers() {
+    m_front ^= 1;
+}
+
+//------------------------------------------------------------
+void
+water_grid::mark_dirty(int x, int y) {
+    auto const chunk = (x / chunk_size) + (y / chunk_size) * m_chunks_x;
+    m_chunk_dirty[chunk] = 1;
+    m_chunk_unsaved[chunk] = 1;
+    m_chunk_changed[chunk] = 1;
+    m_chunk_stale[chunk] = 1;
+}
+
+//------------------------------------------------------------
+void
+water_grid::take_chunks(std::vector<std::uint8_t> & flags, std::vector<std::size_t> & chunks) {
+    chunks.clear();
+
+    for (std::size_t i = 0; i < flags.size(); i++) {
+        if (flags[i]) {
+            chunks.push_back(i);
+        }
+    }
+
+    std::fill(flags.begin(), flags.end(), 0);
+}
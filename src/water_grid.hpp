@@ -0,0 +1,243 @@
+#ifndef WATER_GRID_HPP
+#define WATER_GRID_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// my
+#include "cell_plane.hpp"
+#include "flow_kernel.hpp"
+#include "material.hpp"
+
+class thread_pool;
+class world_file;
+
+//------------------------------------------------------------
+//                       water_grid                         //
+//------------------------------------------------------------
+
+// headless water simulation with a runtime sized, heap backed grid.
+// the outermost ring of cells is always ground, so the flow rules never
+// need to bounds check and edits to the border are ignored.
+//
+// cells are stored as a structure of arrays - one dense plane each for
+// material, mass and mass_next - so the material skip tests stream
+// through bytes and the mass math through contiguous floats.
+//
+// step() runs the flow kernel picked for this cpu at startup, see
+// flow_kernel.hpp. every kernel gives the same result as the scalar one.
+// those only know air, ground and water, so chunks with sand, oil, lava or
+// anything else from material_registry.hpp in or next to them run the
+// material kernels instead, see material_kernel.hpp. they give the same
+// result on water, so a scene of water alone never pays for them. below,
+// water means anything that moves.
+//
+// the grid is split into chunk_size x chunk_size chunks. a chunk is dirty
+// when water moved in it during the last tick or it was edited, and only
+// dirty chunks and their 8 neighbours are woken for the next tick. a chunk
+// that is not woken has neither moved nor had a neighbour move, so a tick
+// would leave it exactly as it is - sleeping is not an approximation.
+// awake chunks with no water in or next to them are skipped as well, so
+// the cost of a tick follows the water that is actually moving.
+//
+// the planes are double buffered. a tick reads the front buffer and sweeps
+// each awake chunk into the back one in a single pass - flows, clamping
+// and turning cells into air or water all at once, see sweep_fn - then the
+// two swap. a chunk that did not run but differs between the buffers, from
+// an edit or from running the tick before, is copied across instead. every
+// chunk reads only the front and writes only its own cells of the back, so
+// step(pool) runs the rows of chunks on the pool in one phase and the tick
+// is identical to step() for any thread count.
+//
+// with mass_format::FIXED16 the mass planes hold 16 bit fixed point
+// instead of floats, see flow_kernel.hpp. the float accessors convert,
+// edits are rounded to the nearest 1/128th and clamped to max_mass, and
+// mass_data() / mass_next_data() are only there for FLOAT32 grids.
+//
+// with cell_layout::TILED the planes are held a chunk to a tile, see
+// plane_layout, so the cells above and below are never more than a page
+// away. each tile has room about it for the cells its sweep reads, so a
+// tick fills that halo from the tiles around an awake chunk and sweeps
+// the chunk in place with the row major kernels. world files are row
+// major, so a grid made from one is as well.
+//
+// a grid made from a world_file works on the mapped planes in place, copy
+// on write, so loading costs nothing up front and pages are only read as
+// the simulation reaches them. the materials of a chunk are checked the
+// first time a tick reads it, and step() throws on a byte that is no
+// material before it writes anything. the back buffer is a second private
+// mapping of the same file, so it starts out equal without a copy. chunks
+// that changed since the last take_unsaved_chunks() are tracked for world_saver, and the same again
+// for take_changed_chunks() so drawing only redoes what changed.
+//
+// settle_basins() is an optional shortcut for water that would take
+// hundreds of ticks to level out. a basin is the open cells below the top
+// of a body of water, and when it has a single span of them per row the
+// rules can only end with the rows full from the bottom up and the rest
+// level on top, so that is written straight away with the same total
+// mass. anything else - spans split by ledges, water still pouring in or
+// more water than the basin holds - is left to the rules.
+class water_grid final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    water_grid(int width, int height, mass_format format = mass_format::FLOAT32, cell_layout layout = cell_layout::ROW_MAJOR) noexcept(false);
+    explicit water_grid(world_file const & file) noexcept(false);
+
+//                       functions                         //
+//------------------------------------------------------------
+    void step();
+    void step(thread_pool & pool);
+
+    bool is_settled() const;
+    std::size_t awake_chunk_count() const;
+
+    void set_kernel(flow_kernel const & kernel);
+    flow_kernel const & kernel() const;
+
+    void set_ground(int x, int y);
+    void set_air(int x, int y);
+    void set_water(int x, int y, float mass);
+
+    void clear();
+    void clear_water();
+
+    // bulk edits, clipped to the interior. each shape is written a row
+    // span at a time, straight through the planes, and only the chunks it
+    // touches are woken. corners and end points are inclusive and the mass
+    // is only kept for materials that move
+    void fill_rect(int x0, int y0, int x1, int y1, material type, float mass = 0.0f);
+    void fill_circle(int x, int y, int radius, material type, float mass = 0.0f);
+    void fill_line(int x0, int y0, int x1, int y1, int radius, material type, float mass = 0.0f);
+
+    // the 4 connected region of whatever material is at x, y
+    void flood_fill(int x, int y, material type, float mass = 0.0f);
+
+    // every interior cell of the given material turns into air
+    void clear_material(material type);
+
+    // jumps water in closed basins straight to where the flow rules would
+    // take it, see settle_basin(). only basins with water in a dirty chunk
+    // are looked at and the number that changed is returned
+    std::size_t settle_basins();
+
+    // raw cells for moving them between grids bit for bit, in the grid's
+    // own format - count material bytes, then count masses and count
+    // mass_next values as the planes hold them. writes are clipped to the
+    // interior and only wake the chunks where something is different
+    std::size_t cell_bytes() const;
+    void read_cells(int x, int y, int count, unsigned char * out) const;
+    void write_cells(int x, int y, int count, unsigned char const * in);
+
+    material material_at(int x, int y) const;
+    float mass_at(int x, int y) const;
+    float mass_next_at(int x, int y) const;
+    bool is_interior(int x, int y) const;
+
+    // the planes as they are held, layout().cell_count() long, for whole
+    // grid passes. cell x, y is at layout().index(x, y)
+    material const * material_data() const;
+    float const * mass_data() const;
+    float const * mass_next_data() const;
+    std::uint16_t const * fixed_mass_data() const;
+    std::uint16_t const * fixed_mass_next_data() const;
+
+    mass_format format() const;
+    plane_layout const & layout() const;
+
+    int width() const;
+    int height() const;
+
+    // bytes held by the cell planes and the chunk flags, mapped or not
+    std::size_t memory_bytes() const;
+
+    std::size_t chunks_x() const;
+    std::size_t chunks_y() const;
+    bool chunk_has_water(std::size_t chunk) const;
+
+    // the chunks changed since the last call, as x + y * chunks_x()
+    void take_unsaved_chunks(std::vector<std::size_t> & chunks);
+
+    // the same for whoever draws the grid, kept apart from the saver's
+    void take_changed_chunks(std::vector<std::size_t> & chunks);
+
+    static constexpr std::size_t chunk_size = 32;
+    static_assert(chunk_size == flow_chunk_span, "chunks run on flow_kernel::chunk_sweep");
+    static_assert(chunk_size == plane_layout::tile, "a tiled grid holds a chunk to a tile");
+
+private:
+    // one copy of the cell planes, only one pair of mass planes is in use
+    struct cell_buffer {
+        cell_plane<material> types;
+        cell_plane<float> mass;
+        cell_plane<float> mass_next;
+        cell_plane<std::uint16_t> mass_fixed;
+        cell_plane<std::uint16_t> mass_next_fixed;
+    };
+
+    // the one span of open cells a basin has in a row, begin == end if none
+    struct basin_row {
+        int begin = 0;
+        int end = 0;
+    };
+
+    std::size_t index(int x, int y) const;
+    cell_buffer & front();
+    cell_buffer const & front() const;
+    cell_buffer & back();
+    static grid_planes planes(cell_buffer & cells, std::size_t width, std::size_t height);
+
+    void wake_chunks();
+    void check_awake_chunks();
+    void sweep_chunk_row(grid_planes const & from, grid_planes const & to, std::size_t chunk_y);
+    template <typename lane, typename row_sweep, typename chunk_sweep, typename material_sweep>
+    void sweep_rows(grid_planes const & from, grid_planes const & to, std::size_t chunk_y, row_sweep sweep_row, chunk_sweep chunk_sweep_row, material_sweep material_sweep_row, lane empty);
+    template <typename lane, typename row_sweep, typename chunk_sweep, typename material_sweep>
+    void sweep_tiles(grid_planes const & from, grid_planes const & to, std::size_t chunk_y, row_sweep sweep_row, chunk_sweep chunk_sweep_row, material_sweep material_sweep_row, lane empty);
+    void copy_chunk(grid_planes const & from, grid_planes const & to, std::size_t chunk_x, std::size_t chunk_y) const;
+    void swap_buffers();
+    void mark_dirty(int x, int y);
+    static void take_chunks(std::vector<std::uint8_t> & flags, std::vector<std::size_t> & chunks);
+    void set_cell(cell_buffer & cells, std::size_t i, material type, float mass);
+    void fill_span(int y, int x_begin, int x_end, material type, float mass);
+    void mark_span(int y, int x_begin, int x_end, bool moves, bool mixed);
+    std::uint16_t to_fixed(float mass) const;
+    bool settle_basin(int x, int y, std::vector<std::uint8_t> & seen, std::vector<basin_row> & rows);
+    bool explore_basin(int x, int top, std::vector<basin_row> & rows) const;
+
+//                         data                             //
+//------------------------------------------------------------
+    int m_width;
+    int m_height;
+    cell_buffer m_cells[2];
+    std::size_t m_front;
+    mass_format m_format;
+    plane_layout m_layout;
+    flow_kernel const * m_kernel;
+
+    std::size_t m_chunks_x;
+    std::size_t m_chunks_y;
+    std::vector<std::uint8_t> m_chunk_dirty;
+    std::vector<std::uint8_t> m_chunk_awake;
+    std::vector<std::uint8_t> m_chunk_water;
+
+    // chunks holding a material that needs_material_kernels(), and the
+    // awake ones with such a chunk in their 3x3, which run on them
+    std::vector<std::uint8_t> m_chunk_mixed;
+    std::vector<std::uint8_t> m_chunk_mixed_near;
+    std::vector<std::uint8_t> m_chunk_unsaved;
+    std::vector<std::uint8_t> m_chunk_changed;
+
+    // chunks whose cells in the back buffer are not the current ones
+    std::vector<std::uint8_t> m_chunk_stale;
+
+    // chunks of a world file whose materials no tick has read yet, empty
+    // once there are none left
+    std::vector<std::uint8_t> m_chunk_unchecked;
+    std::size_t m_unchecked;
+
+}; // water_grid
+
+#endif // WATER_GRID_HPP
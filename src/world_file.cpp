@@ -0,0 +1,148 @@
+#include "world_file.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// my
+#include "water_grid.hpp"
+
+namespace {
+    std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+//------------------------------------------------------------
+//                    world_file_header                     //
+//------------------------------------------------------------
+
+constexpr char world_file_header::magic_bytes[8];
+
+//------------------------------------------------------------
+world_file_header
+world_file_header::make(int width, int height, mass_format format) {
+    world_file_header header {};
+
+    std::memcpy(header.magic, magic_bytes, sizeof(header.magic));
+    header.version = current_version;
+    header.format = static_cast<std::uint32_t>(format);
+    header.width = width;
+    header.height = height;
+    header.chunk_size = static_cast<std::uint32_t>(water_grid::chunk_size);
+    header.chunks_x = static_cast<std::uint32_t>((static_cast<std::size_t>(width) + water_grid::chunk_size - 1) / water_grid::chunk_size);
+    header.chunks_y = static_cast<std::uint32_t>((static_cast<std::size_t>(height) + water_grid::chunk_size - 1) / water_grid::chunk_size);
+
+    auto const cells = header.cell_count();
+
+    header.directory_offset = sizeof(world_file_header);
+    header.material_offset = align_up(header.directory_offset + header.chunk_count() * sizeof(world_file_chunk), plane_alignment);
+    header.mass_offset = align_up(header.material_offset + cells, plane_alignment);
+    header.mass_next_offset = align_up(header.mass_offset + cells * header.mass_bytes(), plane_alignment);
+    header.file_bytes = header.mass_next_offset + cells * header.mass_bytes();
+    return header;
+}
+
+//------------------------------------------------------------
+mass_format
+world_file_header::grid_format() const {
+    return static_cast<mass_format>(format);
+}
+
+//------------------------------------------------------------
+std::size_t
+world_file_header::mass_bytes() const {
+    return (grid_format() == mass_format::FIXED16) ? sizeof(std::uint16_t) : sizeof(float);
+}
+
+//------------------------------------------------------------
+std::size_t
+world_file_header::cell_count() const {
+    return static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+}
+
+//------------------------------------------------------------
+std::size_t
+world_file_header::chunk_count() const {
+    return static_cast<std::size_t>(chunks_x) * static_cast<std::size_t>(chunks_y);
+}
+
+//------------------------------------------------------------
+//                        world_file                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+world_file::world_file(std::string const & path) noexcept(false)
+:   m_mapping{std::make_shared<mapped_file>(path)} {
+
+    if (m_mapping->size() < sizeof(world_file_header)) {
+        throw std::runtime_error(path + " is too small to be a world file");
+    }
+    std::memcpy(&m_header, m_mapping->data(), sizeof(m_header));
+
+    if (std::memcmp(m_header.magic, world_file_header::magic_bytes, sizeof(m_header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a world file");
+    }
+
+    if (m_header.version != world_file_header::current_version) {
+        throw std::runtime_error(path + " is world file version " + std::to_string(m_header.version) + ", expected " + std::to_string(world_file_header::current_version));
+    }
+
+    if (m_header.format != static_cast<std::uint32_t>(mass_format::FLOAT32) && m_header.format != static_cast<std::uint32_t>(mass_format::FIXED16)) {
+        throw std::runtime_error(path + " has an unknown mass format");
+    }
+
+    if (m_header.width < 3 || m_header.height < 3) {
+        throw std::runtime_error(path + " holds a grid smaller than 3x3");
+    }
+
+    // the layout is fully decided by the size and format, so anything that
+    // does not match it exactly is damaged rather than some other variant
+    auto const expected = world_file_header::make(m_header.width, m_header.height, m_header.grid_format());
+
+    bool const layout_ok =
+        m_header.chunk_size == expected.chunk_size &&
+        m_header.chunks_x == expected.chunks_x &&
+        m_header.chunks_y == expected.chunks_y &&
+        m_header.directory_offset == expected.directory_offset &&
+        m_header.material_offset == expected.material_offset &&
+        m_header.mass_offset == expected.mass_offset &&
+        m_header.mass_next_offset == expected.mass_next_offset &&
+        m_header.file_bytes == expected.file_bytes;
+
+    if (!layout_ok) {
+        throw std::runtime_error(path + " has a damaged header");
+    }
+
+    if (m_mapping->size() < m_header.file_bytes) {
+        throw std::runtime_error(path + " is truncated");
+    }
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+world_file_header const &
+world_file::header() const {
+    return m_header;
+}
+
+//------------------------------------------------------------
+world_file_chunk const &
+world_file::chunk(std::size_t i) const {
+    return reinterpret_cast<world_file_chunk const *>(m_mapping->data() + m_header.directory_offset)[i];
+}
+
+//------------------------------------------------------------
+std::shared_ptr<mapped_file> const &
+world_file::mapping() const {
+    return m_mapping;
+}
+
+//------------------------------------------------------------
+std::string const &
+world_file::path() const {
+    return m_mapping->path();
+}
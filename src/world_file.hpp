@@ -0,0 +1,107 @@
+#ifndef WORLD_FILE_HPP
+#define WORLD_FILE_HPP
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// my
+#include "flow_kernel.hpp"
+#include "mapped_file.hpp"
+
+/*
+    ------------ world file format -------------
+    a binary snapshot of a water_grid, laid out so it can be mapped and used
+    in place. everything is little endian and native sized:
+
+    - world_file_header at offset 0
+    - the chunk directory: one world_file_chunk per chunk, row major
+    - the cell planes: material, mass and mass_next, each width * height
+      cells row major exactly as water_grid holds them, mass as float or
+      uint16 depending on the format. every plane starts on a page boundary
+
+    a save only rewrites the chunks that changed since the last one, the
+    directory entries of those chunks, and then the header with the new
+    generation.
+ */
+
+//------------------------------------------------------------
+//                    world_file_header                     //
+//------------------------------------------------------------
+
+struct world_file_header {
+    static constexpr char magic_bytes[8] = {'A', 'Q', 'B', 'W', 'O', 'R', 'L', 'D'};
+    static constexpr std::uint32_t current_version = 1;
+    static constexpr std::uint64_t plane_alignment = 4096;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t format;
+    std::int32_t width;
+    std::int32_t height;
+    std::uint32_t chunk_size;
+    std::uint32_t chunks_x;
+    std::uint32_t chunks_y;
+    std::uint32_t reserved;
+
+    // bumped by every save
+    std::uint64_t generation;
+
+    std::uint64_t directory_offset;
+    std::uint64_t material_offset;
+    std::uint64_t mass_offset;
+    std::uint64_t mass_next_offset;
+    std::uint64_t file_bytes;
+
+    // the layout of a new file for a grid like this
+    static world_file_header make(int width, int height, mass_format format);
+
+    mass_format grid_format() const;
+    std::size_t mass_bytes() const;
+    std::size_t cell_count() const;
+    std::size_t chunk_count() const;
+
+}; // world_file_header
+
+struct world_file_chunk {
+    // generation of the save that last wrote the chunk
+    std::uint64_t generation;
+    std::uint8_t water;
+    std::uint8_t reserved[7];
+};
+
+static_assert(sizeof(world_file_header) == 88, "world_file_header is part of the file format");
+static_assert(sizeof(world_file_chunk) == 16, "world_file_chunk is part of the file format");
+
+//------------------------------------------------------------
+//                        world_file                        //
+//------------------------------------------------------------
+
+// a world file mapped and checked, ready to hand to water_grid. nothing
+// past the header and the directory is read until the grid touches it,
+// and the grid checks each chunk's materials then.
+class world_file final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    explicit world_file(std::string const & path) noexcept(false);
+
+//                       functions                         //
+//------------------------------------------------------------
+    world_file_header const & header() const;
+    world_file_chunk const & chunk(std::size_t i) const;
+
+    std::shared_ptr<mapped_file> const & mapping() const;
+    std::string const & path() const;
+
+private:
+//                         data                             //
+//------------------------------------------------------------
+    std::shared_ptr<mapped_file> m_mapping;
+    world_file_header m_header;
+
+}; // world_file
+
+#endif // WORLD_FILE_HPP
@@ -0,0 +1,320 @@
+#include "world_saver.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+// my
+#include "profiler.hpp"
+#include "water_grid.hpp"
+
+namespace {
+
+// cells [x_begin, x_begin + count) of rows [y_begin, y_end), plane after
+// plane, onto the end of out. the file is row major whatever the grid is,
+// so each row is copied a run of the grid's layout at a time
+void
+append_rows(water_grid const & grid, std::size_t mass_bytes, std::size_t x_begin, std::size_t count, std::size_t y_begin, std::size_t y_end, std::vector<unsigned char> & out) {
+    auto const * material = reinterpret_cast<unsigned char const *>(grid.material_data());
+    auto const * mass = (grid.format() == mass_format::FIXED16) ? reinterpret_cast<unsigned char const *>(grid.fixed_mass_data()) : reinterpret_cast<unsigned char const *>(grid.mass_data());
+    auto const * mass_next = (grid.format() == mass_format::FIXED16) ? reinterpret_cast<unsigned char const *>(grid.fixed_mass_next_data()) : reinterpret_cast<unsigned char const *>(grid.mass_next_data());
+
+    unsigned char const * const planes[3] = {material, mass, mass_next};
+    std::size_t const sizes[3] = {1, mass_bytes, mass_bytes};
+    auto const & layout = grid.layout();
+
+    for (int p = 0; p < 3; p++) {
+        for (auto y = y_begin; y < y_end; y++) {
+            for (auto x = x_begin; x < x_begin + count;) {
+                auto const run = layout.run(x, x_begin + count - x);
+                auto const * cells = planes[p] + layout.index(x, y) * sizes[p];
+                out.insert(out.end(), cells, cells + run * sizes[p]);
+                x += run;
+            }
+        }
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------
+//                       world_saver                        //
+//------------------------------------------------------------
+
+
+//                         RAII                             //
+//------------------------------------------------------------
+world_saver::world_saver(std::string path) noexcept(false)
+:   m_path{std::move(path)}
+,   m_header{}
+,   m_generation{0}
+,   m_started{false}
+,   m_writing{false}
+,   m_stopping{false}
+,   m_failed{false} {
+
+    m_thread = std::thread([this] { loop(); });
+}
+
+//------------------------------------------------------------
+world_saver::world_saver(world_file const & file) noexcept(false)
+:   m_path{file.path()}
+,   m_header{file.header()}
+,   m_generation{file.header().generation}
+,   m_started{true}
+,   m_writing{false}
+,   m_stopping{false}
+,   m_failed{false} {
+
+    m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_file) {
+        throw std::runtime_error("could not open " + m_path + " for writing");
+    }
+
+    m_thread = std::thread([this] { loop(); });
+}
+
+//------------------------------------------------------------
+world_saver::~world_saver() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+//                       functions                         //
+//------------------------------------------------------------
+void
+world_saver::save(water_grid & grid) {
+    check();
+
+    auto header = world_file_header::make(grid.width(), grid.height(), grid.format());
+
+    if (m_started && (header.width != m_header.width || header.height != m_header.height || header.format != m_header.format)) {
+        throw std::invalid_argument("world_saver for " + m_path + " was given a different grid");
+    }
+
+    grid.take_unsaved_chunks(m_unsaved);
+
+    // nothing moved, nothing to write
+    if (m_started && m_unsaved.empty()) return;
+
+    header.generation = ++m_generation;
+
+    batch b;
+    b.header = header;
+    b.whole = !m_started;
+
+    if (b.whole) {
+        b.cells.reserve(header.cell_count() * (1 + 2 * header.mass_bytes()));
+        append_rows(grid, header.mass_bytes(), 0, static_cast<std::size_t>(header.width), 0, static_cast<std::size_t>(header.height), b.cells);
+
+        b.water.resize(header.chunk_count());
+        for (std::size_t i = 0; i < b.water.size(); i++) {
+            b.water[i] = grid.chunk_has_water(i);
+        }
+    } else {
+        // the chunks come in order, so neighbours in a row join up
+        for (auto const chunk : m_unsaved) {
+            bool const extends = !b.runs.empty() &&
+                b.runs.back().first + b.runs.back().count == chunk &&
+                chunk % header.chunks_x != 0;
+
+            if (extends) {
+                b.runs.back().count++;
+            } else {
+                b.runs.push_back({chunk, 1});
+            }
+            b.water.push_back(grid.chunk_has_water(chunk));
+        }
+
+        for (auto const & run : b.runs) {
+            copy_run(grid, header, run, b.cells);
+        }
+    }
+
+    m_header = header;
+    m_started = true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(b));
+    }
+    m_wake.notify_one();
+}
+
+//------------------------------------------------------------
+void
+world_saver::flush() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+    }
+    check();
+}
+
+//------------------------------------------------------------
+void
+world_saver::check() {
+    if (m_failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+//------------------------------------------------------------
+std::string const &
+world_saver::path() const {
+    return m_path;
+}
+
+//------------------------------------------------------------
+std::uint64_t
+world_saver::generation() const {
+    return m_generation;
+}
+
+//------------------------------------------------------------
+void
+world_saver::loop() {
+    AQUABLOCK_PROFILE_THREAD("saver");
+
+    for (;;) {
+        batch b;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+            // only stops once everything queued is written
+            if (m_queue.empty()) return;
+
+            b = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_writing = true;
+        }
+
+        // after a failed write the file is in an unknown state, so later
+        // batches are dropped rather than written on top of it
+        if (!m_failed.load(std::memory_order_relaxed)) {
+            try {
+                write(b);
+            } catch (...) {
+                m_error = std::current_exception();
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_writing = false;
+        }
+        m_idle.notify_all();
+    }
+}
+
+//------------------------------------------------------------
+void
+world_saver::write(batch const & b) {
+    AQUABLOCK_PROFILE_SCOPE("saver.write");
+    auto const & header = b.header;
+
+    if (b.whole) {
+        m_file.close();
+        m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_file) {
+            throw std::runtime_error("could not open " + m_path + " for writing");
+        }
+
+        std::vector<world_file_chunk> directory(header.chunk_count(), world_file_chunk{});
+        for (std::size_t i = 0; i < directory.size(); i++) {
+            directory[i].generation = header.generation;
+            directory[i].water = b.water[i];
+        }
+
+        auto const cells = header.cell_count();
+        auto const mass_bytes = cells * header.mass_bytes();
+
+        // the gaps up to each page aligned plane are left as holes
+        m_file.seekp(static_cast<std::streamoff>(header.directory_offset));
+        m_file.write(reinterpret_cast<char const *>(directory.data()), static_cast<std::streamsize>(directory.size() * sizeof(world_file_chunk)));
+        m_file.seekp(static_cast<std::streamoff>(header.material_offset));
+        m_file.write(reinterpret_cast<char const *>(b.cells.data()), static_cast<std::streamsize>(cells));
+        m_file.seekp(static_cast<std::streamoff>(header.mass_offset));
+        m_file.write(reinterpret_cast<char const *>(b.cells.data() + cells), static_cast<std::streamsize>(mass_bytes));
+        m_file.seekp(static_cast<std::streamoff>(header.mass_next_offset));
+        m_file.write(reinterpret_cast<char const *>(b.cells.data() + cells + mass_bytes), static_cast<std::streamsize>(mass_bytes));
+    } else {
+        write_runs(b);
+    }
+
+    // the header goes last, so its generation is only bumped once the
+    // cells it stands for are written
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    m_file.flush();
+
+    if (!m_file) {
+        throw std::runtime_error("could not write " + m_path);
+    }
+}
+
+//------------------------------------------------------------
+void
+world_saver::write_runs(batch const & b) {
+    auto const & header = b.header;
+    auto const width = static_cast<std::size_t>(header.width);
+    auto const height = static_cast<std::size_t>(header.height);
+    auto const mass_bytes = header.mass_bytes();
+
+    auto const * cells = b.cells.data();
+    auto const * water = b.water.data();
+
+    for (auto const & run : b.runs) {
+        auto const x_begin = (run.first % header.chunks_x) * water_grid::chunk_size;
+        auto const y_begin = (run.first / header.chunks_x) * water_grid::chunk_size;
+        auto const x_count = std::min(run.count * water_grid::chunk_size, width - x_begin);
+        auto const y_end = std::min(y_begin + water_grid::chunk_size, height);
+
+        // same order as copy_run
+        std::uint64_t const planes[3][2] = {
+            {header.material_offset, 1},
+            {header.mass_offset, mass_bytes},
+            {header.mass_next_offset, mass_bytes},
+        };
+
+        for (auto const & plane : planes) {
+            for (auto y = y_begin; y < y_end; y++) {
+                auto const row_bytes = x_count * plane[1];
+
+                m_file.seekp(static_cast<std::streamoff>(plane[0] + (x_begin + y * width) * plane[1]));
+                m_file.write(reinterpret_cast<char const *>(cells), static_cast<std::streamsize>(row_bytes));
+                cells += row_bytes;
+            }
+        }
+
+        std::vector<world_file_chunk> entries(run.count, world_file_chunk{});
+        for (auto & entry : entries) {
+            entry.generation = header.generation;
+            entry.water = *water++;
+        }
+
+        m_file.seekp(static_cast<std::streamoff>(header.directory_offset + run.first * sizeof(world_file_chunk)));
+        m_file.write(reinterpret_cast<char const *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(world_file_chunk)));
+    }
+}
+
+//------------------------------------------------------------
+void
+world_saver::copy_run(water_grid const & grid, world_file_header const & header, chunk_run const & run, std::vector<unsigned char> & out) {
+    auto const width = static_cast<std::size_t>(header.width);
+    auto const height = static_cast<std::size_t>(header.height);
+    auto const mass_bytes = header.mass_bytes();
+
+    auto const x_begin = (run.first % header.chunks_x) * water_grid::chunk_size;
+    auto const y_begin = (run.first / header.chunks_x) * water_grid::chunk_size;
+    auto const x_count = std::min(run.count * water_grid::chunk_size, width - x_begin);
+    auto const y_end = std::min(y_begin + water_grid::chunk_size, height);
+
+    append_rows(grid, mass_bytes, x_begin, x_count, y_begin, y_end, out);
+}
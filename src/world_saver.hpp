@@ -0,0 +1,110 @@
+#ifndef WORLD_SAVER_HPP
+#define WORLD_SAVER_HPP
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// my
+#include "world_file.hpp"
+
+class water_grid;
+
+//------------------------------------------------------------
+//                       world_saver                        //
+//------------------------------------------------------------
+
+// writes a water_grid to a world file on its own thread. save() is called
+// by whoever owns the grid, between ticks: it copies out only the chunks
+// that changed since the last save and queues them, so the tick is held up
+// by a copy of the dirty chunks and never by the disk. the first save of a
+// new saver writes the whole file.
+//
+// a saver made from the world_file a grid was loaded from carries on
+// writing that file incrementally - the grid maps it copy on write, so the
+// mapped pages it has not changed still match what is on disk.
+class world_saver final {
+public:
+//                         RAII                             //
+//------------------------------------------------------------
+    explicit world_saver(std::string path) noexcept(false);
+    explicit world_saver(world_file const & file) noexcept(false);
+
+    // finishes every queued save
+    ~world_saver();
+
+    world_saver(world_saver const &) = delete;
+    world_saver & operator=(world_saver const &) = delete;
+
+//                       functions                         //
+//------------------------------------------------------------
+    void save(water_grid & grid);
+
+    // blocks until every queued save is on disk
+    void flush();
+
+    // rethrows on the calling thread if a write failed
+    void check();
+
+    std::string const & path() const;
+    std::uint64_t generation() const;
+
+private:
+    // count chunks side by side in one row of chunks, so each row of cells
+    // in them is one contiguous write
+    struct chunk_run {
+        std::size_t first;
+        std::size_t count;
+    };
+
+    // one save: either every plane of the grid or some runs of chunks, each
+    // run as its material rows, then its mass rows, then its mass_next rows.
+    // water holds the flag of every chunk saved, in order
+    struct batch {
+        world_file_header header;
+        bool whole;
+        std::vector<chunk_run> runs;
+        std::vector<std::uint8_t> water;
+        std::vector<unsigned char> cells;
+    };
+
+    void loop();
+    void write(batch const & b);
+    void write_runs(batch const & b);
+
+    static void copy_run(water_grid const & grid, world_file_header const & header, chunk_run const & run, std::vector<unsigned char> & out);
+
+//                         data                             //
+//------------------------------------------------------------
+    std::string m_path;
+    world_file_header m_header;
+    std::uint64_t m_generation;
+    bool m_started;
+    std::vector<std::size_t> m_unsaved;
+
+    std::fstream m_file;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<batch> m_queue;
+    bool m_writing;
+    bool m_stopping;
+
+    std::atomic<bool> m_failed;
+    std::exception_ptr m_error;
+
+    std::thread m_thread;
+
+}; // world_saver
+
+#endif // WORLD_SAVER_HPP